@@ -0,0 +1,205 @@
+//compares the List and Queue of Utilities.h with the ones they replaced (LegacyContainers.h), in time and in allocations
+#include "LegacyContainers.h"
+
+#include <cstdio>
+#include <new>
+
+//every allocation of the program, to see what the containers ask the heap for
+static uint64_t allocNb = 0;
+
+void* operator new(size_t size)
+{
+	allocNb++;
+	void* data = malloc(size);
+	if (data == nullptr)
+		throw std::bad_alloc();
+	return data;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+//once these are inlined, gcc follows the copies of a shared memory on a path where its count is missing :
+//it sees their data freed twice there, which cannot happen (a shared memory with data always has a count)
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 12
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuse-after-free"
+#endif
+
+void operator delete(void* data)noexcept
+{
+	free(data);
+}
+
+void operator delete[](void* data)noexcept
+{
+	free(data);
+}
+
+void operator delete(void* data, size_t)noexcept
+{
+	free(data);
+}
+
+void operator delete[](void* data, size_t)noexcept
+{
+	free(data);
+}
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 12
+#pragma GCC diagnostic pop
+#endif
+
+//the rounds of every case, each one filling then emptying the container
+#define BENCH_ROUND_NB 2000
+//the batches pushed in a round, as a frame of the raytracer would
+#define BENCH_BATCH_NB 200
+//the elements of a batch, and how many a pop asks for
+#define BENCH_BATCH_SIZE 64
+#define BENCH_POP_SIZE 16
+
+typedef std::chrono::steady_clock bench_clock;
+
+struct bench_result
+{
+	double		_ms{ 0.0 };
+	uint64_t	_alloc_nb{ 0 };
+	//what the case read, so that the work is not optimized away
+	uint64_t	_checksum{ 0 };
+};
+
+/*===== Cases =====*/
+
+//pushes batches then pops them by smaller ones, round after round
+template<typename QueueType, typename T>
+bench_result QueueBatches(const T& data, uint32_t round_nb)
+{
+	bench_result result;
+	QueueType queue;
+
+	uint64_t firstAllocNb = allocNb;
+	bench_clock::time_point start = bench_clock::now();
+
+	for (uint32_t round = 0; round < round_nb; round++)
+	{
+		for (uint32_t i = 0; i < BENCH_BATCH_NB; i++)
+			queue.PushBatch(data, BENCH_BATCH_SIZE);
+
+		while (queue.GetNb() > 0)
+		{
+			uint32_t popNb = BENCH_POP_SIZE;
+			result._checksum += queue.PopBatch(popNb).offset;
+		}
+	}
+
+	result._ms			= std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+	result._alloc_nb	= allocNb - firstAllocNb;
+	queue.Clear();
+
+	return result;
+}
+
+//adds values then removes the head until the list is empty, round after round
+template<typename ListType, typename RemoveHead>
+bench_result ListRemoveHead(uint32_t round_nb, RemoveHead remove_head)
+{
+	bench_result result;
+	ListType list;
+
+	uint64_t firstAllocNb = allocNb;
+	bench_clock::time_point start = bench_clock::now();
+
+	for (uint32_t round = 0; round < round_nb; round++)
+	{
+		for (uint32_t i = 0; i < BENCH_BATCH_NB; i++)
+			list.Add(i);
+
+		while (list.Nb() > 0)
+		{
+			result._checksum += list.GetHead()->data;
+			remove_head(list);
+		}
+	}
+
+	result._ms			= std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+	result._alloc_nb	= allocNb - firstAllocNb;
+	list.Clear();
+
+	return result;
+}
+
+//adds values then clears the list, round after round
+template<typename ListType, typename ClearList>
+bench_result ListClear(uint32_t round_nb, ClearList clear_list)
+{
+	bench_result result;
+	ListType list;
+
+	uint64_t firstAllocNb = allocNb;
+	bench_clock::time_point start = bench_clock::now();
+
+	for (uint32_t round = 0; round < round_nb; round++)
+	{
+		for (uint32_t i = 0; i < BENCH_BATCH_NB; i++)
+			list.Add(i);
+
+		result._checksum += list.Nb();
+		clear_list(list);
+	}
+
+	result._ms			= std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+	result._alloc_nb	= allocNb - firstAllocNb;
+	list.Clear();
+
+	return result;
+}
+
+/*===== Report =====*/
+
+static bool Report(const char* name, const bench_result& legacy, const bench_result& current)
+{
+	printf("%-40s legacy %9.2f ms %9llu allocs | current %9.2f ms %9llu allocs\n", name,
+		legacy._ms, static_cast<unsigned long long>(legacy._alloc_nb),
+		current._ms, static_cast<unsigned long long>(current._alloc_nb));
+
+	//both containers should have given out the same elements
+	if (legacy._checksum != current._checksum)
+	{
+		printf("%s : the containers disagree (%llu against %llu)\n", name,
+			static_cast<unsigned long long>(legacy._checksum), static_cast<unsigned long long>(current._checksum));
+		return false;
+	}
+
+	return true;
+}
+
+int main()
+{
+	bool same = true;
+
+	{
+		static int rawData[BENCH_BATCH_SIZE];
+		same &= Report("Queue<int*> batches",
+			QueueBatches<legacy::Queue<int*>>(rawData, BENCH_ROUND_NB * 5),
+			QueueBatches<Queue<int*>>(rawData, BENCH_ROUND_NB * 5));
+	}
+
+	{
+		MultipleSharedMemory<int> sharedData(BENCH_BATCH_SIZE);
+		same &= Report("Queue<MultipleSharedMemory> batches",
+			QueueBatches<legacy::Queue<MultipleSharedMemory<int>>>(sharedData, BENCH_ROUND_NB),
+			QueueBatches<Queue<MultipleSharedMemory<int>>>(sharedData, BENCH_ROUND_NB));
+	}
+
+	same &= Report("List add / remove head",
+		ListRemoveHead<legacy::List<uint32_t>>(BENCH_ROUND_NB, [](legacy::List<uint32_t>& list) { list.RemoveHead(); }),
+		ListRemoveHead<List<uint32_t>>(BENCH_ROUND_NB, [](List<uint32_t>& list) { list.Remove(list.GetHead()); }));
+
+	same &= Report("List add / clear (keeping the nodes)",
+		ListClear<legacy::List<uint32_t>>(BENCH_ROUND_NB * 10, [](legacy::List<uint32_t>& list) { list.Clear(); }),
+		ListClear<List<uint32_t>>(BENCH_ROUND_NB * 10, [](List<uint32_t>& list) { list.Clear(false); }));
+
+	return same ? 0 : 1;
+}
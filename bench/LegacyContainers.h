@@ -0,0 +1,195 @@
+#ifndef __LEGACY_CONTAINERS_H__
+#define __LEGACY_CONTAINERS_H__
+
+#include "Utilities.h"
+
+/**
+* The List and Queue of Utilities.h as they were before the queue kept its batches in a ring and the list recycled its nodes,
+* kept to measure the current ones against. only what the benchmark calls is kept.
+*/
+namespace legacy
+{
+
+/**
+* the list allocating a node for every add and freeing it on every remove.
+*/
+template<typename T>
+class List
+{
+public:
+	struct ListNode
+	{
+		T data;
+
+		ListNode* prev{ nullptr };
+		ListNode* next{ nullptr };
+	};
+
+private:
+	ListNode* head{ nullptr };//first node
+	ListNode* toe{ nullptr };//last node
+
+	uint32_t	nb{ 0 };
+public:
+
+	/*===== Manipulation =====*/
+
+	__forceinline void Add(const T& data)
+	{
+		ListNode* newNode = new ListNode;
+		newNode->data = data;
+
+		if (head == nullptr)
+		{
+			head = newNode;
+			toe = newNode;
+		}
+		else if (toe != nullptr)
+		{
+			toe->next = newNode;
+			newNode->prev = toe;
+			toe = newNode;
+		}
+		nb++;
+	}
+
+	//only the head, the walk to the other nodes being broken
+	__forceinline void RemoveHead()
+	{
+		ListNode* node = head;
+		if (node->next != nullptr)
+		{
+			head = node->next;
+			head->prev = nullptr;
+		}
+		else
+		{
+			//the toe was left dangling there, which Clear would then free again
+			head = nullptr;
+			toe = nullptr;
+		}
+
+		delete node;
+		nb--;
+	}
+
+	/*===== Accessor =====*/
+
+	__forceinline ListNode* GetHead()const
+	{
+		return head;
+	}
+
+	__forceinline uint32_t Nb()const
+	{
+		return nb;
+	}
+
+	/*===== Memory Management =====*/
+
+	__forceinline void Clear()
+	{
+		if (toe == nullptr)
+			return;
+
+		//going from back
+		ListNode* iNode = toe;
+		do
+		{
+			//getting back next node to clear
+			ListNode* prevNode = iNode->prev;
+			//freeing current node
+			delete iNode;
+			//make next node to clear current node
+			iNode = prevNode;
+		} while (iNode != nullptr);
+
+		head = nullptr;
+		toe = nullptr;
+		nb = 0;
+	}
+};
+
+/**
+* the queue keeping its batches in a list, allocating a node for every push.
+*/
+template<typename T>
+class Queue
+{
+public:
+	typedef typename ::Queue<T>::QueueNode QueueNode;
+
+private:
+
+	List<QueueNode> nodes;
+	uint32_t nb{ 0 };
+
+public:
+	/*===== Manipulation =====*/
+
+	//pushing a new batch. the batch is considered to be allocated.
+	template<typename PolyT>
+	__forceinline void PushBatch(const PolyT& batch, uint32_t batchNb)
+	{
+		//creating the node
+		QueueNode newNode{};
+		newNode.data = (T)batch;
+		newNode.nb = batchNb;
+
+		//pushing it into the list
+		nodes.Add(newNode);
+
+		nb += batchNb;
+	}
+
+	//pops a batch. we cannot guarantee that you'll get all the requested data in the returned array, 
+	//therefore the nb you get is given in return ; as such you may need to call the method multiple times
+	__forceinline QueueNode PopBatch(uint32_t& wantedBatchNb)
+	{
+		if (nb <= 0)
+		{
+			wantedBatchNb = 0;
+			return QueueNode{};
+		}
+
+		QueueNode& headNode = nodes.GetHead()->data;
+		uint32_t remaining = headNode.nb;
+		if (remaining < wantedBatchNb)
+			wantedBatchNb = remaining;
+
+		QueueNode data = headNode;
+		headNode.offset += wantedBatchNb;
+		headNode.nb -= wantedBatchNb;
+		data.nb = wantedBatchNb;
+
+		if (headNode.nb <= 0)
+			nodes.RemoveHead();
+
+		nb -= wantedBatchNb;
+
+		return data;
+	}
+
+	/*===== Accessor =====*/
+
+	__forceinline uint32_t GetNb()const
+	{
+		return nb;
+	}
+
+	/*===== Memory Management =====*/
+
+	__forceinline void Clear()
+	{
+		//no need if already empty
+		if (nb <= 0)
+			return;
+
+		nodes.Clear();
+		nb = 0;
+	}
+};
+
+}
+
+#endif //__LEGACY_CONTAINERS_H__
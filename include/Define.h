@@ -36,6 +36,76 @@
 
 //Raytracing CPU Params
 #define MAX_CPU_COMPUTE_PER_FRAMES 25000
+#define CPU_RANDOM_SPHERE_GRID 2
+#define MAX_CPU_RANDOM_SPHERE_GRID 15
+#define CPU_RENDER_SEED 0
+#define CPU_TILE_SIZE 16
+#define CPU_PROGRESSIVE_TARGET_SPP 256
+#define MAX_CPU_PROGRESSIVE_TARGET_SPP 4096
+#define CPU_PROGRESSIVE_NOISE_THRESHOLD 0.01f
+#define CPU_ADAPTIVE_MIN_SPP 16
+#define CPU_REPROJECTION true
+//the relative difference of depth over which a reprojected sample is seen as a different surface (a disocclusion)
+#define CPU_REPROJECTION_DEPTH_TOLERANCE 0.02f
+//the most samples a pixel keeps from the previous image, so that the new point of view soon outweighs it
+#define CPU_REPROJECTION_MAX_SPP 64.0f
+#define MAX_CPU_ADAPTIVE_MIN_SPP 256
+#define CPU_TARGET_FRAME_TIME 16.6f
+#define MAX_CPU_TARGET_FRAME_TIME 100.0f
+#define CPU_JOBS_PER_WORKER 2
+#define CPU_MIN_RAYS_PER_JOB 64
+#define CPU_DEFAULT_RAYS_PER_MS 500.0f
+#define CPU_THROUGHPUT_SMOOTHING 0.1f
+#define CPU_DYNAMIC_RESOLUTION true
+//the preview traces a ray for blocks of up to this side (a power of two, dividing CPU_TILE_SIZE)
+#define CPU_MAX_PREVIEW_SCALE 8
+//the part of the frame the preview is sized for, the rest being left to the main thread
+#define CPU_PREVIEW_FRAME_SHARE 0.75f
+//the preview only gets sharper once the sharper one would fit in this part of its rays
+#define CPU_PREVIEW_HYSTERESIS 0.7f
+#define CPU_WAVEFRONT_SIZE 65536
+#define CPU_WAVEFRONT_CHUNK 1024
+#define CPU_LIGHT_SAMPLING true
+#define CPU_SAMPLE_SEQUENCE sample_sequence::SOBOL
+//the format the cpu image is sent to the GPU in, and the number of images the staging memory holds (one shown, one written)
+#define CPU_DISPLAY_FORMAT display_format::RGBA8
+#define CPU_DISPLAY_BUFFER_NB 2
+//the side of the tiles the image is sent to the GPU by (a multiple of CPU_TILE_SIZE, so that a render job's tile is in a single one)
+#define CPU_DISPLAY_TILE_SIZE 64
+//the rays are counted by depth up to this one (the camera rays being at 0), the deeper ones with the last
+#define CPU_STATS_DEPTH_NB 8
+//the number of frames the statistics keep, for the graphs and the export
+#define CPU_STATS_HISTORY_NB 240
+#define CPU_STATS_EXPORT_PATH "RaytraceCPUStats.json"
+
+//enum to get how the CPU raytracer distributes its work
+enum class CPURenderMode
+{
+	RAY_HEAP = 0,//every ray of every sample is stored in a heap, and computed by batches
+	TILES = 1,//every path of a small tile of the screen is computed from start to end by the same job
+	WAVEFRONT = 2,//the paths are traced by waves, each stage (generate, extend, shade, accumulate) running on the whole wave at once
+
+	NB
+};
+
+#define CPU_RENDER_MODE CPURenderMode::RAY_HEAP
+
+//the models the CPU raytracer can trace, and how big they are in its scene
+#define CPU_MODEL_PATH "../../../media/Duck/Duck.gltf"
+#define CPU_MODEL_HEIGHT 10.0f
+#define CPU_CORNELL_BOX_SCALE 30.0f
+
+//enum to get what the CPU raytracer's scene is made of
+enum class CPUSceneType
+{
+	RANDOM_SPHERES = 0,//example spheres surrounded by a grid of random spheres
+	CORNELL_BOX = 1,//the triangle mesh of the cornell box of the other scenes
+	MODEL = 2,//a glTF model on the ground
+
+	NB
+};
+
+#define CPU_SCENE_TYPE CPUSceneType::RANDOM_SPHERES
 
 
 struct RaytracingParams
@@ -50,6 +120,46 @@ struct RaytracingParams
 	uint32_t	_max_depth{ BOUNCE_DEPTH };
 };
 
+//Offline CPU Render Init Values
+#define OFFLINE_RENDER_WIDTH 1280
+#define OFFLINE_RENDER_HEIGHT 720
+#define OFFLINE_RENDER_OUTPUT "RaytraceCPU.png"
+
+//what the command line asks the CPU raytracer to render, without any window
+struct OfflineRenderParams
+{
+	//the size of the image
+	uint32_t			_width{ OFFLINE_RENDER_WIDTH };
+	uint32_t			_height{ OFFLINE_RENDER_HEIGHT };
+	//the samples, depth and background of the render
+	RaytracingParams	_rtParams;
+	//the seed of both the scene and the render, so that two renders give out the same image
+	uint32_t			_seed{ CPU_RENDER_SEED };
+	//what the scene is made of
+	CPUSceneType		_scene_type{ CPU_SCENE_TYPE };
+	//the half size of the grid on which random spheres are created
+	uint32_t			_random_sphere_grid{ CPU_RANDOM_SPHERE_GRID };
+	//the glTF file of the model scene
+	const char*			_model_path{ CPU_MODEL_PATH };
+	//how the work is distributed between jobs
+	CPURenderMode		_render_mode{ CPU_RENDER_MODE };
+	//whether the samples are added one pass at a time, each pass leaving out the tiles that are clean enough
+	//(the samples of the raytracing params are then the most a pixel gets)
+	bool				_adaptive{ false };
+	//the relative noise under which a tile gets no more samples
+	float				_noise_threshold{ CPU_PROGRESSIVE_NOISE_THRESHOLD };
+	//whether the image written is the heatmap of the samples of each pixel
+	bool				_sample_heatmap{ false };
+	//whether the diffuse hits sample the scene's light through shadow rays
+	bool				_light_sampling{ CPU_LIGHT_SAMPLING };
+	//the sequence the random numbers of the paths come from
+	sample_sequence		_sample_sequence{ CPU_SAMPLE_SEQUENCE };
+	//the number of threads rendering (0 for one per core)
+	uint32_t			_thread_nb{ 0 };
+	//where the image is written (png, or hdr if the path ends with .hdr)
+	const char*			_output_path{ OFFLINE_RENDER_OUTPUT };
+};
+
 /*==== LIGHT PARAMS ====*/
 
 //enum to get the type of light currently processed
@@ -70,6 +180,10 @@ enum class LightType
 
 #define INIT_DIR_LIGHT {INIT_LIGHT_DIR, 0.0f, INIT_LIGHT_COLOR, LightType::DIRECTIONNAL}
 
+//the CPU raytracer's scenes are y up, its light comes from above
+#define CPU_LIGHT_DIR vec3( 0.5f, 1.0f, 0.3f)
+#define CPU_DIR_LIGHT {CPU_LIGHT_DIR, 0.0f, INIT_LIGHT_COLOR, LightType::DIRECTIONNAL}
+
 //Light UI MAX MIN
 #define LIGHT_DIR_EDIT_MAX 1.0f
 #define LIGHT_DIR_EDIT_MIN -1.0f
@@ -26,6 +26,361 @@ __forceinline float randf(float min, float max)
 	return min + (max - min) * (static_cast<float>(rand()) / static_cast<float>(RAND_MAX));
 }
 
+//utility function to scramble an integer, to turn structured inputs (such as pixel indices) into well distributed seeds (this is the "pcg hash")
+__forceinline uint32_t hash_uint(uint32_t x)
+{
+	uint32_t state	= x * 747796405u + 2891336453u;
+	uint32_t word	= ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+//utility function to get the position of the d-th cell along a hilbert curve going through a side x side grid (side must be a power of two).
+//cells next to each other on the curve are always next to each other in the grid.
+__forceinline void hilbert_to_xy(uint32_t side, uint32_t d, uint32_t& x, uint32_t& y)
+{
+	x = y = 0;
+	for (uint32_t s = 1; s < side; s *= 2)
+	{
+		uint32_t rx = 1 & (d / 2);
+		uint32_t ry = 1 & (d ^ rx);
+
+		//rotating the quadrant so that the curve stays continuous
+		if (ry == 0)
+		{
+			if (rx == 1)
+			{
+				x = s - 1 - x;
+				y = s - 1 - y;
+			}
+			uint32_t tmp = x;
+			x = y;
+			y = tmp;
+		}
+
+		x += s * rx;
+		y += s * ry;
+		d /= 4;
+	}
+}
+
+/*
+* a small random number generator (PCG32, see https://www.pcg-random.org), with its own state.
+* unlike randf, it is not shared : an object can be owned by each thread, and seeded to get a reproducible sequence.
+*/
+struct pcg32
+{
+	//the current state of the generator
+	uint64_t state{ 0x853c49e6748fea9bull };
+	//the increment, which selects the stream (must be odd)
+	uint64_t inc{ 0xda3e39cb94b95bdbull };
+
+	pcg32() = default;
+	pcg32(uint64_t init_state, uint64_t init_stream)
+	{
+		seed(init_state, init_stream);
+	}
+
+	//restarts the generator at a new position, on one of 2^63 possible streams
+	__forceinline void seed(uint64_t init_state, uint64_t init_stream)
+	{
+		state	= 0u;
+		inc		= (init_stream << 1u) | 1u;
+		next_uint();
+		state += init_state;
+		next_uint();
+	}
+
+	//gives out a random number on 32 bits
+	__forceinline uint32_t next_uint()
+	{
+		uint64_t old_state = state;
+		state = old_state * 6364136223846793005ull + inc;
+		uint32_t xorshifted = static_cast<uint32_t>(((old_state >> 18u) ^ old_state) >> 27u);
+		uint32_t rot		= static_cast<uint32_t>(old_state >> 59u);
+		return (xorshifted >> rot) | (xorshifted << ((32u - rot) & 31u));
+	}
+
+	//gives out a random number between 0.0f and 1.0f (1.0f excluded)
+	__forceinline float next_float()
+	{
+		//only 24 bits fit in a float's mantissa
+		return static_cast<float>(next_uint() >> 8u) * (1.0f / 16777216.0f);
+	}
+
+	//gives out a random number between min and max
+	__forceinline float next_float(float min, float max)
+	{
+		return min + (max - min) * next_float();
+	}
+};
+
+/*===== Low Discrepancy Sampling =====*/
+
+//utility function to reverse the order of the bits of an integer
+__forceinline uint32_t reverse_bits(uint32_t x)
+{
+	x = ((x >> 1u) & 0x55555555u) | ((x & 0x55555555u) << 1u);
+	x = ((x >> 2u) & 0x33333333u) | ((x & 0x33333333u) << 2u);
+	x = ((x >> 4u) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4u);
+	x = ((x >> 8u) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8u);
+	return (x >> 16u) | (x << 16u);
+}
+
+/*
+* utility function to scramble an integer so that each bit only depends on itself and the bits below it,
+* (see "Practical Hash-based Owen Scrambling", Burley 2020, after Laine and Karras).
+*/
+__forceinline uint32_t laine_karras_permutation(uint32_t x, uint32_t seed)
+{
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return x;
+}
+
+/*
+* utility function to Owen scramble a fixed point number in [0, 1) (the first bit being the half) :
+* each bit is flipped depending on the bits above it, which keeps the stratification of a sequence while decorrelating it.
+* used on an index, it is also a way to shuffle a sequence without breaking it.
+*/
+__forceinline uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed)
+{
+	return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+}
+
+/*
+* utility function to get the index-th point of the first (dimension 0) or second (dimension 1) dimension of the Sobol sequence,
+* as a fixed point number in [0, 1). both dimensions together are a (0,2) sequence : any power of two of consecutive points
+* are perfectly stratified over the square.
+*/
+__forceinline uint32_t sobol(uint32_t index, uint32_t dimension)
+{
+	//the first dimension is the van der corput sequence
+	if (dimension == 0)
+		return reverse_bits(index);
+
+	uint32_t result = 0;
+	for (uint32_t v = 1u << 31u; index != 0; index >>= 1u, v ^= v >> 1u)
+		if (index & 1u)
+			result ^= v;
+	return result;
+}
+
+//the side of the blue noise tile, which must be a power of two
+#define BLUE_NOISE_TILE_SIZE 64
+
+/*
+* a tile of BLUE_NOISE_TILE_SIZE x BLUE_NOISE_TILE_SIZE values in [0, 1), each value being used once, spread so that close pixels
+* get values far apart (it wraps around, so it can be repeated over the screen without seams).
+* it is made with the void and cluster method (Ulichney 1993) : the pixels are ranked one by one in the biggest hole of the ones ranked before.
+*/
+struct blue_noise_mask
+{
+	float values[BLUE_NOISE_TILE_SIZE * BLUE_NOISE_TILE_SIZE];
+
+	blue_noise_mask()
+	{
+		const uint32_t side		= BLUE_NOISE_TILE_SIZE;
+		const uint32_t pixel_nb	= side * side;
+		//how far the pixels push each other
+		const float sigma		= 1.5f;
+
+		//the energy a pixel gives to another, only depending on the (wrapped around) offset between them
+		float* filter	= new float[pixel_nb];
+		//the energy every pixel gets from the pixels that are set
+		float* energy	= new float[pixel_nb];
+		//whether a pixel is set
+		bool* pattern	= new bool[pixel_nb];
+		for (uint32_t y = 0; y < side; y++)
+			for (uint32_t x = 0; x < side; x++)
+			{
+				float dx = static_cast<float>(x < side / 2 ? x : side - x);
+				float dy = static_cast<float>(y < side / 2 ? y : side - y);
+				filter[y * side + x] = expf(-(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+				energy[y * side + x] = 0.0f;
+				pattern[y * side + x] = false;
+			}
+
+		//sets or unsets a pixel, updating the energy of every other
+		auto toggle = [&](uint32_t pixel)
+		{
+			pattern[pixel]	= !pattern[pixel];
+			float sign		= pattern[pixel] ? 1.0f : -1.0f;
+			uint32_t px = pixel % side, py = pixel / side;
+			for (uint32_t y = 0; y < side; y++)
+				for (uint32_t x = 0; x < side; x++)
+					energy[y * side + x] += sign * filter[((y - py) & (side - 1)) * side + ((x - px) & (side - 1))];
+		};
+		//the set pixel with the most energy (the tightest cluster) or the unset one with the least (the biggest void)
+		auto find = [&](bool cluster)
+		{
+			uint32_t best = 0;
+			float best_energy = cluster ? -FLT_MAX : FLT_MAX;
+			for (uint32_t i = 0; i < pixel_nb; i++)
+				if (pattern[i] == cluster && (cluster ? energy[i] > best_energy : energy[i] < best_energy))
+				{
+					best		= i;
+					best_energy = energy[i];
+				}
+			return best;
+		};
+
+		//a random tenth of the pixels to start with, always the same
+		const uint32_t initial_nb = pixel_nb / 10;
+		uint32_t state = 1;
+		for (uint32_t set_nb = 0; set_nb < initial_nb;)
+		{
+			state = hash_uint(state);
+			if (!pattern[state % pixel_nb])
+			{
+				toggle(state % pixel_nb);
+				set_nb++;
+			}
+		}
+
+		//moving the tightest cluster into the biggest void, until the pattern is evenly spread
+		for (uint32_t i = 0; i < pixel_nb; i++)
+		{
+			uint32_t cluster = find(true);
+			toggle(cluster);
+			uint32_t hole = find(false);
+			toggle(hole);
+			if (hole == cluster)
+				break;
+		}
+
+		//the initial pixels get the lowest ranks, the tightest cluster being the last of them
+		bool* initial_pattern	= new bool[pixel_nb];
+		float* initial_energy	= new float[pixel_nb];
+		for (uint32_t i = 0; i < pixel_nb; i++)
+		{
+			initial_pattern[i]	= pattern[i];
+			initial_energy[i]	= energy[i];
+		}
+		for (uint32_t rank = initial_nb; rank > 0; rank--)
+		{
+			uint32_t cluster = find(true);
+			toggle(cluster);
+			values[cluster] = static_cast<float>(rank - 1) / static_cast<float>(pixel_nb);
+		}
+
+		//the other pixels are ranked in the biggest void left by the ones before them
+		for (uint32_t i = 0; i < pixel_nb; i++)
+		{
+			pattern[i]	= initial_pattern[i];
+			energy[i]	= initial_energy[i];
+		}
+		for (uint32_t rank = initial_nb; rank < pixel_nb; rank++)
+		{
+			uint32_t hole = find(false);
+			toggle(hole);
+			values[hole] = static_cast<float>(rank) / static_cast<float>(pixel_nb);
+		}
+
+		delete[] filter;
+		delete[] energy;
+		delete[] pattern;
+		delete[] initial_pattern;
+		delete[] initial_energy;
+	}
+};
+
+//gives out the blue noise tile, which is made on the first call
+inline const float* blue_noise_tile()
+{
+	static const blue_noise_mask mask;
+	return mask.values;
+}
+
+//the kind of sequences a sampler gives out its random numbers from
+enum class sample_sequence
+{
+	WHITE_NOISE	= 0,//independent random numbers
+	SOBOL		= 1,//an Owen scrambled Sobol sequence, scrambled differently for every pixel
+	BLUE_NOISE	= 2,//the same Owen scrambled Sobol sequence for every pixel, shifted by a blue noise tile repeated over the screen
+
+	NB
+};
+
+/*
+* a sampler giving out the numbers of a single sample (a point of a sequence), one dimension after the other.
+* with a Sobol sequence, the samples of a pixel fill up the space far better than random numbers, so the pixel converges with fewer samples.
+* the dimensions are taken by pairs, each pair being its own 2D Sobol sequence shuffled and scrambled differently,
+* so a pair of numbers used together (such as a direction) should be drawn together, starting on an even dimension.
+*/
+struct sequence_sampler
+{
+	//the random numbers, for white noise
+	pcg32		white;
+	//the sequence the numbers come from
+	sample_sequence sequence{ sample_sequence::WHITE_NOISE };
+	//the index of the point in the sequence (the index of the sample)
+	uint32_t	index{ 0 };
+	//the seed scrambling the sequence
+	uint32_t	seed{ 0 };
+	//the position in the blue noise tile, for blue noise
+	uint32_t	tile_x{ 0 }, tile_y{ 0 };
+	//the next dimension to give out
+	uint32_t	dimension{ 0 };
+
+	sequence_sampler() = default;
+	sequence_sampler(const pcg32& white_) :
+		white{ white_ }
+	{
+	}
+	sequence_sampler(sample_sequence sequence_, uint32_t index_, uint32_t seed_, uint32_t tile_x_ = 0, uint32_t tile_y_ = 0) :
+		sequence{ sequence_ },
+		index{ index_ },
+		seed{ seed_ },
+		tile_x{ tile_x_ & (BLUE_NOISE_TILE_SIZE - 1) },
+		tile_y{ tile_y_ & (BLUE_NOISE_TILE_SIZE - 1) }
+	{
+	}
+
+	//gives out the next dimension of the sample, between 0.0f and 1.0f (1.0f excluded)
+	__forceinline float next_float()
+	{
+		if (sequence == sample_sequence::WHITE_NOISE)
+			return white.next_float();
+
+		uint32_t pair	= dimension >> 1u;
+		uint32_t axis	= dimension & 1u;
+		dimension++;
+
+		//every pair has its own shuffled sequence, so that the pairs are not correlated with each other
+		uint32_t pair_seed	= hash_uint(seed ^ hash_uint(pair));
+		uint32_t shuffled	= nested_uniform_scramble(index, pair_seed);
+		uint32_t point		= nested_uniform_scramble(sobol(shuffled, axis), hash_uint(pair_seed + axis + 1u));
+		float value			= static_cast<float>(point >> 8u) * (1.0f / 16777216.0f);
+
+		if (sequence == sample_sequence::BLUE_NOISE)
+		{
+			//the tile is shifted for every dimension, so that the dimensions get different values
+			uint32_t shift	= hash_uint(seed ^ dimension);
+			uint32_t x		= (tile_x + shift) & (BLUE_NOISE_TILE_SIZE - 1);
+			uint32_t y		= (tile_y + (shift >> 16u)) & (BLUE_NOISE_TILE_SIZE - 1);
+			value += blue_noise_tile()[y * BLUE_NOISE_TILE_SIZE + x];
+			value = value >= 1.0f ? value - 1.0f : value;
+		}
+
+		return value;
+	}
+
+	//gives out the next dimension of the sample, between min and max
+	__forceinline float next_float(float min, float max)
+	{
+		return min + (max - min) * next_float();
+	}
+
+	//moves on to dimension_, so that a use of the sample always gets the same dimensions whatever was drawn before it
+	__forceinline void skip_to(uint32_t dimension_)
+	{
+		dimension = dimension < dimension_ ? dimension_ : dimension;
+	}
+};
+
 /* struct representing a mathematical 2 dimensional vector. it has been made to resemble the one you may encounter in glsl or hlsl. */
 struct vec2
 {
@@ -11,17 +11,54 @@
 #include "AppWideContext.h"
 #include "Define.h"
 
-//utilities include
-#include "RaytraceCPUHelper.h"
+//utilities include (the materials are needed to call them without the virtual interface)
+#include "RaytraceCPUHelper.inl"
+#include "RaytraceCPUBVH.h"
+#include "RaytraceCPUSIMD.h"
+#include "RaytraceCPUMesh.h"
+#include "RaytraceCPUWavefront.h"
+#include "RaytraceCPUDisplay.h"
+#include "RaytraceCPUStats.h"
 
 //for multithreading
-#include <mutex>
+#include <atomic>
+//to time the jobs
+#include <chrono>
 
 //defines for init values
 #define RAY_TO_COMPUTE_PER_FRAME 2700
+#define SPHERE_BENCHMARK_RAY_NB 8192
 
 typedef Queue<MultipleSharedMemory<ray_compute>>::QueueNode RayBatch;
 
+/*
+* the memory a thread of the pool shades its batches of rays in, kept from one job to the next so that the jobs do not allocate.
+* only the job running on the thread uses it, and it only grows when a job has more rays than any before.
+*/
+struct shading_scratch
+{
+	//the closest hit of every ray that goes on, in the order of the batch
+	MultipleScopedMemory<hit_record>	_Hits;
+	//the same hits sorted by material type, and the index of their ray in the batch
+	MultipleScopedMemory<hit_record>	_SortedHits;
+	MultipleScopedMemory<uint32_t>		_RayIndices;
+	//the number of rays the memory has room for
+	uint32_t							_capacity{ 0 };
+	//so that two threads never write the same cache line
+	uint8_t								_padding[CACHE_LINE_SIZE];
+
+	__forceinline void reserve(uint32_t nb)
+	{
+		if (nb <= _capacity)
+			return;
+
+		_Hits.Alloc(nb);
+		_SortedHits.Alloc(nb);
+		_RayIndices.Alloc(nb);
+		_capacity = nb;
+	}
+};
+
 
 /**
 * This class is a scene to do the Raytracing in One Week-End tutorial.
@@ -67,16 +104,18 @@ private:
 	VkDeviceMemory						_GPULocalImageMemory{VK_NULL_HANDLE};
 	//the size of a single ImageBuffer on GPU
 	VkDeviceSize						_GPULocalImageBufferSize{0};
+	//the version of the shown image each local image got, to only copy an image once in each of them
+	MultipleScopedMemory<uint32_t>		_GPULocalImageVersions;
 
 
-	//the Buffer object that stages the new image each frame
+	//the Buffer objects of each image of the staging memory (CPU_DISPLAY_BUFFER_NB of them)
 	MultipleScopedMemory<VkBuffer>	_ImageCopyBuffer;
-	//the allocated memory on GPU mapped on CPU memory
-	VkDeviceMemory					_ImageCopyMemory;
-	//the mapped CPU memory that the GPU copies to get the image
-	MultipleScopedMemory<void*>		_MappedCPUImage;
+	//the allocated memory on GPU mapped on CPU memory, for as long as it is allocated
+	VkDeviceMemory					_ImageCopyMemory{ VK_NULL_HANDLE };
 	//the size of a single copy Buffer on GPU
 	VkDeviceSize					_ImageCopyBufferSize{ 0 };
+	//the regions of the changed tiles copied from the staging memory each frame (as many as there are tiles at most)
+	MultipleScopedMemory<VkBufferImageCopy>	_ImageCopyRegions;
 
 	/*
 	* Creates the necessary resources for displaying with vulkan.
@@ -169,36 +208,401 @@ public:
 	/*===== CPU Raytracing =====*/
 
 	/*
-	* the general multithreaded job interface used to compute RayBatches concurrently
+	* the general multithreaded job interface that knows the scene, and how to find the closest hit of a ray in it
 	*/
-	class RaytraceJob : public ThreadJob
+	class SceneRaytraceJob : public ThreadJob
 	{
 		public:
-			RaytraceJob(const RayBatch& RayBatch, const RaytraceCPU& Owner) :
-				_Computes{RayBatch},
+			SceneRaytraceJob(const RaytraceCPU& Owner) :
 				_Scene{Owner._Scene},
+				_SceneBVH{Owner._SceneBVH},
+				_SceneSpheres{Owner._SceneSpheres},
+				_Materials{Owner._Materials},
+				_sphere_kernel{ Owner._use_sphere_soa && Owner._SceneSpheres._nb == Owner._SceneBVH._prim_nb ? Owner._SceneSpheres._kernel : nullptr },
 				_background_gradient_top{ Owner._rtParams._background_gradient_top},
 				_background_gradient_bottom{ Owner._rtParams._background_gradient_bottom },
-				_depth{ Owner._rtParams._max_depth}
+				_Light{ Owner._light },
+				_light_sampling{ Owner._light_sampling },
+				_depth{ Owner._rtParams._max_depth},
+				_Sampling{ Owner._render_seed, Owner._sample_sequence, Owner._FullScreenScissors.extent.width },
+				_Throughput{ Owner._RayThroughput },
+				_Stats{ Owner._RenderStats }
 			{
 			}
 
-			//the batch this multithreaded job is supposed to accomplish
-			RayBatch							_Computes;
 			//the scene on which the ray need to be tested
 			const ScopedLoopArray<hittable*>&	_Scene;
+			//the acceleration structure built over the scene's objects
+			const bvh&							_SceneBVH;
+			//the spheres of the scene as a structure of arrays, in the order of the bvh's leaves
+			const sphere_soa&					_SceneSpheres;
+			//the materials of the scene, that the spheres' material ids refer to
+			const ScopedLoopArray<material*>&	_Materials;
+			//the kernel to intersect the spheres with, or nullptr to go through each hittable's hit
+			sphere_soa::hit_kernel				_sphere_kernel;
 			//the color for the top of the background gradient 
 			vec4								_background_gradient_top;
 			//the color for the bottom of the background gradient 
 			vec4								_background_gradient_bottom;
+			//the light of the scene
+			Light								_Light;
+			//whether the diffuse hits sample the light
+			bool								_light_sampling;
 			//the max allowed generated rays depth
 			uint32_t							_depth;
+			//the seed and sequence of the render, from which every path gets its own random sequence
+			path_sampling						_Sampling;
+			//the random number generator of this job, seeded again for each bounce it computes
+			mutable sequence_sampler			_Sampler;
+			//where the job tells how many rays it traced and how long it took, for the scheduler
+			ray_throughput&						_Throughput;
+			//the number of rays traced by this job so far
+			mutable uint64_t					_ray_nb{ 0 };
+			//where the job tells what it traced, for the statistics
+			render_stats&						_Stats;
+			//what this job traced so far, by depth, and how much of the scene it went through to do so
+			mutable trace_counters				_Counters;
+
+			/*
+			* gives the rays traced by this job and the time it took since start to the scheduler, and what it traced to the statistics.
+			*/
+			__forceinline void RecordThroughput(const std::chrono::high_resolution_clock::time_point& start)const
+			{
+				uint64_t busyNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count());
+				_Throughput.record(_ray_nb, busyNs);
+				_ray_nb = 0;
+
+				_Stats.record(_Counters);
+				_Counters = trace_counters{};
+			}
+
+			/*
+			* Finds the closest object of the scene hit by the ray, and fills up the record for it.
+			* depth is the number of surfaces the path hit before this ray (0 for a camera ray), for the statistics.
+			* returns whether the ray has intersected with an object in the scene.
+			*/
+			__forceinline bool ClosestHit(const ray& incoming, hit_record& closest_hit, uint32_t depth)const
+			{
+				//basically saying making the distance "INFINITY"
+				closest_hit.distance = FLT_MAX;
+				_ray_nb++;
+				_Counters.count_ray(depth);
+
+				if (_sphere_kernel != nullptr)
+				{
+					//the spheres are stored in leaf order, so a leaf is a contiguous range we can test all at once
+					uint32_t sphere_index = 0;
+					auto leaf_hit = [this, &incoming, &sphere_index](uint32_t first, uint32_t nb, float& closest)
+					{
+						_Counters._prim_test_nb += nb;
+						return _sphere_kernel(_SceneSpheres, incoming, first, nb, closest, sphere_index);
+					};
+
+					if (!_SceneBVH.closest_hit(incoming, closest_hit.distance, leaf_hit, &_Counters._node_visit_nb))
+						return false;
+
+					//we only fill up the record for the closest sphere
+					_SceneSpheres.record(incoming, sphere_index, closest_hit.distance, closest_hit);
+					closest_hit.mat		= _Materials[_SceneSpheres._material_id[sphere_index]];
+					closest_hit.shade	= shade_material(*closest_hit.mat, closest_hit);
+					return true;
+				}
+
+				//the bvh gives us the objects in the leaves the ray goes through, front to back
+				auto leaf_hit = [this, &incoming, &closest_hit](uint32_t first, uint32_t nb, float& closest)
+				{
+					_Counters._prim_test_nb += nb;
+					bool leaf_has_hit = false;
+					for (uint32_t j = first; j < first + nb; j++)
+					{
+						//compute hit with each object in the leaf
+						hit_record jHit{};
+						if (_Scene[_SceneBVH._prim_indices[j]]->hit(incoming, jHit))
+						{
+							//if we hit the ray intersect with multiple objects, we take the closest to the ray's origin
+							if (jHit.distance < closest)
+							{
+								closest_hit = jHit;//this also updates closest
+								leaf_has_hit = true;
+							}
+						}
+					}
+					return leaf_has_hit;
+				};
+
+				if (!_SceneBVH.closest_hit(incoming, closest_hit.distance, leaf_hit, &_Counters._node_visit_nb))
+					return false;
+
+				//only the closest hit is shaded, not every hit it won against
+				closest_hit.shade = closest_hit.mat != nullptr ? shade_material(*closest_hit.mat, closest_hit) : vec4{ 0.0f, 0.0f, 0.0f, 0.0f };
+				return true;
+			}
+
+			/*
+			* Finds whether any object of the scene is hit by the ray closer than max_distance, stopping at the first one found.
+			*/
+			__forceinline bool Occluded(const ray& incoming, float max_distance)const
+			{
+				_ray_nb++;
+				_Counters._shadow_ray_nb++;
+
+				if (_sphere_kernel != nullptr)
+				{
+					//the kernel tells whether any sphere of the leaf is closer than max_distance
+					uint32_t sphere_index = 0;
+					auto leaf_hit = [this, &incoming, &sphere_index](uint32_t first, uint32_t nb, float& closest)
+					{
+						_Counters._prim_test_nb += nb;
+						return _sphere_kernel(_SceneSpheres, incoming, first, nb, closest, sphere_index);
+					};
+
+					return _SceneBVH.any_hit(incoming, max_distance, leaf_hit, &_Counters._node_visit_nb);
+				}
+
+				auto leaf_hit = [this, &incoming](uint32_t first, uint32_t nb, float& closest)
+				{
+					//the objects after the first one hit are not tested
+					for (uint32_t j = first; j < first + nb; j++)
+					{
+						_Counters._prim_test_nb++;
+						if (_Scene[_SceneBVH._prim_indices[j]]->any_hit(incoming, closest))
+							return true;
+					}
+					return false;
+				};
+
+				return _SceneBVH.any_hit(incoming, max_distance, leaf_hit, &_Counters._node_visit_nb);
+			}
+
+			/*
+			* Samples the light of the scene from a hit, through a shadow ray towards it (next event estimation).
+			* the paths cannot hit the light, so this is the only way it reaches them.
+			* returns the light the hit reflects back along the incoming ray (to be weighted by what the path kept so far).
+			* careful, the point sampled on a sphere light is random : it uses (and advances) the sampler.
+			*/
+			__forceinline vec4 DirectLight(const ray& in, const hit_record& hit, sequence_sampler& sampler)const
+			{
+				//only a lambertian surface reflects the light coming from every direction, the others reflect a single one
+				if (!_light_sampling || hit.mat->_type != material_type::DIFFUSE)
+					return vec4{ 0.0f, 0.0f, 0.0f, 0.0f };
+
+				//the light is gathered on the side the ray came from
+				vec3 normal = dot(hit.hit_normal, in.direction) < 0.0f ? hit.hit_normal : -hit.hit_normal;
+
+				vec3 toLight;
+				float lightDistance;
+				vec3 irradiance = _Light._color;
+				if (_Light._LightType == LightType::SPHERE)
+				{
+					//aiming at a random point of the sphere, so that its shadows are soft
+					sampler.skip_to(PATH_DIMENSION_LIGHT);
+					float u1 = sampler.next_float();
+					float u2 = sampler.next_float();
+					toLight			= _Light._pos + uniform_sphere(u1, u2) * fabsf(_Light._radius) - hit.hit_point;
+					lightDistance	= sqrtf(dot(toLight, toLight));
+					if (lightDistance == 0.0f)
+						return vec4{ 0.0f, 0.0f, 0.0f, 0.0f };
+					toLight = toLight / lightDistance;
+
+					//the same falloff as the sphere light of the rasterized scenes
+					vec3 toCenter	= _Light._pos - hit.hit_point;
+					irradiance		= irradiance * fminf((_Light._radius * _Light._radius) / dot(toCenter, toCenter), 1.0f);
+				}
+				else
+				{
+					//the direction is towards the light, which is infinitely far
+					float dirLength = sqrtf(dot(_Light._dir, _Light._dir));
+					if (dirLength == 0.0f)
+						return vec4{ 0.0f, 0.0f, 0.0f, 0.0f };
+					toLight			= _Light._dir / dirLength;
+					lightDistance	= FLT_MAX;
+				}
+
+				float cosLight = dot(normal, toLight);
+				if (cosLight <= 0.0f || Occluded(ray{ hit.hit_point, toLight }, lightDistance))
+					return vec4{ 0.0f, 0.0f, 0.0f, 0.0f };
+
+				//a lambertian surface reflects albedo / pi of the light it gets (the alpha is left to the path)
+				return hit.shade * vec4{ irradiance.x, irradiance.y, irradiance.z, 0.0f } * (cosLight / static_cast<float>(M_PI));
+			}
+
+			/*
+			* Follows the path of a sample from its first hit, until it reaches the sky or bounces too much,
+			* sampling the light at every hit on the way.
+			* returns the light the path brings back to the pixel.
+			*/
+			__forceinline vec4 TracePath(const ray& first_ray, const hit_record& first_hit, uint32_t pixel_index, uint32_t sample)const
+			{
+				_Sampler		= _Sampling.get(pixel_index, sample, PATH_BOUNCE_FIRST_HIT);
+				ray path		= propagate_material(*first_hit.mat, first_ray, first_hit, _Sampler);
+				vec4 radiance	= DirectLight(first_ray, first_hit, _Sampler);
+				vec4 color		= first_hit.shade;
+
+				for (uint32_t depth = 0; ; depth++)
+				{
+					hit_record pathHit;
+					if (!ClosestHit(path, pathHit, depth + 1))
+						return radiance + color * GetRayColor(path, _background_gradient_top, _background_gradient_bottom);
+
+					//a path that bounces too much only keeps the light it already found
+					if (depth >= _depth)
+						return radiance;
+
+					_Sampler	= _Sampling.get(pixel_index, sample, PATH_BOUNCE_FIRST_HIT + 1 + depth);
+					ray bounced	= propagate_material(*pathHit.mat, path, pathHit, _Sampler);
+					radiance	+= color * DirectLight(path, pathHit, _Sampler);
+					color		= pathHit.shade * color;
+					path		= bounced;
+				}
+			}
+	};
+
+	/*
+	* the general multithreaded job interface used to compute RayBatches concurrently
+	*/
+	class RaytraceJob : public SceneRaytraceJob
+	{
+		public:
+			RaytraceJob(const RayBatch& RayBatch, uint32_t first_depth, ThreadPool& Pool, RaytraceCPU& Owner) :
+				SceneRaytraceJob(Owner),
+				_Computes{RayBatch},
+				_first_depth{ first_depth },
+				_ComputeQueue{ Owner._ComputeBatch },
+				_PendingRayNb{ Owner._pending_ray_nb },
+				_Pool{ Pool },
+				_job_ray_nb{ Owner._compute_per_frames },
+				_SampleRadiance{ Owner._SampleRadiance },
+				_PixelSampleDoneNb{ Owner._PixelSampleDoneNb },
+				_pixel_sample_nb{ Owner._rtParams._pixel_sample_nb },
+				_Display{ Owner._Display },
+				_ThreadScratch{ *Owner._ShadingScratch },
+				_scratch_nb{ Owner._ShadingScratch.Nb() },
+				_RenderEpoch{ Owner._RenderEpoch },
+				_epoch{ Owner._RenderEpoch.current() }
+			{
+			}
+
+			//the batch this multithreaded job is supposed to accomplish
+			RayBatch							_Computes;
+			//the number of surfaces hit before the rays of the batch that have not bounced yet (0 for the camera rays), for the statistics
+			uint32_t							_first_depth;
+			//the queue in which the job gives its generated rays back to the main thread
+			BoundedQueue<RayBatch>&				_ComputeQueue;
+			//the rays waiting in the queue, counted as they are added
+			std::atomic<uint32_t>&				_PendingRayNb;
+			//the pool running the job, where it adds the jobs of its rays when the queue is full
+			ThreadPool&							_Pool;
+			//the number of rays the main thread gives to a job
+			uint32_t							_job_ray_nb;
+			//the radiance of every sample of every pixel. a path is the only one writing its own slot, so no synchronisation is needed
+			MultipleSharedMemory<vec4>			_SampleRadiance;
+			//the samples of each pixel that are done
+			MultipleSharedMemory<std::atomic<uint32_t>>	_PixelSampleDoneNb;
+			//the number of rays needed to be generated for a single pixel
+			uint32_t							_pixel_sample_nb;
+			//where the job tells which pixels it wrote
+			const display_staging&				_Display;
+			//the memory each thread of the pool shades in
+			shading_scratch*					_ThreadScratch;
+			uint32_t							_scratch_nb;
+			//the generation of the image, and the one this job works for
+			const render_epoch&					_RenderEpoch;
+			uint32_t							_epoch;
+
+			/*
+			* tells that sample_nb samples of the ray's pixel are done. the job ending the last one averages them in the image,
+			* as every sample of the pixel was written by then.
+			*/
+			__forceinline void SamplesDone(const ray_compute& computed_ray, uint32_t sample_nb = 1)const
+			{
+				if (_PixelSampleDoneNb[computed_ray.pixel_index].fetch_add(sample_nb) + sample_nb != _pixel_sample_nb)
+					return;
+
+				const vec4* pixelSamples = &_SampleRadiance[computed_ray.pixel_index * _pixel_sample_nb];
+
+				vec4 sum{ 0.0f, 0.0f, 0.0f, 0.0f };
+				for (uint32_t i = 0; i < _pixel_sample_nb; i++)
+					sum += pixelSamples[i];
+
+				*computed_ray.pixel			= sum * (1.0f / static_cast<float>(_pixel_sample_nb));
+				computed_ray.pixel->w		= 1.0f;
+				_Display.mark_pixels(computed_ray.pixel_index, computed_ray.pixel_index + 1);
+			}
+
+			/*
+			* gives a batch of rays to trace back to the main thread, counting its rays first so that they are never seen done in between.
+			* the main thread only takes batches once the pool runs out of jobs, which we are one of : when the queue is full,
+			* the rays are cut in jobs we add to the pool ourselves rather than waiting for it.
+			*/
+			__forceinline void GiveBackRays(const RayBatch& batch)const
+			{
+				//nothing left to trace
+				if (batch.nb == 0)
+					return;
+
+				_PendingRayNb.fetch_add(batch.nb);
+				if (_ComputeQueue.Push(batch))
+					return;
+
+				//the image was restarted, nobody wants these rays anymore
+				if (_RenderEpoch.stale(_epoch))
+				{
+					_PendingRayNb.fetch_sub(batch.nb);
+					return;
+				}
+
+				for (uint32_t i = 0; i < batch.nb; i += _job_ray_nb)
+				{
+					//a batch with the size of a job, as the main thread would have cut it
+					RayBatch computes	= batch;
+					computes.offset		+= i;
+					computes.nb			= batch.nb - i < _job_ray_nb ? batch.nb - i : _job_ray_nb;
+
+					_Pool.Add(AnyHitRaytraceJob(computes, *this));
+
+					//only once the pool counts the job, so that its rays are never seen done in between
+					_PendingRayNb.fetch_sub(computes.nb);
+				}
+			}
+
+			/*
+			* gives the batch its rays, for the jobs that start the paths themselves (the rays were written by the previous bounce otherwise).
+			*/
+			virtual void GenerateRays()const {}
+
+
+			/*
+			* Processes the ray_compute of a ray that ends here, either because it missed the scene or because it bounced too much
+			*/
+			virtual void ProcessRayHit(bool hit, const hit_record& hit_record, const ray_compute& computed_ray)const = 0;
 
+			/*
+			* shades the nb rays of the batch at ray_indices, that all hit a material of the given type (hits being in the same order).
+			*/
+			virtual void ShadeHits(material_type type, const uint32_t* ray_indices, const hit_record* hits, uint32_t nb)const = 0;
 
 			/*
-			* Processes the ray_compute depending on the hit status with the scene
+			* calls the job's loop over the hits of a single material type, the type being known when it is compiled.
 			*/
-			virtual void ProcessRayHit(bool hit, uint32_t ray_index, const hit_record& hit_record, const ray_compute& computed_ray)const = 0;
+			template<class Job>
+			static __forceinline void ShadeHitsByType(const Job& job, material_type type, const uint32_t* ray_indices, const hit_record* hits, uint32_t nb)
+			{
+				switch (type)
+				{
+				case material_type::DIFFUSE:
+					job.template ShadeHitsAs<material_type::DIFFUSE>(ray_indices, hits, nb);
+					break;
+				case material_type::METAL:
+					job.template ShadeHitsAs<material_type::METAL>(ray_indices, hits, nb);
+					break;
+				case material_type::DIELECTRIC:
+					job.template ShadeHitsAs<material_type::DIELECTRIC>(ray_indices, hits, nb);
+					break;
+				default:
+					job.template ShadeHitsAs<material_type::OTHER>(ray_indices, hits, nb);
+					break;
+				}
+			}
 
 			/*
 			* Implements the Dispatch of new rays, given the number of hits.
@@ -207,9 +611,30 @@ public:
 
 			__forceinline void Execute()override
 			{
+				//the rays are traced in place in the heap the new image uses : a refresh waits for the batch we are on, or we drop it
+				if (!_RenderEpoch.begin_write(_epoch))
+					return;
+
+				std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+				GenerateRays();
+
 				//the start of our ray heap we need to compute
 				const MultipleVolatileMemory<ray_compute> computes = &_Computes.data[_Computes.offset];
 
+				//the memory of the thread we run on, or our own when the thread is not one of the pool's
+				shading_scratch localScratch;
+				uint32_t threadIndex		= ThreadPool::GetCurrentThreadIndex();
+				shading_scratch& scratch	= threadIndex < _scratch_nb ? _ThreadScratch[threadIndex] : localScratch;
+				scratch.reserve(_Computes.nb);
+
+				//the closest hit of every ray that goes on, kept to handle them by material once the whole batch is intersected
+				hit_record* hits = *scratch._Hits;
+				//the number of rays that go on for each material type
+				uint32_t material_hit_nb[static_cast<uint32_t>(material_type::NB)] = {};
+
+				/* Intersection : every ray of the batch is tested with the scene first */
+
 				//the nb of rays that hit an object in the scene
 				uint32_t hit_nb{ 0 };
 				//going over all the rays
@@ -221,38 +646,65 @@ public:
 					if (indexedComputedRay.pixel == nullptr)
 						continue;
 
-					//whether this ray has intersected with an object in the scene
-					float has_hit{ false };
 					//the record of the closest hit between the ray and the objects in the scene
 					hit_record closest_hit;
-					//basically saying making the distance "INFINITY"
-					closest_hit.distance = FLT_MAX;
-					for (uint32_t j = 0; j < _Scene.Nb(); j++)
+
+					//whether this ray has intersected with an object in the scene
+					bool has_hit = ClosestHit(indexedComputedRay.launched, closest_hit, _first_depth + indexedComputedRay.depth);
+
+					//the rays that end here give their color right away
+					if (!has_hit || indexedComputedRay.depth >= _depth)
 					{
-						//compute hit with each object in the scene
-						hit_record jHit{};
-						if (_Scene[j]->hit(indexedComputedRay.launched, jHit))
-						{
-							//if we hit the ray intersect with multiple objects, we take the closest to the ray's origin
-							if (jHit.distance < closest_hit.distance)
-							{
-								closest_hit = jHit;
-								has_hit = true;
-							}
-						}
+						ProcessRayHit(has_hit, closest_hit, indexedComputedRay);
+						continue;
+					}
+
+					//the rays that go on are packed at the start of the batch. as hit_nb <= i, we only overwrite rays we are done with.
+					//hit_nb is also the index in the heap that the ray's generated rays will use
+					hits[hit_nb] = closest_hit;
+					if (hit_nb != i)
+						computes[hit_nb] = indexedComputedRay;
+					material_hit_nb[static_cast<uint32_t>(closest_hit.mat->_type)]++;
+					hit_nb++;
+				}
+
+				/* Shading : the rays that go on are handled one material type after the other, so that each type runs as its own loop */
+
+				if (hit_nb > 0)
+				{
+					//a counting sort of the packed rays by material type (in the order of the batch for a same type)
+					uint32_t material_next[static_cast<uint32_t>(material_type::NB)];
+					uint32_t material_sum = 0;
+					for (uint32_t i = 0; i < static_cast<uint32_t>(material_type::NB); i++)
+					{
+						material_next[i]	= material_sum;
+						material_sum		+= material_hit_nb[i];
 					}
 
-					//giving the pixel color, or generating a bouncing ray
-					ProcessRayHit(has_hit, hit_nb, closest_hit, indexedComputedRay);
+					hit_record* sortedHits	= *scratch._SortedHits;
+					uint32_t* rayIndices	= *scratch._RayIndices;
+					for (uint32_t i = 0; i < hit_nb; i++)
+					{
+						uint32_t sorted		= material_next[static_cast<uint32_t>(hits[i].mat->_type)]++;
+						sortedHits[sorted]	= hits[i];
+						rayIndices[sorted]	= i;
+					}
 
-					//hit_nb helps to record how many rays we may need to generate,but also acts as an index in the heap,
-					//that we reuse for generated rays, thus we add it *after* the ray has been processed
-					if (has_hit && indexedComputedRay.depth < _depth)
-						hit_nb++;
+					//every ray reads and writes its own packed index, so the order we go through them in does not matter
+					uint32_t first = 0;
+					for (uint32_t i = 0; i < static_cast<uint32_t>(material_type::NB); i++)
+					{
+						if (material_hit_nb[i] > 0)
+							ShadeHits(static_cast<material_type>(i), &rayIndices[first], &sortedHits[first], material_hit_nb[i]);
+						first += material_hit_nb[i];
+					}
 				}
 
 				//if needed, generate a new request to process a new batch of ray compute
 				DispatchRayHits(hit_nb);
+
+				_RenderEpoch.end_write();
+				RecordThroughput(start);
 			}
 	};
 
@@ -268,46 +720,81 @@ public:
 	class AnyHitRaytraceJob : public RaytraceJob
 	{
 	public:
-		//the amound each rays contribute to the final image
-		float										_sample_weight;
-		//the queue in which the job should add its genenrated rays
-		Queue<MultipleSharedMemory<ray_compute>>&	_ComputeQueue;
-		//fence for safe concurrent had of generated batch in the queue
-		std::mutex&									_fence;
-
-		AnyHitRaytraceJob(const RayBatch& RayBatch, RaytraceCPU& Owner) :
-			RaytraceJob(RayBatch, Owner),
-			_sample_weight{ 1.0f / static_cast<float>(Owner._rtParams._pixel_sample_nb) },
-			_ComputeQueue{ Owner._ComputeBatch },
-			_fence{ Owner._batch_fence }
+		AnyHitRaytraceJob(const RayBatch& RayBatch, ThreadPool& Pool, RaytraceCPU& Owner) :
+			RaytraceJob(RayBatch, 1, Pool, Owner)
+		{
+		}
 
+		//a job tracing the rays a running job could not give back, for the same image
+		AnyHitRaytraceJob(const RayBatch& RayBatch, const RaytraceJob& From) :
+			RaytraceJob(From)
 		{
+			_Computes		= RayBatch;
+			_first_depth	= 1;
+			//the producer's counters and pool bookkeeping are its own
+			_ray_nb			= 0;
+			_Counters		= trace_counters{};
+			next_job		= nullptr;
+			task			= nullptr;
 		}
 
 		/*
 		* Processes the ray_compute depending on the hit status with the scene
 		*/
-		__forceinline virtual void ProcessRayHit(bool hit, uint32_t ray_index, const hit_record& hit_record, const ray_compute& computed_ray)const final
+		__forceinline virtual void ProcessRayHit(bool hit, const hit_record&, const ray_compute& computed_ray)const final
 		{
 			//if the ray does not intersect with anything, we may say that it comes from our light source (which in this demo, is "the sky")
-			//we make it contribute to the final image, depending on the sample weight (as we launched multiple ray for the same pixel), and with the color of the light
+			//the path ends here, giving its sample the color of the light (the samples are averaged in the image once the pixel's last one is done)
 			if (!hit)
-				*computed_ray.pixel += computed_ray.color * _sample_weight * GetRayColor(computed_ray.launched, _background_gradient_top, _background_gradient_bottom);
-			else if (computed_ray.depth < _depth)//if it hit, we did not found where the light came from, so requesting a new compute to the bounced ray from the hit
 			{
+				_SampleRadiance[computed_ray.pixel_index * _pixel_sample_nb + computed_ray.sample] = computed_ray.radiance + computed_ray.color * GetRayColor(computed_ray.launched, _background_gradient_top, _background_gradient_bottom);
+				SamplesDone(computed_ray);
+			}
+			else//a path that bounces too much only keeps the light it already found
+			{
+				_SampleRadiance[computed_ray.pixel_index * _pixel_sample_nb + computed_ray.sample] = computed_ray.radiance;
+				SamplesDone(computed_ray);
+			}
+		}
+
+		__forceinline virtual void ShadeHits(material_type type, const uint32_t* ray_indices, const hit_record* hits, uint32_t nb)const final
+		{
+			ShadeHitsByType(*this, type, ray_indices, hits, nb);
+		}
+
+		/*
+		* the rays hit a material of the given type, but we did not find where the sky light came from : each of them bounces from its hit, to be computed by another job.
+		*/
+		template<material_type type>
+		__forceinline void ShadeHitsAs(const uint32_t* ray_indices, const hit_record* hits, uint32_t nb)const
+		{
+			for (uint32_t i = 0; i < nb; i++)
+			{
+				const hit_record& hit_record	= hits[i];
+				ray_compute& computed_ray		= _Computes.data[_Computes.offset + ray_indices[i]];
+
 				//the new ray to compute
 				ray_compute newCompute{};
-				
+
+				//every bounce of every path has its own random sequence, whichever thread computes it
+				_Sampler = _Sampling.get(computed_ray.pixel_index, computed_ray.sample, PATH_BOUNCE_FIRST_HIT + 1 + computed_ray.depth);
+
 				//the bounced ray
-				newCompute.launched = hit_record.mat->propagate(computed_ray.launched, hit_record);
+				newCompute.launched = propagate_material_as<type>(*hit_record.mat, computed_ray.launched, hit_record, _Sampler);
+				//the light reaching the hit straight from the light source, which only a diffuse surface gathers
+				newCompute.radiance = computed_ray.radiance;
+				if (type == material_type::DIFFUSE)
+					newCompute.radiance += computed_ray.color * DirectLight(computed_ray.launched, hit_record, _Sampler);
 				//still computing the same pixel
-				newCompute.pixel = computed_ray.pixel;
+				newCompute.pixel		= computed_ray.pixel;
+				newCompute.pixel_index	= computed_ray.pixel_index;
+				newCompute.sample		= computed_ray.sample;
 				//if it bounced, the object absorbed some of the light's spectrum
 				newCompute.color = hit_record.shade * computed_ray.color;
 				//adding to the bounce number, as we limit the number of rebounce (as the contribution is close to 0 at a certain point)
 				newCompute.depth = computed_ray.depth + 1;
-				
-				_Computes.data[(_Computes.offset + ray_index)] = newCompute;
+
+				computed_ray = newCompute;
 			}
 		}
 
@@ -324,10 +811,8 @@ public:
 			node.offset = _Computes.offset;
 			node.nb		= hit_nb;
 
-			//sending it away when the resource is available
-			_fence.lock();
-			_ComputeQueue.PushNode(node);
-			_fence.unlock();
+			//sending it away, without waiting for the other jobs nor the main thread
+			GiveBackRays(node);
 		}
 	};
 
@@ -339,63 +824,130 @@ public:
 	public:
 		//an offset in the ray_compute's heap to not overwrite rays computed now
 		uint32_t _offset;
-		//the number of rays needed to be generated for a single pixel
-		uint32_t _pixel_sample_nb;
 		//whether this job should generate rays or not
 		bool _is_moving;
-		//the queue in which the job should add its genenrated rays
-		Queue<MultipleSharedMemory<ray_compute>>&	_ComputeQueue;
-		//fence for safe concurrent had of generated batch in the queue
-		std::mutex& _fence;
+		//the rays going from the camera through every pixel
+		camera_rays	_Camera;
+		//the cpu image
+		vec4*		_Image;
+		//the width of the screen
+		uint32_t	_screen_width;
 
 
-		FirstContactRaytraceJob(const RayBatch& RayBatch, RaytraceCPU& Owner) :
-			RaytraceJob(RayBatch, Owner),
+		FirstContactRaytraceJob(const RayBatch& RayBatch, ThreadPool& Pool, RaytraceCPU& Owner) :
+			RaytraceJob(RayBatch, 0, Pool, Owner),
 			_offset{ Owner._FullScreenScissors.extent.width * Owner._FullScreenScissors.extent.height },
-			_pixel_sample_nb{ Owner._rtParams._pixel_sample_nb},
 			_is_moving{Owner._is_moving},
-			_ComputeQueue{Owner._ComputeBatch},
-			_fence{Owner._batch_fence}
+			_Camera{ Owner._CameraRays },
+			_Image{ *Owner._RaytracedImage },
+			_screen_width{ Owner._FullScreenScissors.extent.width }
 		{
 		}
 
 		/*
-		* Processes the ray_compute depending on the hit status with the scene
+		* generates the camera ray of every pixel of the batch (the batch's offset being its first pixel), so that a refresh only splits the screen.
 		*/
-		__forceinline virtual void ProcessRayHit(bool hit, uint32_t ray_index, const hit_record& hit_record, const ray_compute& computed_ray)const final
+		__forceinline virtual void GenerateRays()const final
+		{
+			for (uint32_t i = 0; i < _Computes.nb; i++)
+			{
+				uint32_t pixelIndex = _Computes.offset + i;
+
+				//the jitter of each pixel comes from its own random sequence
+				sequence_sampler pixelSampler = _Sampling.get(pixelIndex, 0, PATH_BOUNCE_CAMERA);
+
+				ray_compute& pixelCompute	= _Computes.data[pixelIndex];
+				pixelCompute				= ray_compute{};
+				pixelCompute.launched		= _Camera.get(pixelIndex % _screen_width, pixelIndex / _screen_width, pixelSampler);
+				pixelCompute.pixel			= &_Image[pixelIndex];
+				pixelCompute.pixel_index	= pixelIndex;
+			}
+		}
+
+		/*
+		* Processes the ray_compute of a ray that ends here
+		*/
+		__forceinline virtual void ProcessRayHit(bool hit, const hit_record& hit_record, const ray_compute& computed_ray)const final
 		{
 			if (hit)
 			{
-				//whether we move changes we should launch new ray or draw a "basic image"
-				if (!_is_moving)
+				//helping the user to move into the scene by rendering a simple representation of the scene
+				if (_is_moving)
 				{
-					//clearing the screen
-					*computed_ray.pixel = vec4{ 0.0f, 0.0f, 0.0f, 1.0f };
-					uint32_t globalOffset = _offset + (_Computes.offset + ray_index) * _pixel_sample_nb;
-					for (uint32_t i = 0; i < _pixel_sample_nb; i++)
-					{
-						//the new ray to compute
-						ray_compute newCompute{};
-
-						//the bounced ray
-						newCompute.launched = hit_record.mat->propagate(computed_ray.launched, hit_record);
-						//we want them all to compute the same pixel
-						newCompute.pixel = computed_ray.pixel;
-						//if it bounced, the object absorbed some of the light's spectrum
-						newCompute.color = hit_record.shade;
-						//we initialize the number of rebounce, as this is the first hit
-						newCompute.depth = 0;
-
-						_Computes.data[globalOffset + i] = newCompute;
-					}
-				}
-				else//helping the user to move into the scene by rendering a simple representation of the scene
 					*computed_ray.pixel = hit_record.shade;
+					return;
+				}
+
+				//no bounce is allowed : the paths keep the light they found so far, which is none
+				for (uint32_t i = 0; i < _pixel_sample_nb; i++)
+					_SampleRadiance[computed_ray.pixel_index * _pixel_sample_nb + i] = vec4{ 0.0f, 0.0f, 0.0f, 0.0f };
+				SamplesDone(computed_ray, _pixel_sample_nb);
 			}
 			else
 			{
 				//whether we move or not, we still render the sky
 				*computed_ray.pixel = GetRayColor(computed_ray.launched, _background_gradient_top, _background_gradient_bottom);
+
+				//every sample of the pixel would see the sky as well, so the pixel is already done
+				if (!_is_moving)
+				{
+					for (uint32_t i = 0; i < _pixel_sample_nb; i++)
+						_SampleRadiance[computed_ray.pixel_index * _pixel_sample_nb + i] = *computed_ray.pixel;
+					SamplesDone(computed_ray, _pixel_sample_nb);
+				}
+			}
+		}
+
+		__forceinline virtual void ShadeHits(material_type type, const uint32_t* ray_indices, const hit_record* hits, uint32_t nb)const final
+		{
+			ShadeHitsByType(*this, type, ray_indices, hits, nb);
+		}
+
+		/*
+		* the camera rays hit a material of the given type : each of them starts the paths of every sample of its pixel from its hit.
+		*/
+		template<material_type type>
+		__forceinline void ShadeHitsAs(const uint32_t* ray_indices, const hit_record* hits, uint32_t nb)const
+		{
+			for (uint32_t j = 0; j < nb; j++)
+			{
+				uint32_t ray_index				= ray_indices[j];
+				const hit_record& hit_record	= hits[j];
+				const ray_compute& computed_ray	= _Computes.data[_Computes.offset + ray_index];
+
+				//the pixel shows its first hit until its samples are all done, or while we move
+				*computed_ray.pixel = hit_record.shade;
+				if (_is_moving)
+					continue;
+
+				uint32_t globalOffset = _offset + (_Computes.offset + ray_index) * _pixel_sample_nb;
+				for (uint32_t i = 0; i < _pixel_sample_nb; i++)
+				{
+					//a path that never reaches the light does not contribute
+					_SampleRadiance[computed_ray.pixel_index * _pixel_sample_nb + i] = vec4{ 0.0f, 0.0f, 0.0f, 0.0f };
+
+					//the new ray to compute
+					ray_compute newCompute{};
+
+					//every sample gets its own random sequence, whichever thread computes it
+					_Sampler = _Sampling.get(computed_ray.pixel_index, i, PATH_BOUNCE_FIRST_HIT);
+
+					//the bounced ray
+					newCompute.launched = propagate_material_as<type>(*hit_record.mat, computed_ray.launched, hit_record, _Sampler);
+					//the light reaching the first hit straight from the light source, for this sample (only a diffuse surface gathers it)
+					if (type == material_type::DIFFUSE)
+						newCompute.radiance = DirectLight(computed_ray.launched, hit_record, _Sampler);
+					//we want them all to compute the same pixel
+					newCompute.pixel		= computed_ray.pixel;
+					newCompute.pixel_index	= computed_ray.pixel_index;
+					newCompute.sample		= i;
+					//if it bounced, the object absorbed some of the light's spectrum
+					newCompute.color = hit_record.shade;
+					//we initialize the number of rebounce, as this is the first hit
+					newCompute.depth = 0;
+
+					_Computes.data[globalOffset + i] = newCompute;
+				}
 			}
 		}
 
@@ -404,6 +956,9 @@ public:
 		*/
 		__forceinline virtual void DispatchRayHits(uint32_t hit_nb)const final
 		{
+			//every pixel of the batch shows something new, be it the sky or its first hit
+			_Display.mark_pixels(_Computes.offset, _Computes.offset + _Computes.nb);
+
 			//dispatching rays when the image is recomputed every frame would be stupid
 			if (!_is_moving)
 			{
@@ -418,11 +973,607 @@ public:
 				//and for every hit, we have at least _pixel_sample_nb ray compute created
 				node.nb		= hit_nb * _pixel_sample_nb;
 
-				//sending it away when the resource is available
-				_fence.lock();
-				_ComputeQueue.PushNode(node);
-				_fence.unlock();
+				//sending it away, without waiting for the other jobs nor the main thread
+				GiveBackRays(node);
+			}
+		}
+	};
+
+
+	/*
+	* the multithreaded job used in tile mode : it computes every path of every pixel of a small tile of the screen from start to end.
+	* it only needs a few locals to do so, and is the only one writing the pixels of its tile.
+	* it uses the same random sequences as the ray heap, so both modes give out the same image.
+	*/
+	class TileRaytraceJob : public SceneRaytraceJob
+	{
+	public:
+		//the rays going from the camera through every pixel
+		camera_rays	_Camera;
+		//the cpu image
+		vec4*		_Image;
+		//the width of the screen
+		uint32_t	_screen_width;
+		//the first pixel (upper left) of the tile
+		uint32_t	_x, _y;
+		//the last pixel (lower right, excluded) of the tile, clamped to the screen
+		uint32_t	_end_x, _end_y;
+		//the number of rays needed to be generated for a single pixel
+		uint32_t	_pixel_sample_nb;
+		//whether this job should generate rays or not
+		bool		_is_moving;
+		//the side of the blocks of pixels sharing a single ray while moving
+		uint32_t	_preview_scale;
+		//the staging memory, to tell it once the tile is written
+		const display_staging&	_Display;
+		//the generation of the image, and the one this job works for
+		const render_epoch&		_RenderEpoch;
+		uint32_t				_epoch;
+
+		TileRaytraceJob(uint32_t x, uint32_t y, const RaytraceCPU& Owner) :
+			SceneRaytraceJob(Owner),
+			_Camera{ Owner._CameraRays },
+			_Image{ *Owner._RaytracedImage },
+			_screen_width{ Owner._FullScreenScissors.extent.width },
+			_x{ x },
+			_y{ y },
+			_end_x{ x + CPU_TILE_SIZE < Owner._FullScreenScissors.extent.width ? x + CPU_TILE_SIZE : Owner._FullScreenScissors.extent.width },
+			_end_y{ y + CPU_TILE_SIZE < Owner._FullScreenScissors.extent.height ? y + CPU_TILE_SIZE : Owner._FullScreenScissors.extent.height },
+			_pixel_sample_nb{ Owner._rtParams._pixel_sample_nb },
+			_is_moving{ Owner._is_moving },
+			_preview_scale{ Owner._preview_scale },
+			_Display{ Owner._Display },
+			_RenderEpoch{ Owner._RenderEpoch },
+			_epoch{ Owner._RenderEpoch.current() }
+		{
+		}
+
+		/*
+		* traces the preview of the tile : a single ray through the center of each block of pixels, its first hit's color filling the block.
+		* the blocks are aligned on the screen, and a tile always holds a whole number of them.
+		* a row of blocks is written once it is traced, so that a refresh stops us after a row at most.
+		*/
+		__forceinline void ExecutePreview()
+		{
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+			for (uint32_t h = _y; h < _end_y; h += _preview_scale)
+			{
+				//the image was restarted, even before we started : none of the rows left are needed anymore
+				if (_RenderEpoch.stale(_epoch))
+					return;
+
+				//the last blocks of the screen may be cut
+				uint32_t blockEndY	= h + _preview_scale < _end_y ? h + _preview_scale : _end_y;
+				uint32_t centerY	= (h + blockEndY) / 2;
+
+				vec4 blockColors[CPU_TILE_SIZE];
+				for (uint32_t w = _x, block = 0; w < _end_x; w += _preview_scale, block++)
+				{
+					uint32_t blockEndX	= w + _preview_scale < _end_x ? w + _preview_scale : _end_x;
+					uint32_t centerX	= (w + blockEndX) / 2;
+
+					sequence_sampler pixelSampler	= _Sampling.get(centerY * _screen_width + centerX, 0, PATH_BOUNCE_CAMERA);
+					ray pixelRay		= _Camera.get(centerX, centerY, pixelSampler);
+
+					//helping the user to move into the scene by rendering a simple representation of the scene
+					hit_record firstHit;
+					blockColors[block] = ClosestHit(pixelRay, firstHit, 0) ? firstHit.shade : GetRayColor(pixelRay, _background_gradient_top, _background_gradient_bottom);
+				}
+
+				//the image was restarted, the rest of the tile is not needed anymore
+				if (!_RenderEpoch.begin_write(_epoch))
+					return;
+
+				for (uint32_t w = _x, block = 0; w < _end_x; w += _preview_scale, block++)
+				{
+					uint32_t blockEndX = w + _preview_scale < _end_x ? w + _preview_scale : _end_x;
+					for (uint32_t y = h; y < blockEndY; y++)
+						for (uint32_t x = w; x < blockEndX; x++)
+							_Image[y * _screen_width + x] = blockColors[block];
+				}
+
+				_RenderEpoch.end_write();
+			}
+
+			_Display.mark(_x, _y, _end_x, _end_y);
+			RecordThroughput(start);
+		}
+
+		__forceinline void Execute()override
+		{
+			//the image was restarted while we were waiting in the queue
+			if (_RenderEpoch.stale(_epoch))
+				return;
+
+			if (_is_moving && _preview_scale > 1)
+			{
+				ExecutePreview();
+				return;
+			}
+
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			float sampleWeight = 1.0f / static_cast<float>(_pixel_sample_nb);
+
+			for (uint32_t h = _y; h < _end_y; h++)
+			{
+				//the image was restarted : none of the rows left are needed anymore
+				if (_RenderEpoch.stale(_epoch))
+					return;
+
+				//the row is traced first, then written at once, so that a refresh stops us after a row at most
+				vec4 rowColors[CPU_TILE_SIZE];
+				for (uint32_t w = _x; w < _end_x; w++)
+				{
+					uint32_t pixelIndex = h * _screen_width + w;
+					vec4& color			= rowColors[w - _x];
+
+					//the first ray is shared by every sample of the pixel
+					sequence_sampler pixelSampler	= _Sampling.get(pixelIndex, 0, PATH_BOUNCE_CAMERA);
+					ray pixelRay		= _Camera.get(w, h, pixelSampler);
+
+					hit_record firstHit;
+					if (!ClosestHit(pixelRay, firstHit, 0))
+					{
+						//whether we move or not, we still render the sky
+						color = GetRayColor(pixelRay, _background_gradient_top, _background_gradient_bottom);
+						continue;
+					}
+
+					//helping the user to move into the scene by rendering a simple representation of the scene
+					if (_is_moving)
+					{
+						color = firstHit.shade;
+						continue;
+					}
+
+					//following every sample's path until it reaches the light, or bounces too much
+					vec4 sum{ 0.0f, 0.0f, 0.0f, 0.0f };
+					for (uint32_t i = 0; i < _pixel_sample_nb; i++)
+						sum += TracePath(pixelRay, firstHit, pixelIndex, i);
+
+					color	= sum * sampleWeight;
+					color.w	= 1.0f;
+				}
+
+				//the image was restarted, the rest of the tile is not needed anymore
+				if (!_RenderEpoch.begin_write(_epoch))
+					return;
+
+				for (uint32_t w = _x; w < _end_x; w++)
+					_Image[h * _screen_width + w] = rowColors[w - _x];
+
+				_RenderEpoch.end_write();
+			}
+
+			_Display.mark(_x, _y, _end_x, _end_y);
+			RecordThroughput(start);
+		}
+	};
+
+
+	/*
+	* the multithreaded job used in progressive mode : it adds a single sample to every pixel of a small tile of the screen.
+	* a pass over the screen is only launched once the previous one is done, so the job is still the only one writing its pixels.
+	* it also tells how noisy its tile is, for adaptive sampling to leave the tile out once it is clean enough.
+	*/
+	class ProgressiveRaytraceJob : public TileRaytraceJob
+	{
+	public:
+		//the sum of the radiance of every sample of each pixel (the alpha counts the samples)
+		vec4*				_AccumulatedRadiance;
+		//the sum of the squared luminance of every sample of each pixel, to know how noisy the pixel is
+		float*				_AccumulatedLuminanceSq;
+		//what this pass finds out about the tile
+		progressive_tile&	_Tile;
+		//the index of the pass, which is also the index of the sample it adds
+		uint32_t			_pass;
+		//whether the tile may be left out of the next passes once its noise is under the threshold
+		bool				_adaptive;
+		//the number of samples a tile needs before it can be left out, so that the noise estimate can be trusted
+		uint32_t			_min_spp;
+		//the relative noise under which a tile is left out
+		float				_noise_threshold;
+		//whether the image shows the number of samples of each pixel instead of the pixel
+		bool				_show_heatmap;
+		//the number of samples a pixel gets at most, the top of the heatmap
+		float				_target_spp;
+		//the distance from the camera to the first hit of each pixel, written by the first pass
+		float*				_PixelDepth;
+		//the sums and depths of the previous image, to start from on the first pass (nullptr when there is nothing to reuse)
+		const vec4*			_HistoryRadiance;
+		const float*		_HistoryLuminanceSq;
+		const float*		_HistoryDepth;
+		//the rays of the camera the previous image was seen from
+		camera_rays			_HistoryCamera;
+		//the height of the screen
+		uint32_t			_screen_height;
+
+		ProgressiveRaytraceJob(uint32_t x, uint32_t y, progressive_tile& Tile, const RaytraceCPU& Owner) :
+			TileRaytraceJob(x, y, Owner),
+			_AccumulatedRadiance{ *Owner._AccumulatedRadiance },
+			_AccumulatedLuminanceSq{ *Owner._AccumulatedLuminanceSq },
+			_Tile{ Tile },
+			_pass{ Owner._progressive_pass_nb },
+			_adaptive{ Owner._adaptive },
+			_min_spp{ Owner._adaptive_min_spp },
+			_noise_threshold{ Owner._progressive_noise_threshold },
+			_show_heatmap{ Owner._show_sample_heatmap },
+			_target_spp{ static_cast<float>(Owner._progressive_target_spp) },
+			_PixelDepth{ *Owner._PixelDepth },
+			_HistoryRadiance{ Owner._history_valid && Owner._progressive_pass_nb == 0 ? *Owner._HistoryRadiance : nullptr },
+			_HistoryLuminanceSq{ *Owner._HistoryLuminanceSq },
+			_HistoryDepth{ *Owner._HistoryDepth },
+			_HistoryCamera{ Owner._HistoryCamera },
+			_screen_height{ Owner._FullScreenScissors.extent.height }
+		{
+		}
+
+		/*
+		* starts the pixel from the samples the previous image found for the same point of the scene, if it saw it.
+		* the point is looked for in the previous image, which should have seen it at the same depth, otherwise
+		* something else was in front of it (or it was out of the screen).
+		* returns true if the pixel got the previous samples.
+		*/
+		__forceinline bool Reproject(const vec3& point, uint32_t pixel_index)const
+		{
+			float u, v;
+			if (!_HistoryCamera.project(point, u, v))
+				return false;
+
+			//the pixel of the previous image whose center is the closest
+			float x = floorf(u + 0.5f);
+			float y = floorf(v + 0.5f);
+			if (x < 0.0f || y < 0.0f || x >= static_cast<float>(_screen_width) || y >= static_cast<float>(_screen_height))
+				return false;
+
+			uint32_t historyIndex	= static_cast<uint32_t>(y) * _screen_width + static_cast<uint32_t>(x);
+			const vec4& history		= _HistoryRadiance[historyIndex];
+			if (history.w == 0.0f)
+				return false;
+
+			//the sky is never at the right depth, as its depth is FLT_MAX
+			vec3 toPoint	= point - _HistoryCamera.center;
+			float depth		= sqrtf(dot(toPoint, toPoint));
+			if (fabsf(_HistoryDepth[historyIndex] - depth) > CPU_REPROJECTION_DEPTH_TOLERANCE * depth)
+				return false;
+
+			//only keeping part of a long history, so that what the reprojection got wrong fades away
+			float weight = history.w > CPU_REPROJECTION_MAX_SPP ? CPU_REPROJECTION_MAX_SPP / history.w : 1.0f;
+			_AccumulatedRadiance[pixel_index]		= history * weight;
+			_AccumulatedLuminanceSq[pixel_index]	= _HistoryLuminanceSq[historyIndex] * weight;
+			return true;
+		}
+
+		__forceinline void Execute()override
+		{
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			float noiseSum = 0.0f;
+			uint32_t reprojectedNb = 0;
+
+			for (uint32_t h = _y; h < _end_y; h++)
+			{
+				//the image was restarted, even before we started : none of the rows left are needed anymore
+				if (_RenderEpoch.stale(_epoch))
+					return;
+
+				//the samples of the row are traced first, then added at once, so that a refresh stops us after a row at most
+				vec4 rowRadiance[CPU_TILE_SIZE];
+				float rowDepth[CPU_TILE_SIZE];
+				vec3 rowHitPoint[CPU_TILE_SIZE];
+				bool rowReprojectable[CPU_TILE_SIZE];
+				for (uint32_t w = _x; w < _end_x; w++)
+				{
+					uint32_t pixelIndex = h * _screen_width + w;
+					uint32_t column		= w - _x;
+
+					//every pass has its own first ray, so that anti-aliasing converges as well
+					sequence_sampler pixelSampler	= _Sampling.get(pixelIndex, _pass, PATH_BOUNCE_CAMERA);
+					ray pixelRay		= _Camera.get(w, h, pixelSampler);
+
+					hit_record firstHit;
+					bool hasHit = ClosestHit(pixelRay, firstHit, 0);
+
+					//the first pass tells how far each pixel sees, for the next image to reproject this one
+					if (_pass == 0)
+					{
+						vec3 toHit = firstHit.hit_point - _Camera.center;
+						rowDepth[column]			= hasHit ? sqrtf(dot(toHit, toHit)) : FLT_MAX;
+						rowHitPoint[column]			= firstHit.hit_point;
+						//only a lambertian surface looks the same from the new point of view
+						rowReprojectable[column]	= hasHit && _HistoryRadiance != nullptr && firstHit.mat->_type == material_type::DIFFUSE;
+					}
+
+					rowRadiance[column] = hasHit ? TracePath(pixelRay, firstHit, pixelIndex, _pass)
+												: GetRayColor(pixelRay, _background_gradient_top, _background_gradient_bottom);
+				}
+
+				//the image was restarted, the sums now belong to the new one
+				if (!_RenderEpoch.begin_write(_epoch))
+					return;
+
+				for (uint32_t w = _x; w < _end_x; w++)
+				{
+					uint32_t pixelIndex = h * _screen_width + w;
+					uint32_t column		= w - _x;
+
+					if (_pass == 0)
+					{
+						_PixelDepth[pixelIndex] = rowDepth[column];
+						if (rowReprojectable[column] && Reproject(rowHitPoint[column], pixelIndex))
+							reprojectedNb++;
+					}
+
+					//adding our sample to the running sum
+					const vec4& radiance = rowRadiance[column];
+					vec4& sum = _AccumulatedRadiance[pixelIndex];
+					sum.x += radiance.x;
+					sum.y += radiance.y;
+					sum.z += radiance.z;
+					sum.w += 1.0f;
+
+					float radianceLuminance = luminance(radiance);
+					_AccumulatedLuminanceSq[pixelIndex] += radianceLuminance * radianceLuminance;
+
+					//a single pixel with an unknown noise makes the whole tile's unknown
+					float pixelNoise = relative_noise(sum, _AccumulatedLuminanceSq[pixelIndex]);
+					noiseSum = pixelNoise == FLT_MAX || noiseSum == FLT_MAX ? FLT_MAX : noiseSum + pixelNoise;
+
+					//the image always shows the current estimate (or how many samples it took)
+					_Image[pixelIndex] = _show_heatmap ? heatmap_color(sum.w / _target_spp) : vec4{ sum.x / sum.w, sum.y / sum.w, sum.z / sum.w, 1.0f };
+				}
+
+				_RenderEpoch.end_write();
+			}
+
+			//the tiles are reset with the image as well
+			if (!_RenderEpoch.begin_write(_epoch))
+				return;
+
+			//the tile is clean enough when its pixels are on average
+			float pixelNb	= static_cast<float>((_end_x - _x) * (_end_y - _y));
+			_Tile._noise_sum = noiseSum;
+			_Tile._converged = _adaptive && _pass + 1 >= _min_spp && noiseSum != FLT_MAX && noiseSum <= _noise_threshold * pixelNb;
+			if (_pass == 0)
+				_Tile._reprojected_nb = reprojectedNb;
+
+			_RenderEpoch.end_write();
+
+			_Display.mark(_x, _y, _end_x, _end_y);
+			RecordThroughput(start);
+		}
+	};
+
+
+	/*
+	* the multithreaded job used in wavefront mode : it runs a single stage of the pipeline on a chunk of the current wave.
+	* every job of a stage works on its own part of the buffers, and the last one to finish starts the next stage.
+	*/
+	class WavefrontRaytraceJob : public SceneRaytraceJob
+	{
+	public:
+		//the owner of the pipeline, to start the next stage
+		RaytraceCPU&	_Owner;
+		//the pool to add the next stage's jobs in
+		ThreadPool&		_Pool;
+		//the buffers and state of the pipeline
+		wavefront&		_Wavefront;
+		//the rays going from the camera through every pixel
+		camera_rays		_Camera;
+		//the radiance of every sample of every pixel. a path is the only one writing its own slot
+		vec4*			_SampleRadiance;
+		//the cpu image
+		vec4*			_Image;
+		//the width of the screen
+		uint32_t		_screen_width;
+		//the number of rays needed to be generated for a single pixel
+		uint32_t		_pixel_sample_nb;
+		//the stage this job runs
+		wavefront_stage	_stage;
+		//the part of the wave this job works on (pixels for the accumulate stage, rays otherwise)
+		uint32_t		_first, _end;
+		//the image this job works for
+		uint32_t		_epoch;
+
+		WavefrontRaytraceJob(wavefront_stage stage, uint32_t first, uint32_t end, ThreadPool& Pool, uint32_t epoch, RaytraceCPU& Owner) :
+			SceneRaytraceJob(Owner),
+			_Owner{ Owner },
+			_Pool{ Pool },
+			_Wavefront{ Owner._Wavefront },
+			_Camera{ Owner._CameraRays },
+			_SampleRadiance{ *Owner._SampleRadiance },
+			_Image{ *Owner._RaytracedImage },
+			_screen_width{ Owner._FullScreenScissors.extent.width },
+			_pixel_sample_nb{ Owner._rtParams._pixel_sample_nb },
+			_stage{ stage },
+			_first{ first },
+			_end{ end },
+			_epoch{ epoch }
+		{
+		}
+
+		/*
+		* creates the camera ray of every path of the chunk. the first ray of a pixel is shared by all its samples.
+		*/
+		__forceinline void Generate()const
+		{
+			wavefront_rays& rays = _Wavefront.current_rays();
+
+			for (uint32_t i = _first; i < _end; i++)
+			{
+				uint32_t path		= _Wavefront._first_path + i;
+				uint32_t pixelIndex = path / _pixel_sample_nb;
+
+				sequence_sampler pixelSampler	= _Sampling.get(pixelIndex, 0, PATH_BOUNCE_CAMERA);
+				ray pixelRay		= _Camera.get(pixelIndex % _screen_width, pixelIndex / _screen_width, pixelSampler);
+
+				rays.set_ray(i, pixelRay, vec4{ 1.0f, 1.0f, 1.0f, 1.0f });
+				rays.set_radiance(i, vec4{ 0.0f, 0.0f, 0.0f, 0.0f });
+				rays.set_path(i, pixelIndex, path % _pixel_sample_nb, 0);
+			}
+		}
+
+		/*
+		* finds the closest hit of every ray of the chunk.
+		*/
+		__forceinline void Extend()const
+		{
+			const wavefront_rays& rays = _Wavefront.current_rays();
+
+			for (uint32_t i = _first; i < _end; i++)
+				_Wavefront._has_hit[i] = ClosestHit(rays.get_ray(i), _Wavefront._hits[i], rays._bounce[i]) ? 1 : 0;
+		}
+
+		/*
+		* ends the paths that reached the light or bounced too much, and bounces the others.
+		* the bounced rays are then packed in the other buffer, after the ones of the other jobs.
+		*/
+		__forceinline void Shade()const
+		{
+			wavefront_rays& rays = _Wavefront.current_rays();
+
+			//the bounced rays are written in place, and flagged to be packed afterwards
+			uint32_t goOnNb = 0;
+			for (uint32_t i = _first; i < _end; i++)
+			{
+				uint32_t pixelIndex = rays._pixel_index[i];
+				uint32_t sample		= rays._sample[i];
+				uint32_t bounce		= rays._bounce[i];
+				ray launched		= rays.get_ray(i);
+				vec4 color			= rays.get_color(i);
+				vec4 radiance		= rays.get_radiance(i);
+
+				//the path reached the sky
+				if (_Wavefront._has_hit[i] == 0)
+				{
+					_SampleRadiance[pixelIndex * _pixel_sample_nb + sample] = radiance + color * GetRayColor(launched, _background_gradient_top, _background_gradient_bottom);
+					continue;
+				}
+
+				//a path that bounces too much only keeps the light it already found
+				if (bounce > _depth)
+				{
+					_SampleRadiance[pixelIndex * _pixel_sample_nb + sample] = radiance;
+					_Wavefront._has_hit[i] = 0;
+					continue;
+				}
+
+				//the same random sequences as the other modes, so that they all give out the same image
+				const hit_record& pathHit = _Wavefront._hits[i];
+				_Sampler = _Sampling.get(pixelIndex, sample, PATH_BOUNCE_FIRST_HIT + bounce);
+				ray bounced = propagate_material(*pathHit.mat, launched, pathHit, _Sampler);
+				rays.set_radiance(i, radiance + color * DirectLight(launched, pathHit, _Sampler));
+				rays.set_ray(i, bounced, pathHit.shade * color);
+				rays._bounce[i] = bounce + 1;
+				goOnNb++;
+			}
+
+			if (goOnNb == 0)
+				return;
+
+			//reserving our place in the other buffer
+			wavefront_rays& nextRays	= _Wavefront.next_rays();
+			uint32_t packedIndex		= _Wavefront._next_ray_nb.fetch_add(goOnNb);
+			for (uint32_t i = _first; i < _end; i++)
+				if (_Wavefront._has_hit[i] != 0)
+					nextRays.copy(packedIndex++, rays, i);
+		}
+
+		/*
+		* averages the samples of every pixel of the chunk into the image.
+		* a pixel cut between two waves is averaged again by the next wave.
+		*/
+		__forceinline void Accumulate()const
+		{
+			float sampleWeight = 1.0f / static_cast<float>(_pixel_sample_nb);
+
+			for (uint32_t i = _first; i < _end; i++)
+			{
+				const vec4* pixelSamples = &_SampleRadiance[i * _pixel_sample_nb];
+
+				vec4 sum{ 0.0f, 0.0f, 0.0f, 0.0f };
+				for (uint32_t j = 0; j < _pixel_sample_nb; j++)
+					sum += pixelSamples[j];
+
+				_Image[i]	= sum * sampleWeight;
+				_Image[i].w	= 1.0f;
+			}
+
+			_Owner._Display.mark_pixels(_first, _end);
+		}
+
+		__forceinline void Execute()override
+		{
+			//the image was restarted, the buffers now belong to the new one (a restart waits for the chunk we are on)
+			if (!_Wavefront._epoch.begin_write(_epoch))
+				return;
+
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+			switch (_stage)
+			{
+				case wavefront_stage::GENERATE:		Generate();		break;
+				case wavefront_stage::EXTEND:		Extend();		break;
+				case wavefront_stage::SHADE:		Shade();		break;
+				case wavefront_stage::ACCUMULATE:	Accumulate();	break;
+				default: break;
+			}
+
+			//each stage is timed on its own
+			uint64_t busyNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count());
+			_Wavefront._stage_ns[static_cast<uint32_t>(_stage)].fetch_add(busyNs);
+			RecordThroughput(start);
+
+			//the last job of the stage starts the next one
+			if (_Wavefront._pending_job_nb.fetch_sub(1) == 1)
+				_Owner.NextWavefrontStage(_Pool, _epoch);
+
+			_Wavefront._epoch.end_write();
+		}
+	};
+
+
+	/*
+	* the multithreaded job writing the changed tiles of a row of tiles of the cpu image in the back image of the staging memory,
+	* in the display format. it does not need the scene : the image is only read, and each job writes its own tiles.
+	*/
+	class DisplayEncodeJob : public ThreadJob
+	{
+	public:
+		//the staging memory, to tell when we are done
+		display_staging&	_Display;
+		//the cpu image
+		const vec4*			_Image;
+		//the image of the staging memory being written
+		uint8_t*			_To;
+		//the row of tiles written by this job
+		uint32_t			_tile_y;
+		//the version the image being written holds, only the tiles that changed since are written
+		uint32_t			_since;
+		//the epoch of the staging memory when the job was created, the job does nothing if it changed
+		uint32_t			_epoch;
+
+		DisplayEncodeJob(uint32_t tile_y, RaytraceCPU& Owner) :
+			_Display{ Owner._Display },
+			_Image{ *Owner._RaytracedImage },
+			_To{ Owner._Display.back() },
+			_tile_y{ tile_y },
+			_since{ Owner._Display._image_version[Owner._Display._front ^ 1] },
+			_epoch{ Owner._Display._epoch.load() }
+		{
+		}
+
+		__forceinline void Execute()override
+		{
+			//we say we are writing before looking at the epoch, so that a cancel either waits for us or is seen by us
+			_Display._writing_job_nb.fetch_add(1);
+			if (_Display._epoch.load() == _epoch)
+			{
+				_Display.encode_tile_row(_Image, _To, _tile_y, _since);
+				_Display._pending_job_nb.fetch_sub(1);
 			}
+			_Display._writing_job_nb.fetch_sub(1);
+			_Display._queued_job_nb.fetch_sub(1);
 		}
 	};
 
@@ -435,23 +1586,280 @@ public:
 	*/
 	void DispatchSceneRay(struct AppWideContext& AppContext);
 
+	/*
+	* creates a job for every tile of the screen, in the order of a hilbert curve, so that jobs running at the same time
+	* work on close parts of the screen (and of the scene). Used by DispatchSceneRay in tile mode.
+	*/
+	void DispatchSceneTiles(struct AppWideContext& AppContext, bool progressive = false);
+
+	/*
+	* gives out how noisy the progressive image is : the standard error of the luminance of each pixel,
+	* relative to its luminance, averaged over the screen. it is summed up from what the last pass found out about each tile.
+	* also counts the tiles adaptive sampling has not left out yet.
+	*/
+	float EstimateProgressiveNoise();
+
+	/*
+	* once the previous pass is done, checks whether the progressive image reached its target,
+	* and if not launches a pass over the tiles that still need samples. returns whether a pass was launched.
+	*/
+	bool NextProgressivePass(struct AppWideContext& AppContext);
+
+	/*
+	* writes the whole cpu image again from the progressive sums, as the image or as the heatmap of the samples of each pixel.
+	* should only be called once the pass is done.
+	*/
+	void ResolveProgressiveImage();
+
+	/*
+	* renders a single image of the scene without any window or graphics API, and writes it to the params' output path.
+	* the scene is generated from the params' seed, so that the image can be compared from one build to another.
+	* prints out the render time, the rays per second and how busy each thread was. returns false if the image could not be written.
+	*/
+	bool RenderOffline(struct AppWideContext& AppContext, const OfflineRenderParams& Params);
+
+	/*
+	* keeps CPU_JOBS_PER_WORKER jobs waiting or running for every worker, from the rays waiting in the ray heap.
+	*/
+	void DispatchPendingRays(struct AppWideContext& AppContext);
+
+	/*
+	* stops every job of the scene : the waiting ones are removed, and the running ones are waited for.
+	* the pool is left paused, so that new jobs can be added before resuming it.
+	*/
+	void CancelJobs(ThreadPool& Pool);
+
+	/*
+	* whether the pool has no job of the image left, waiting or running (the jobs writing the staging memory are not counted).
+	*/
+	bool RenderJobsIdle(ThreadPool& Pool);
+
+	/*
+	* shows the image the display jobs finished writing, then has the tiles of the cpu image the render jobs wrote since
+	* written in the staging memory, by a job for each row of tiles.
+	*/
+	void DispatchDisplayEncode(ThreadPool& Pool);
+
+	/*
+	* starts the next stage of the wavefront pipeline, or the next wave once a wave is accumulated.
+	* called by the last job of a stage. does nothing if the image was restarted since the stage started.
+	*/
+	void NextWavefrontStage(ThreadPool& Pool, uint32_t epoch);
+
+	/*
+	* creates the jobs of the current stage of the wavefront pipeline, each working on a chunk of the wave.
+	*/
+	void DispatchWavefrontStage(ThreadPool& Pool, uint32_t epoch);
+
+	/*
+	* takes the rays the jobs traced since last frame to update the measured throughput,
+	* then sizes the ray batches so that a job lasts a fraction of the target frame time.
+	*/
+	void UpdateRayBudget(const struct AppWideContext& AppContext);
+
+	/*
+	* chooses the resolution of the preview shown while moving from the measured throughput,
+	* so that the preview of a frame can be traced within the target frame time.
+	*/
+	void UpdatePreviewScale(const struct AppWideContext& AppContext);
+
+	/*
+	* allocates the depth of the progressive image and the buffers of the previous one, for the screen's size.
+	*/
+	void AllocateReprojection();
+
+	/*
+	* (re)allocates the ray heap and the sample slots for the current screen size and sample count.
+	* nothing is allocated in tile mode, as jobs only need a few locals.
+	*/
+	void AllocateComputeHeap();
+
+	/*
+	* drops every batch of rays waiting to be traced. no job may push any batch meanwhile.
+	*/
+	void ClearRayBatches();
+
+	/*
+	* creates the objects and materials of the scene of the current type, then builds the acceleration structure on it.
+	* if a pool is given, its threads help building the bvhs.
+	*/
+	void GenerateScene(ThreadPool* Pool = nullptr);
+
+	/*
+	* creates the example spheres and the random sphere field around them.
+	*/
+	void GenerateRandomSpheres();
+
+	/*
+	* creates the cornell box as a single triangle mesh.
+	*/
+	void GenerateCornellBox(ThreadPool* Pool);
+
+	/*
+	* creates the ground and the glTF model standing on it (only the ground if the model could not be loaded).
+	*/
+	void GenerateModel(ThreadPool* Pool);
+
+	/*
+	* (re)builds the bounding volume hierarchy over the objects of the scene. 
+	* this should only be called when the objects change.
+	*/
+	void RebuildSceneBVH(ThreadPool* Pool = nullptr);
+
+	/*
+	* releases the objects, materials and acceleration structure of the scene.
+	*/
+	void ClearScene();
+
+	/*
+	* times the intersection of random rays with the scene's spheres, for the virtual hit and each sphere kernel,
+	* both against every sphere and through the bvh. results are given in _sphere_benchmark.
+	*/
+	void BenchmarkSphereKernels();
+
 	// the cpu image. should be of size width * height
 	MultipleScopedMemory<vec4>	_RaytracedImage;
+	//the staging memory the cpu image is written in for the GPU, in the display format
+	display_staging				_Display;
 
 	//the objects in our scene
 	ScopedLoopArray<hittable*>	_Scene;
 	//the materials for our objects
 	ScopedLoopArray<material*>	_Materials;
+	//the acceleration structure built over the objects of our scene
+	bvh							_SceneBVH;
+	//the spheres of our scene in the order of the bvh's leaves, as a structure of arrays for the SIMD kernels
+	sphere_soa					_SceneSpheres;
+	//whether the rays are intersected with the sphere kernels or through the virtual hit of our objects
+	bool						_use_sphere_soa{ true };
+	//what the scene is made of
+	CPUSceneType				_scene_type{ CPU_SCENE_TYPE };
+	//the half size of the grid on which random spheres are created (the grid is (2n+1)x(2n+1) spheres)
+	uint32_t					_random_sphere_grid{ CPU_RANDOM_SPHERE_GRID };
+	//the glTF file of the model scene
+	const char*					_model_path{ CPU_MODEL_PATH };
+
+	//how the work is distributed between jobs
+	CPURenderMode	_render_mode{ CPU_RENDER_MODE };
+	//the rays going from the camera through every pixel, for the current frame
+	camera_rays		_CameraRays;
+	//the image the tile and ray heap jobs work for : a refresh makes the jobs of the previous one drop their work
+	render_epoch	_RenderEpoch;
+
+	//the light of the scene, that the paths cannot hit : it is only found through shadow rays from the diffuse hits
+	Light			_light CPU_DIR_LIGHT;
+	//whether the diffuse hits sample the light (otherwise the scene is only lit by the sky)
+	bool			_light_sampling{ CPU_LIGHT_SAMPLING };
+
+	/* Progressive */
+
+	//whether a still camera adds a sample to every pixel each pass, instead of computing a fixed number of samples once
+	bool							_progressive{ false };
+	//the number of samples per pixel at which the progressive image stops
+	uint32_t						_progressive_target_spp{ CPU_PROGRESSIVE_TARGET_SPP };
+	//the relative noise under which the progressive image stops (0 to never stop on noise)
+	float							_progressive_noise_threshold{ CPU_PROGRESSIVE_NOISE_THRESHOLD };
+	//the number of passes launched since the image was reset
+	uint32_t						_progressive_pass_nb{ 0 };
+	//the noise of the progressive image after the last finished pass
+	float							_progressive_noise{ FLT_MAX };
+	//the progressive image reached its target, no more passes are launched
+	bool							_progressive_done{ false };
+	//the sum of the radiance of every sample of each pixel (the alpha counts the samples), of size width * height
+	MultipleScopedMemory<vec4>		_AccumulatedRadiance;
+	//the sum of the squared luminance of every sample of each pixel, of size width * height
+	MultipleScopedMemory<float>		_AccumulatedLuminanceSq;
+
+	/* Adaptive Sampling */
+
+	//whether the passes leave out the tiles whose noise is under the threshold
+	bool							_adaptive{ false };
+	//the number of samples a tile needs before it can be left out
+	uint32_t						_adaptive_min_spp{ CPU_ADAPTIVE_MIN_SPP };
+	//whether the image shows how many samples each pixel got instead of the pixel
+	bool							_show_sample_heatmap{ false };
+	//what the last pass found out about each tile of the screen, of size tile nb x * tile nb y
+	MultipleScopedMemory<progressive_tile>	_ProgressiveTiles;
+	//the number of tiles the next pass goes through
+	uint32_t						_progressive_active_tile_nb{ 0 };
+	//the number of samples computed since the image was reset, over every pixel
+	uint64_t						_progressive_sample_nb{ 0 };
+	//the image needs to be written again from the sums, as the heatmap was switched
+	bool							_progressive_image_dirty{ false };
+	//the tiles should all be checked again on the next pass, as the adaptive parameters changed
+	bool							_adaptive_reset{ false };
+
+	/* Reprojection */
+
+	//whether a new progressive image starts from the samples of the previous one, when only the camera moved
+	bool							_reprojection{ CPU_REPROJECTION };
+	//the distance from the camera to the first hit of each pixel of the progressive image, of size width * height
+	MultipleScopedMemory<float>		_PixelDepth;
+	//the rays of the camera the progressive image is seen from
+	camera_rays						_AccumulatedCamera{};
+	//the sums, depths and camera of the previous progressive image, that the first pass of the new one reprojects
+	MultipleScopedMemory<vec4>		_HistoryRadiance;
+	MultipleScopedMemory<float>		_HistoryLuminanceSq;
+	MultipleScopedMemory<float>		_HistoryDepth;
+	camera_rays						_HistoryCamera{};
+	//the previous image can be reused by the current one
+	bool							_history_valid{ false };
+	//the refresh comes from the camera alone, the scene and the settings did not change
+	bool							_camera_refresh{ false };
+	//the number of pixels of the current image that started from the previous one
+	uint32_t						_progressive_reprojected_nb{ 0 };
 
 	//a heap that to allocate the any hit compute heap
 	MultipleSharedMemory<ray_compute>			_ComputeHeap;
-	//a Queue to append the Ray Batches
-	Queue<MultipleSharedMemory<ray_compute>>	_ComputeBatch;
-	//a mutex to add and remove the batches concurrently
-	std::mutex									_batch_fence;
-
-	//how many rays should we compute per frame refresh ?
+	//the radiance found by each sample of each pixel, of size width * height * sample nb
+	MultipleSharedMemory<vec4>					_SampleRadiance;
+	//the samples of each pixel whose path is done, so that the job ending the last one averages the pixel
+	MultipleSharedMemory<std::atomic<uint32_t>>	_PixelSampleDoneNb;
+	//the memory each thread of the pool shades the ray heap's batches in, allocated once for the pool
+	ScopedLoopArray<shading_scratch>			_ShadingScratch;
+	//the batches of rays the jobs give back to trace, any job pushing and the main thread popping without a lock
+	BoundedQueue<RayBatch>						_ComputeBatch;
+	//the batch the main thread is cutting jobs in, only used by the main thread
+	RayBatch									_BatchLeft;
+	//the rays waiting to be traced, in the queue or in the batch left
+	std::atomic<uint32_t>						_pending_ray_nb{ 0 };
+
+	//the buffers and state of the wavefront pipeline (only allocated in wavefront mode)
+	wavefront									_Wavefront;
+
+	//the results of the last sphere benchmark, in nanoseconds per ray (negative if the kernel is not supported).
+	//the first column is against every sphere, the second through the bvh. the first row is the virtual hit, then each kernel.
+	float		_sphere_benchmark[1 + static_cast<uint32_t>(simd_level::NB)][2]{};
+	//the number of hits found by each benchmark, that should all be the same
+	uint32_t	_sphere_benchmark_hits[1 + static_cast<uint32_t>(simd_level::NB)][2]{};
+
+	//the seed of the render : the same seed gives the same image, whatever the number of threads
+	uint32_t	_render_seed{ CPU_RENDER_SEED };
+	//the sequence the random numbers of the paths come from (a low discrepancy one converges with fewer samples)
+	sample_sequence	_sample_sequence{ CPU_SAMPLE_SEQUENCE };
+
+	//how many rays should a job compute ? (chosen by hand, or from the frame budget)
 	uint32_t	_compute_per_frames{ RAY_TO_COMPUTE_PER_FRAME };
+
+	/* Scheduling */
+
+	//whether the size of the jobs comes from the measured throughput and the target frame time, or from the user
+	bool					_frame_budget{ true };
+	//the frame time the jobs are sized for, in ms
+	float					_target_frame_time{ CPU_TARGET_FRAME_TIME };
+	//the rays traced by the jobs and the time it took, gathered concurrently by every job
+	mutable ray_throughput	_RayThroughput;
+	//what the jobs traced and what the threads did over the last frames, for the statistics panel
+	mutable render_stats	_RenderStats;
+	//the smoothed number of rays a single worker traces in a ms
+	float					_worker_rays_per_ms{ CPU_DEFAULT_RAYS_PER_MS };
+	//the number of rays the whole pool traced in a ms, over the last frame
+	float					_pool_rays_per_ms{ 0.0f };
+	//whether the preview shown while moving lowers its resolution to hold the target frame time
+	bool					_dynamic_resolution{ CPU_DYNAMIC_RESOLUTION };
+	//the side of the blocks of pixels of the preview : a single ray is traced for each block, and its color fills the block
+	uint32_t				_preview_scale{ 1 };
+
 	//parameters useful for raytracing (such as depth or samples)
 	RaytracingParams _rtParams;
 
@@ -0,0 +1,264 @@
+#ifndef __RAYTRACE_CPU_BVH_H__
+#define __RAYTRACE_CPU_BVH_H__
+
+#include "RaytraceCPUHelper.h"
+
+//the number of bins the primitives are sorted in on each axis to evaluate the surface area heuristic
+#define BVH_SAH_BIN_NB 16
+//the cost of going through a node compared to the cost of intersecting a primitive, for the surface area heuristic
+#define BVH_TRAVERSAL_COST 1.0f
+//the number of primitives above which we will always try to split a node, whatever the heuristic says
+#define BVH_MAX_LEAF_SIZE 8
+//the maximum depth of the tree, which is also the size of the traversal stack
+#define BVH_MAX_DEPTH 64
+//the number of primitives above which a node's left child is built by another thread, when the build is given a pool
+#define BVH_TASK_MIN_PRIM_NB 4096
+
+/*
+* a single node of the bounding volume hierarchy.
+* it is 32 bytes, and two siblings are always created next to each other,
+* so that a pair of children (that we will always test together) lives on the same cache line.
+*/
+struct alignas(32) bvh_node
+{
+	//the corner of the node's box with the smallest coordinates
+	vec3		min;
+	//if it is an inner node, the index of the first child in the node array (the second is right after),
+	//if it is a leaf, the index of the first primitive in the bvh's primitive indices.
+	uint32_t	left_first{ 0 };
+	//the corner of the node's box with the biggest coordinates
+	vec3		max;
+	//the number of primitives in the node. an inner node has none.
+	uint32_t	prim_nb{ 0 };
+
+	__forceinline bool is_leaf()const noexcept { return prim_nb > 0; }
+
+	//intersects the ray (given with its inverted direction) with the node's box.
+	//gives out the distance at which the ray enters the box, or FLT_MAX if it misses or enters after closest.
+	__forceinline float hit(const vec3& origin, const vec3& inv_dir, float closest)const noexcept
+	{
+		//slab method : getting the entry and exit distance on each axis
+		float tx1 = (min.x - origin.x) * inv_dir.x;
+		float tx2 = (max.x - origin.x) * inv_dir.x;
+		float ty1 = (min.y - origin.y) * inv_dir.y;
+		float ty2 = (max.y - origin.y) * inv_dir.y;
+		float tz1 = (min.z - origin.z) * inv_dir.z;
+		float tz2 = (max.z - origin.z) * inv_dir.z;
+
+		//we enter the box when we have entered on all axis, and exit when we have exited on at least one
+		float tmin = fmaxf(fmaxf(fminf(tx1, tx2), fminf(ty1, ty2)), fminf(tz1, tz2));
+		float tmax = fminf(fminf(fmaxf(tx1, tx2), fmaxf(ty1, ty2)), fmaxf(tz1, tz2));
+
+		return (tmax >= tmin && tmax > 0.0f && tmin < closest) ? tmin : FLT_MAX;
+	}
+};
+
+/*
+* what the subdivisions of a single build share, as they may run on several threads
+*/
+struct bvh_build
+{
+	const aabb*				_prim_bounds{ nullptr };
+	//the centroids are what we sort the primitives with, computing them once
+	const vec3*				_prim_centroids{ nullptr };
+	std::atomic<uint32_t>	_node_nb{ 0 };
+	std::atomic<uint32_t>	_leaf_nb{ 0 };
+	std::atomic<uint32_t>	_depth{ 0 };
+	//the pool the big nodes are split on, or nullptr to build on the calling thread only
+	ThreadPool*				_Pool{ nullptr };
+	//the task every subdivision given to the pool is a child of
+	TaskHandle				_Build;
+};
+
+/*
+* A bounding volume hierarchy built with the surface area heuristic.
+* It is built over the bounds of any kind of primitives, and does not know about the primitives themselves :
+* it only reorders their indices so that every leaf references a contiguous range of _prim_indices.
+* The nodes are stored in a flat, cache line aligned array, the root being the first node.
+*/
+struct bvh
+{
+	//the flat array of nodes. the node at index 1 is never used so that siblings pairs start on a 64 bytes boundary.
+	AlignedLoopArray<bvh_node, CACHE_LINE_SIZE>	_nodes;
+	//the indices of the primitives given at build time, reordered so that a leaf references a contiguous range
+	MultipleScopedMemory<uint32_t>				_prim_indices;
+	//the number of nodes actually used in the node array
+	uint32_t									_node_nb{ 0 };
+	//the number of primitives the bvh was built with
+	uint32_t									_prim_nb{ 0 };
+
+	/* Statistics */
+
+	//the number of leaves in the tree
+	uint32_t	_leaf_nb{ 0 };
+	//the depth of the deepest leaf
+	uint32_t	_depth{ 0 };
+	//the time the last build took, in milliseconds
+	float		_build_time{ 0.0f };
+
+	/*
+	* Builds the tree from the bounds of the primitives. this should only be called when the primitives change.
+	* if a pool is given (and running), the big nodes are split by its threads as well, the calling thread helping them until the tree is done.
+	* the nodes are then not always in the same order, but the tree is the same.
+	*/
+	void build(const aabb* prim_bounds, uint32_t prim_nb, ThreadPool* Pool = nullptr);
+
+	/*
+	* Frees the tree.
+	*/
+	void clear();
+
+	/*
+	* Finds the closest primitive hit by the ray, closer than "closest".
+	* the bvh only tests the boxes : leaf_hit is called on each leaf the ray enters, in front to back order, as
+	* bool leaf_hit(uint32_t first, uint32_t nb, float& closest)
+	* where [first, first + nb) is a range in _prim_indices.
+	* It should test the primitives, update closest if it found a closer hit, and return whether it did.
+	* the number of nodes the ray went through is added to node_visit_nb, if given.
+	* returns true if any primitive was hit.
+	*/
+	template<typename LeafHit>
+	__forceinline bool closest_hit(const ray& incoming, float& closest, LeafHit& leaf_hit, uint64_t* node_visit_nb = nullptr)const
+	{
+		if (_node_nb == 0)
+			return false;
+
+		//inverting once for every slab test
+		const vec3 inv_dir{ 1.0f / incoming.direction.x, 1.0f / incoming.direction.y, 1.0f / incoming.direction.z };
+
+		//the nodes we still need to visit, with the distance at which the ray enters them
+		const bvh_node* stack[BVH_MAX_DEPTH];
+		float			stack_dist[BVH_MAX_DEPTH];
+		uint32_t		stack_nb = 0;
+
+		const bvh_node* node = &_nodes[0];
+		if (node->hit(incoming.origin, inv_dir, closest) == FLT_MAX)
+			return false;
+
+		bool has_hit = false;
+		uint32_t visit_nb = 0;
+		while (true)
+		{
+			visit_nb++;
+			if (node->is_leaf())
+			{
+				has_hit |= leaf_hit(node->left_first, node->prim_nb, closest);
+			}
+			else
+			{
+				//siblings are next to each other
+				const bvh_node* near_child	= &_nodes[node->left_first];
+				const bvh_node* far_child	= near_child + 1;
+				float near_dist = near_child->hit(incoming.origin, inv_dir, closest);
+				float far_dist	= far_child->hit(incoming.origin, inv_dir, closest);
+
+				//visiting the closest first, so that "closest" shrinks as fast as possible
+				if (far_dist < near_dist)
+				{
+					const bvh_node* tmp = near_child;
+					near_child	= far_child;
+					far_child	= tmp;
+					float tmp_dist = near_dist;
+					near_dist	= far_dist;
+					far_dist	= tmp_dist;
+				}
+
+				if (near_dist != FLT_MAX)
+				{
+					if (far_dist != FLT_MAX)
+					{
+						stack[stack_nb] = far_child;
+						stack_dist[stack_nb++] = far_dist;
+					}
+					node = near_child;
+					continue;
+				}
+			}
+
+			//going back up, skipping the nodes that are now behind the closest hit
+			do
+			{
+				if (stack_nb == 0)
+				{
+					if (node_visit_nb != nullptr)
+						*node_visit_nb += visit_nb;
+					return has_hit;
+				}
+				node = stack[--stack_nb];
+			} while (stack_dist[stack_nb] >= closest);
+		}
+	}
+
+	/*
+	* Finds whether any primitive is hit by the ray closer than max_distance, for shadow rays.
+	* leaf_hit is the same as for closest_hit, but the traversal stops at the first leaf that has a hit,
+	* so the children are not sorted, and nothing is known about which primitive was hit.
+	*/
+	template<typename LeafHit>
+	__forceinline bool any_hit(const ray& incoming, float max_distance, LeafHit& leaf_hit, uint64_t* node_visit_nb = nullptr)const
+	{
+		if (_node_nb == 0)
+			return false;
+
+		//inverting once for every slab test
+		const vec3 inv_dir{ 1.0f / incoming.direction.x, 1.0f / incoming.direction.y, 1.0f / incoming.direction.z };
+
+		//the nodes we still need to visit
+		const bvh_node* stack[BVH_MAX_DEPTH];
+		uint32_t		stack_nb = 0;
+
+		const bvh_node* node = &_nodes[0];
+		if (node->hit(incoming.origin, inv_dir, max_distance) == FLT_MAX)
+			return false;
+
+		uint32_t visit_nb = 0;
+		while (true)
+		{
+			visit_nb++;
+			if (node->is_leaf())
+			{
+				float closest = max_distance;
+				if (leaf_hit(node->left_first, node->prim_nb, closest))
+				{
+					if (node_visit_nb != nullptr)
+						*node_visit_nb += visit_nb;
+					return true;
+				}
+			}
+			else
+			{
+				//siblings are next to each other
+				const bvh_node* left_child	= &_nodes[node->left_first];
+				const bvh_node* right_child = left_child + 1;
+				bool left_hit	= left_child->hit(incoming.origin, inv_dir, max_distance) != FLT_MAX;
+				bool right_hit	= right_child->hit(incoming.origin, inv_dir, max_distance) != FLT_MAX;
+
+				if (left_hit || right_hit)
+				{
+					if (left_hit && right_hit)
+						stack[stack_nb++] = right_child;
+					node = left_hit ? left_child : right_child;
+					continue;
+				}
+			}
+
+			if (stack_nb == 0)
+			{
+				if (node_visit_nb != nullptr)
+					*node_visit_nb += visit_nb;
+				return false;
+			}
+			node = stack[--stack_nb];
+		}
+	}
+
+private:
+	friend class BVHSubdivideJob;
+
+	/*
+	* Recursively splits the node along the best split found with the binned surface area heuristic.
+	*/
+	void subdivide(uint32_t node_index, uint32_t depth, bvh_build& build);
+};
+
+#endif //__RAYTRACE_CPU_BVH_H__
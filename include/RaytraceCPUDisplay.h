@@ -0,0 +1,231 @@
+#ifndef __RAYTRACE_CPU_DISPLAY_H__
+#define __RAYTRACE_CPU_DISPLAY_H__
+
+#include "Utilities.h"
+#include "Maths.h"
+#include "Define.h"
+
+//for the jobs writing the images
+#include <atomic>
+
+/*
+* the formats the cpu image can be sent to the GPU in.
+* the image is computed in floats, and only written in the display format for the GPU to copy it, so that a lot less is sent each frame.
+*/
+enum class display_format
+{
+	RGBA8	= 0,//8 bits per channel, sRGB encoded (the image is clamped to what the screen shows)
+	RGBA16F = 1,//a half float per channel, keeping the values over 1
+
+	NB
+};
+
+//gives out a readable name for the format
+const char* display_format_name(display_format format);
+
+//the number of bytes of a pixel in the format
+__forceinline uint32_t display_pixel_size(display_format format)
+{
+	return format == display_format::RGBA8 ? 4 : 8;
+}
+
+//encodes a linear value in [0,1] as an 8 bits sRGB channel (the value is clamped first)
+__forceinline uint8_t encode_srgb8(float linear)
+{
+	linear = linear < 0.0f ? 0.0f : (linear > 1.0f ? 1.0f : linear);
+	float encoded = linear <= 0.0031308f ? linear * 12.92f : 1.055f * powf(linear, 1.0f / 2.4f) - 0.055f;
+	return static_cast<uint8_t>(encoded * 255.0f + 0.5f);
+}
+
+//converts a float to a half float, rounding to the nearest (the values too big for a half become infinite)
+__forceinline uint16_t float_to_half(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(float));
+
+	uint16_t sign		= static_cast<uint16_t>((bits >> 16) & 0x8000u);
+	uint32_t absBits	= bits & 0x7fffffffu;
+
+	//too big (or infinite, or not a number)
+	if (absBits >= 0x47800000u)
+		return sign | (absBits > 0x7f800000u ? 0x7e00u : 0x7c00u);
+
+	//too small to be a normal half : the mantissa of a denormal half counts 2^-24s
+	if (absBits < 0x38800000u)
+		return sign | static_cast<uint16_t>(lrintf(fabsf(value) * 16777216.0f));
+
+	//changing the exponent's bias, then rounding the mantissa to its 10 highest bits (to the even one on a tie)
+	uint32_t half = absBits - 0x38000000u;
+	half = (half + 0x0fffu + ((half >> 13) & 1u)) >> 13;
+	return sign | static_cast<uint16_t>(half);
+}
+
+//a rectangle of pixels of the image
+struct display_rect
+{
+	uint32_t _x, _y;
+	uint32_t _width, _height;
+};
+
+/*
+* the staging memory the GPU copies the shown image from, mapped once when it is allocated.
+* it holds two images in the display format : the front one is the last one fully written, which is the one copied to the GPU,
+* while the jobs write the next one in the back one. the back one only becomes the front one once every job is done with it,
+* and is only written again once no frame still copies from it, so that the GPU never gets a half written image.
+* the image is split in tiles of CPU_DISPLAY_TILE_SIZE pixels : the render jobs tell which tiles they wrote,
+* and only those are written in the staging memory, then copied to the GPU.
+*/
+struct display_staging
+{
+	//the format the images are written in
+	display_format			_format{ CPU_DISPLAY_FORMAT };
+	//the mapped memory of the images, one after the other (nullptr when not allocated)
+	uint8_t*				_mapped{ nullptr };
+	//the size of a single image in the mapped memory, aligned for the GPU
+	size_t					_image_size{ 0 };
+	//the size of the images, in pixels
+	uint32_t				_width{ 0 };
+	uint32_t				_height{ 0 };
+	//the number of tiles on each axis (the last ones may be cut)
+	uint32_t				_tile_nb_x{ 0 };
+	uint32_t				_tile_nb_y{ 0 };
+
+	//the image copied to the GPU, the other one being the one written
+	uint32_t				_front{ 0 };
+	//changes every time a new image becomes the front one, so that each frame knows whether its GPU image is up to date
+	uint32_t				_version{ 0 };
+	//the version each image of the staging memory holds
+	uint32_t				_image_version[CPU_DISPLAY_BUFFER_NB]{};
+	//the frames shown so far
+	uint64_t				_frame{ 0 };
+	//the number of frames that can be drawn at once
+	uint32_t				_frame_nb{ 1 };
+	//the first frame at which each image is not copied by any frame in flight anymore
+	uint64_t				_free_frame[CPU_DISPLAY_BUFFER_NB]{};
+
+	//whether the render jobs wrote each tile of the cpu image since it was last written in the staging memory
+	MultipleScopedMemory<std::atomic<uint8_t>>	_TileChanged;
+	//the version in which each tile last changed (a version not shown yet while it is being written)
+	MultipleScopedMemory<uint32_t>				_TileVersion;
+	//the parts of the image the current frame copies to the GPU, a run of tiles of a row each
+	MultipleScopedMemory<display_rect>			_CopyRects;
+	//the number of pixels the last frame copied to the GPU
+	uint32_t				_copied_pixel_nb{ 0 };
+
+	//the jobs are writing the back image
+	bool					_encoding{ false };
+	//the number of jobs writing the back image that are not done yet
+	std::atomic<uint32_t>	_pending_job_nb{ 0 };
+	//the number of jobs that are in the pool, whether they are still waiting or stale
+	std::atomic<uint32_t>	_queued_job_nb{ 0 };
+	//the number of jobs currently writing in the mapped memory
+	std::atomic<uint32_t>	_writing_job_nb{ 0 };
+	//changes every time the writing is cancelled, so that the jobs of an old image do nothing
+	std::atomic<uint32_t>	_epoch{ 0 };
+
+	/*
+	* gets ready to write images of width x height pixels in the mapped memory, both images starting black.
+	* "image_size" is the size of an image in the memory, and "frame_nb" the number of frames that can be drawn at once.
+	*/
+	void reset(uint8_t* mapped, size_t image_size, uint32_t width, uint32_t height, uint32_t frame_nb);
+
+	/*
+	* makes the jobs still waiting do nothing, and waits for the ones writing in the mapped memory.
+	* the tiles they were writing are written again by the next jobs.
+	*/
+	void cancel();
+
+	/*
+	* tells that the pixels in [x, end_x[ x [y, end_y[ of the cpu image were written, to be called once they are.
+	* this may be called by any job at any time.
+	*/
+	__forceinline void mark(uint32_t x, uint32_t y, uint32_t end_x, uint32_t end_y)const
+	{
+		//nothing is sent to the GPU without a window
+		if (_tile_nb_x == 0 || end_x <= x || end_y <= y)
+			return;
+
+		for (uint32_t tileY = y / CPU_DISPLAY_TILE_SIZE; tileY <= (end_y - 1) / CPU_DISPLAY_TILE_SIZE; tileY++)
+			for (uint32_t tileX = x / CPU_DISPLAY_TILE_SIZE; tileX <= (end_x - 1) / CPU_DISPLAY_TILE_SIZE; tileX++)
+				_TileChanged[tileY * _tile_nb_x + tileX].store(1);
+	}
+
+	//tells that the pixels [first, end[ of the cpu image (as indices) were written
+	__forceinline void mark_pixels(uint32_t first, uint32_t end)const
+	{
+		if (end > first && _width > 0)
+			mark(0, first / _width, _width, (end - 1) / _width + 1);
+	}
+
+	//tells that the whole cpu image was written
+	__forceinline void mark_all()const
+	{
+		mark(0, 0, _width, _height);
+	}
+
+	/*
+	* takes the tiles the jobs wrote, as changed in "version" (the version the back image becomes once written).
+	* returns whether any tile of the back image needs to be written.
+	*/
+	bool collect(uint32_t version);
+
+	//whether the tile needs to be written in an image holding "since"
+	__forceinline bool tile_changed(uint32_t tile_index, uint32_t since)const
+	{
+		return _TileVersion[tile_index] > since;
+	}
+
+	/*
+	* writes the tiles of a row of tiles that changed since "since" in "to" (an image of the mapped memory), in the display format.
+	*/
+	void encode_tile_row(const vec4* image, uint8_t* to, uint32_t tile_y, uint32_t since)const;
+
+	/*
+	* makes the back image the front one if every job is done writing it.
+	* returns true if the front image changed.
+	*/
+	bool publish();
+
+	/*
+	* fills _CopyRects with the parts of the front image that changed since "since", merging the tiles next to each other on a row.
+	* returns the number of rects.
+	*/
+	uint32_t changed_rects(uint32_t since);
+
+	/*
+	* tells that the current frame copies the front image to the GPU.
+	*/
+	__forceinline void copied()
+	{
+		_free_frame[_front] = _frame + _frame_nb;
+	}
+
+	//whether the back image can be written, as no frame copies from it anymore
+	__forceinline bool can_encode()const
+	{
+		return _mapped != nullptr && !_encoding && _free_frame[_front ^ 1] <= _frame;
+	}
+
+	__forceinline uint8_t* image(uint32_t index)const
+	{
+		return _mapped + _image_size * index;
+	}
+
+	__forceinline uint8_t* back()const
+	{
+		return image(_front ^ 1);
+	}
+
+	__forceinline uint32_t tile_nb()const
+	{
+		return _tile_nb_x * _tile_nb_y;
+	}
+
+	//the number of bytes sent to the GPU for a whole image
+	__forceinline size_t upload_size()const
+	{
+		return static_cast<size_t>(_width) * _height * display_pixel_size(_format);
+	}
+};
+
+#endif //__RAYTRACE_CPU_DISPLAY_H__
@@ -21,6 +21,229 @@ struct ray
 	}
 };
 
+/*
+* gives out two directions orthogonal to the normalized vector n and to each other,
+* so that a direction sampled around the z axis can be turned around n (see "Building an Orthonormal Basis, Revisited", Duff et al.)
+*/
+__forceinline void orthonormal_basis(const vec3& n, vec3& t, vec3& b)
+{
+	float sign	= copysignf(1.0f, n.z);
+	float a		= -1.0f / (sign + n.z);
+	float c		= n.x * n.y * a;
+	t = vec3{ 1.0f + sign * n.x * n.x * a, sign * c, -sign * n.x };
+	b = vec3{ c, sign + n.y * n.y * a, -n.y };
+}
+
+/*
+* gives out a direction of the hemisphere around the normalized normal, with a probability of cos / pi
+* (what a lambertian surface reflects), from two random numbers in [0, 1).
+*/
+__forceinline vec3 cosine_hemisphere(const vec3& normal, float u1, float u2)
+{
+	//a uniform point on the disk, lifted up onto the hemisphere
+	float radius	= sqrtf(u1);
+	float phi		= 2.0f * static_cast<float>(M_PI) * u2;
+
+	vec3 tangent, bitangent;
+	orthonormal_basis(normal, tangent, bitangent);
+	return tangent * (radius * cosf(phi)) + bitangent * (radius * sinf(phi)) + normal * sqrtf(fmaxf(1.0f - u1, 0.0f));
+}
+
+//gives out a direction uniformly on the unit sphere, from two random numbers in [0, 1)
+__forceinline vec3 uniform_sphere(float u1, float u2)
+{
+	float z			= 1.0f - 2.0f * u1;
+	float radius	= sqrtf(fmaxf(1.0f - z * z, 0.0f));
+	float phi		= 2.0f * static_cast<float>(M_PI) * u2;
+	return vec3{ radius * cosf(phi), radius * sinf(phi), z };
+}
+
+//gives out the perceived brightness of a color
+__forceinline float luminance(const vec4& color)
+{
+	return color.x * 0.2126f + color.y * 0.7152f + color.z * 0.0722f;
+}
+
+/*
+* gives out how noisy the running estimate of a pixel is, from the sum of its samples (the alpha counting them)
+* and the sum of their squared luminance : the standard error of the mean luminance, relative to it
+* (dark pixels would always look noisy otherwise). the noise cannot be estimated from a single sample, this gives out FLT_MAX then.
+*/
+__forceinline float relative_noise(const vec4& sum, float luminance_sq_sum)
+{
+	float sample_nb = sum.w;
+	if (sample_nb < 2.0f)
+		return FLT_MAX;
+
+	float mean		= luminance(sum) / sample_nb;
+	float variance	= fmaxf(luminance_sq_sum / sample_nb - mean * mean, 0.0f) * sample_nb / (sample_nb - 1.0f);
+	return sqrtf(variance / sample_nb) / fmaxf(mean, 0.01f);
+}
+
+//gives out a color going from blue (0) through green (0.5) to red (1), to show how much of something a pixel got
+__forceinline vec4 heatmap_color(float t)
+{
+	t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+	return t < 0.5f ? vec4{ 0.0f, t * 2.0f, 1.0f - t * 2.0f, 1.0f } : vec4{ t * 2.0f - 1.0f, 2.0f - t * 2.0f, 0.0f, 1.0f };
+}
+
+/*
+* what the last progressive pass found out about a tile of the screen, so that the next passes only go where the image is still noisy
+*/
+struct progressive_tile
+{
+	//the sum of the relative noise of the tile's pixels (FLT_MAX while a pixel has a single sample)
+	float	_noise_sum{ FLT_MAX };
+	//the tile's noise is under the threshold : adaptive passes skip it
+	bool	_converged{ false };
+	//the number of the tile's pixels that started from the previous image's samples
+	uint32_t _reprojected_nb{ 0 };
+};
+
+/*
+* the generation of the image the jobs work for : restarting the image makes every job of an older one stale,
+* and a stale job drops its work by itself instead of the pool waiting for it.
+* a job only writes the buffers of the image between begin_write and end_write, so that restarting
+* only waits for the jobs that are in the middle of a write, never for the ones tracing.
+*/
+struct render_epoch
+{
+	//changes every time the image is restarted
+	std::atomic<uint32_t>	_epoch{ 0 };
+	//the number of jobs currently writing the buffers of the image
+	mutable std::atomic<uint32_t>	_writer_nb{ 0 };
+
+	__forceinline uint32_t current()const
+	{
+		return _epoch.load();
+	}
+
+	__forceinline bool stale(uint32_t epoch)const
+	{
+		return _epoch.load() != epoch;
+	}
+
+	/*
+	* to be called before writing the buffers of the image of "epoch". returns false if it was restarted, the job should then stop.
+	* we say we are writing before looking at the epoch, so that a restart either waits for us or is seen by us.
+	*/
+	__forceinline bool begin_write(uint32_t epoch)const
+	{
+		_writer_nb.fetch_add(1);
+		if (_epoch.load() == epoch)
+			return true;
+
+		_writer_nb.fetch_sub(1);
+		return false;
+	}
+
+	__forceinline void end_write()const
+	{
+		_writer_nb.fetch_sub(1);
+	}
+
+	/*
+	* restarts the image, returning its new epoch. once this returns, no job of an older image writes anymore.
+	*/
+	__forceinline uint32_t advance()
+	{
+		uint32_t epoch = _epoch.fetch_add(1) + 1;
+		while (_writer_nb.load() > 0)
+			std::this_thread::yield();
+		return epoch;
+	}
+};
+
+/*
+* the description of the rays going from the camera through every pixel of the screen
+*/
+struct camera_rays
+{
+	//the position of the camera in 3D space
+	vec3 center;
+	//the center of the first (upper left) pixel in 3D space
+	vec3 first_pixel;
+	//the step from a pixel to the next one on the right
+	vec3 pixel_delta_u;
+	//the step from a pixel to the next one below
+	vec3 pixel_delta_v;
+
+	//gives out the ray going through the pixel (w, h), at a random position in the pixel (we anti-aliase using random)
+	__forceinline ray get(uint32_t w, uint32_t h, sequence_sampler& sampler)const noexcept
+	{
+		//drawing the jitter first, so that the order of the random numbers does not depend on the compiler
+		float jitter_u = sampler.next_float() - 0.5f;
+		float jitter_v = sampler.next_float() - 0.5f;
+
+		//first get the pixel's "3D position"
+		vec3 pixel_center = first_pixel + pixel_delta_u * (static_cast<float>(w) + jitter_u) + pixel_delta_v * (static_cast<float>(h) + jitter_v);
+
+		//create a direction from the camera's position to the 3D viewport for this pixel
+		return ray{ pixel_center, normalize(pixel_center - center) };
+	}
+
+	/*
+	* finds where a point of 3D space is seen on the screen, in pixels (the center of the pixel (w, h) being at (w, h)).
+	* returns false if the point is behind the camera.
+	*/
+	__forceinline bool project(const vec3& point, float& u, float& v)const noexcept
+	{
+		//going along the line from the camera to the point, up to the 3D viewport
+		vec3 viewportNormal = cross(pixel_delta_u, pixel_delta_v);
+		float pointDistance		= dot(point - center, viewportNormal);
+		float viewportDistance	= dot(first_pixel - center, viewportNormal);
+		if (pointDistance * viewportDistance <= 0.0f)
+			return false;
+
+		vec3 onViewport = center + (point - center) * (viewportDistance / pointDistance) - first_pixel;
+		u = dot(onViewport, pixel_delta_u) / dot(pixel_delta_u, pixel_delta_u);
+		v = dot(onViewport, pixel_delta_v) / dot(pixel_delta_v, pixel_delta_v);
+		return true;
+	}
+};
+
+/*
+* the simple representation of an axis aligned bounding box in 3D space
+*/
+struct aabb
+{
+	//the corner of the box with the smallest coordinates
+	vec3 min{ FLT_MAX, FLT_MAX, FLT_MAX };
+	//the corner of the box with the biggest coordinates
+	vec3 max{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+	//extends the box so that it includes the point
+	__forceinline void grow(const vec3& point)noexcept
+	{
+		min = vec3{ fminf(min.x, point.x), fminf(min.y, point.y), fminf(min.z, point.z) };
+		max = vec3{ fmaxf(max.x, point.x), fmaxf(max.y, point.y), fmaxf(max.z, point.z) };
+	}
+
+	//extends the box so that it includes the other box
+	__forceinline void grow(const aabb& box)noexcept
+	{
+		grow(box.min);
+		grow(box.max);
+	}
+
+	//gives out the center of the box
+	__forceinline vec3 centroid()const noexcept
+	{
+		return (min + max) * 0.5f;
+	}
+
+	//gives out the surface area of the box, which is what the probability of a ray hitting the box is proportional to.
+	//an empty box has no area.
+	__forceinline float surface_area()const noexcept
+	{
+		if (min.x > max.x)
+			return 0.0f;
+
+		vec3 extent = max - min;
+		return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+	}
+};
+
 /*
 * a simple struct to get info back from the collision between a ray and a hittable object
 */
@@ -50,8 +273,92 @@ struct ray_compute
 	vec4* pixel{ nullptr };
 	//the color the ray has computed so far
 	vec4 color;
+	//the light the path has already gathered from the light source, on its previous hits
+	vec4 radiance;
 	//the number of time the same pixel has been computed
 	uint32_t depth{0};
+	//the index of the pixel in the image, to seed the random numbers of the path
+	uint32_t pixel_index{0};
+	//the index of the sample of the pixel this ray is part of, to seed the random numbers of the path
+	uint32_t sample{0};
+};
+
+//the bounce index with which the camera ray's jitter is sampled
+#define PATH_BOUNCE_CAMERA 0
+//the bounce index with which the first hit is propagated, the following bounces come after this one
+#define PATH_BOUNCE_FIRST_HIT 1
+//the first dimension of a bounce's sample used to sample the light, the ones before being for the material
+#define PATH_DIMENSION_LIGHT 2
+
+/*
+* gives out the samplers of the paths of a render : every (pixel, sample, bounce) has its own random sequence,
+* so that the image does not depend on which thread computes which ray, nor in which order.
+* with a Sobol sequence, the sample is the index of the point in the pixel's sequence, so the samples of a pixel stay stratified.
+*/
+struct path_sampling
+{
+	//the seed of the render
+	uint32_t		seed{ 0 };
+	//the sequence the paths' random numbers come from
+	sample_sequence	sequence{ sample_sequence::WHITE_NOISE };
+	//the width of the image, to find the pixel's position in the blue noise tile
+	uint32_t		image_width{ 1 };
+
+	path_sampling() = default;
+
+	//(the member initializers forbid the aggregate initialization in C++11)
+	__forceinline path_sampling(uint32_t seed_, sample_sequence sequence_, uint32_t image_width_)noexcept :
+		seed{ seed_ },
+		sequence{ sequence_ },
+		image_width{ image_width_ }
+	{
+	}
+
+	//gives out the sampler for a single bounce of a path
+	__forceinline sequence_sampler get(uint32_t pixel_index, uint32_t sample, uint32_t bounce)const noexcept
+	{
+		uint32_t pixel_hash = hash_uint(pixel_index ^ hash_uint(seed));
+
+		switch (sequence)
+		{
+			case sample_sequence::SOBOL:
+				//every pixel and bounce has its own scrambling of the sequence
+				return sequence_sampler{ sequence, sample, hash_uint(bounce ^ pixel_hash) };
+			case sample_sequence::BLUE_NOISE:
+				//every pixel has the same sequence, the blue noise tile decorrelating the pixels next to each other
+				return sequence_sampler{ sequence, sample, hash_uint(bounce ^ hash_uint(seed)), pixel_index % image_width, pixel_index / image_width };
+			default:
+			{
+				uint32_t path_hash = hash_uint(sample ^ hash_uint(bounce ^ pixel_hash));
+				return sequence_sampler{ pcg32{ (static_cast<uint64_t>(pixel_hash) << 32u) | path_hash, path_hash } };
+			}
+		}
+	}
+};
+
+/*
+* the number of rays traced by the jobs, and the time they took to do so.
+* every job adds to it once it is done, and the main thread takes it all once per frame.
+*/
+struct ray_throughput
+{
+	//the rays traced since the last collect
+	std::atomic<uint64_t> _ray_nb{ 0 };
+	//the time the jobs spent tracing them, summed over every thread, in ns
+	std::atomic<uint64_t> _busy_ns{ 0 };
+
+	__forceinline void record(uint64_t ray_nb, uint64_t busy_ns)
+	{
+		_ray_nb.fetch_add(ray_nb);
+		_busy_ns.fetch_add(busy_ns);
+	}
+
+	//gives out what was recorded since the last collect, and starts over
+	__forceinline void collect(uint64_t& ray_nb, uint64_t& busy_ns)
+	{
+		ray_nb	= _ray_nb.exchange(0);
+		busy_ns = _busy_ns.exchange(0);
+	}
 };
 
 /*
@@ -59,24 +366,63 @@ struct ray_compute
 */
 struct hittable
 {
+	//the objects are deleted through this interface
+	virtual ~hittable() = default;
+
 	//a method to implement the collision beween the hittable object and a ray
 	__forceinline virtual bool hit(const ray& incomming, hit_record& record)const = 0;
 
+	//a method to implement whether the ray hits the object closer than max_distance, for shadow rays.
+	//any hit will do, so an object can do better than finding its closest hit.
+	__forceinline virtual bool any_hit(const ray& incomming, float max_distance)const
+	{
+		hit_record record;
+		return hit(incomming, record) && record.distance < max_distance;
+	}
+
 
 	//a method to implement the reflected ray from a hit.
-	// careful, calling twice this method with the same parameter may not have the same result
-	__forceinline virtual ray propagate(const ray& in, const hit_record& record)const = 0;
+	// careful, the reflected ray may be random : it uses (and advances) the sampler
+	__forceinline virtual ray propagate(const ray& in, const hit_record& record, sequence_sampler& sampler)const = 0;
 
 	//a method to implement what color does the hit returns
 	__forceinline virtual vec4 shading(const hit_record& record)const = 0;
+
+	//a method to give out the smallest axis aligned box containing the whole object
+	__forceinline virtual aabb bounds()const = 0;
+};
+
+/*
+* the closed set of materials of the CPU raytracer. knowing the type of a material lets us call it directly,
+* and handle every hit of the same type together.
+*/
+enum class material_type
+{
+	DIFFUSE		= 0,
+	METAL		= 1,
+	DIELECTRIC	= 2,
+	OTHER		= 3,//any other implementation, only reachable through the virtual interface
+
+	NB
 };
 
 /* the simple representation of the material of an hittable object */
 struct material
 {
+	__forceinline material(material_type type = material_type::OTHER)noexcept :
+		_type{ type }
+	{
+	}
+
+	//the scene and the meshes free their materials through this interface
+	virtual ~material() = default;
+
+	//the actual type of the material, to call it without going through the virtual interface
+	material_type _type;
+
 	//a method to implement the reflected ray from a hit.
-	// careful, calling twice this method with the same parameter may not have the same result
-	virtual __forceinline ray propagate(const ray& in, const hit_record& record)const = 0;
+	// careful, the reflected ray may be random : it uses (and advances) the sampler
+	virtual __forceinline ray propagate(const ray& in, const hit_record& record, sequence_sampler& sampler)const = 0;
 
 	//a method to implement what color does the hit returns
 	virtual __forceinline vec4 shading(const hit_record& record)const = 0;
@@ -12,8 +12,12 @@
 */
 struct diffuse : public material
 {
-	__forceinline diffuse() = default;
+	__forceinline diffuse()noexcept :
+		material{ material_type::DIFFUSE }
+	{
+	}
 	__forceinline diffuse(const vec4& color)noexcept :
+		material{ material_type::DIFFUSE },
 		_albedo{ color }
 	{
 	}
@@ -23,12 +27,17 @@ struct diffuse : public material
 
 	//a method to implement the reflected ray from a hit.
 	//diffuse reflection, or basically, lambertian "random" reflection
-	__forceinline virtual ray propagate(const ray& in, const hit_record& record)const override
+	__forceinline virtual ray propagate(const ray& in, const hit_record& record, sequence_sampler& sampler)const override
 	{
-		ray reflect{ record.hit_point, record.hit_normal };
-		reflect.direction = normalize(reflect.direction + normalize(vec3{ randf(-1.0f, 1.0f), randf(-1.0f, 1.0f), randf(-1.0f, 1.0f) }));
+		//a surface (such as a triangle) can be hit from behind, the ray bounces back on the side it came from
+		vec3 normal = dot(record.hit_normal, in.direction) < 0.0f ? record.hit_normal : -record.hit_normal;
 
-		return reflect;
+		//drawing the numbers first, so that the order of the random numbers does not depend on the compiler
+		float u1 = sampler.next_float();
+		float u2 = sampler.next_float();
+
+		//the lambertian's cos is in the probability of the bounce, so a path only needs the albedo to go on
+		return ray{ record.hit_point, cosine_hemisphere(normal, u1, u2) };
 	}
 
 	//a method to implement what color does the hit returns
@@ -41,8 +50,12 @@ struct diffuse : public material
 */
 struct metal : public material
 {
-	__forceinline metal() = default;
-	__forceinline metal(const vec4& color)noexcept :
+	__forceinline metal(material_type type = material_type::METAL)noexcept :
+		material{ type }
+	{
+	}
+	__forceinline metal(const vec4& color, material_type type = material_type::METAL)noexcept :
+		material{ type },
 		_albedo{ color }
 	{
 	}
@@ -52,7 +65,7 @@ struct metal : public material
 
 	//a method to implement the reflected ray from a hit.
 	//perfect reflection so basically taking the incident ray
-	__forceinline virtual ray propagate(const ray& in, const hit_record& record)const override
+	__forceinline virtual ray propagate(const ray& in, const hit_record& record, sequence_sampler&)const override
 	{
 		//are we in the object or outside ?
 		bool front_face = dot(record.hit_normal, in.direction) < 0.0f;
@@ -78,8 +91,12 @@ struct metal : public material
 */
 struct dieletrics : public metal
 {
-	__forceinline dieletrics() = default;
+	__forceinline dieletrics()noexcept :
+		metal{ material_type::DIELECTRIC }
+	{
+	}
 	__forceinline dieletrics(const vec4& color, float index) noexcept :
+		metal{ color, material_type::DIELECTRIC },
 		_albedo{ color },
 		_refract_index{ index }
 	{
@@ -89,7 +106,7 @@ struct dieletrics : public metal
 	float	_refract_index{ 0.0f };
 
 	//diffuse reflection, or basically, lambertian "random" reflection
-	__forceinline virtual ray propagate(const ray& in, const hit_record& record)const override
+	__forceinline virtual ray propagate(const ray& in, const hit_record& record, sequence_sampler& sampler)const override
 	{
 		//we will use snell's law to approximate refraction properties
 		//the ray will refract when the angle between the ray and the normal is less then 90 degrees
@@ -118,10 +135,10 @@ struct dieletrics : public metal
 		reflectance = reflectance + (1.0f * reflectance) * powf((1.0f - cos_ray_normal), 5);
 
 		//as snell's law is an approximation, it actually takes more of a probabilistic approach, thus the random.
-		if (cannot_refract || reflectance > randf())
+		if (cannot_refract || reflectance > sampler.next_float())
 		{
 			//full-on reflection
-			return metal::propagate(in, record);
+			return metal::propagate(in, record, sampler);
 		}
 		else
 		{
@@ -146,6 +163,70 @@ struct dieletrics : public metal
 
 };
 
+/*
+* calls the propagate of a material known to be of the given type, without going through the virtual interface nor looking at its type.
+* this is what the loops going over the hits of a single material type call.
+*/
+template<material_type type>
+__forceinline ray propagate_material_as(const material& mat, const ray& in, const hit_record& record, sequence_sampler& sampler)
+{
+	return mat.propagate(in, record, sampler);
+}
+
+template<>
+__forceinline ray propagate_material_as<material_type::DIFFUSE>(const material& mat, const ray& in, const hit_record& record, sequence_sampler& sampler)
+{
+	return static_cast<const diffuse&>(mat).diffuse::propagate(in, record, sampler);
+}
+
+template<>
+__forceinline ray propagate_material_as<material_type::METAL>(const material& mat, const ray& in, const hit_record& record, sequence_sampler& sampler)
+{
+	return static_cast<const metal&>(mat).metal::propagate(in, record, sampler);
+}
+
+template<>
+__forceinline ray propagate_material_as<material_type::DIELECTRIC>(const material& mat, const ray& in, const hit_record& record, sequence_sampler& sampler)
+{
+	return static_cast<const dieletrics&>(mat).dieletrics::propagate(in, record, sampler);
+}
+
+/*
+* calls the propagate of the material's actual type, without going through the virtual interface.
+*/
+__forceinline ray propagate_material(const material& mat, const ray& in, const hit_record& record, sequence_sampler& sampler)
+{
+	switch (mat._type)
+	{
+	case material_type::DIFFUSE:
+		return propagate_material_as<material_type::DIFFUSE>(mat, in, record, sampler);
+	case material_type::METAL:
+		return propagate_material_as<material_type::METAL>(mat, in, record, sampler);
+	case material_type::DIELECTRIC:
+		return propagate_material_as<material_type::DIELECTRIC>(mat, in, record, sampler);
+	default:
+		return mat.propagate(in, record, sampler);
+	}
+}
+
+/*
+* calls the shading of the material's actual type, without going through the virtual interface.
+*/
+__forceinline vec4 shade_material(const material& mat, const hit_record& record)
+{
+	switch (mat._type)
+	{
+	case material_type::DIFFUSE:
+		return static_cast<const diffuse&>(mat).diffuse::shading(record);
+	case material_type::METAL:
+		return static_cast<const metal&>(mat).metal::shading(record);
+	case material_type::DIELECTRIC:
+		return static_cast<const dieletrics&>(mat).dieletrics::shading(record);
+	default:
+		return mat.shading(record);
+	}
+}
+
 
 /*===== HITTABLE OBJECTS IMPLEMENTATION =====*/
 
@@ -214,11 +295,30 @@ struct sphere : public hittable
 		record.distance		= record.distance < HIT_EPSILON ? fmax(root_1, root_2) : record.distance;//avoid considering a collision behind the camera
 		record.hit_point	= incomming.at(record.distance);
 		record.hit_normal	= (record.hit_point - _center) / _radius;//this is a normalized vector
-		record.shade		= shading(record);
 		record.mat			= _material;
+		//the shade is only computed for the closest hit, once it is known (see shading)
 		return true;
 	}
 
+	//a method to implement whether the ray hits the sphere closer than max_distance, without filling up any record
+	__forceinline virtual bool any_hit(const ray& incomming, float max_distance)const override
+	{
+		//the same equation as hit, with a == 1
+		vec3 ray_to_center	= _center - incomming.origin;
+		float h				= dot(incomming.direction, ray_to_center);
+		float c				= dot(ray_to_center, ray_to_center) - (_radius * _radius);
+		float discriminant	= (h * h) - c;
+
+		if (discriminant <= 0.0f)
+			return false;
+
+		//the closest root in front of the origin
+		float sqrt_discriminant = sqrtf(discriminant);
+		float distance			= h - sqrt_discriminant;
+		distance				= distance < HIT_EPSILON ? h + sqrt_discriminant : distance;
+		return distance >= HIT_EPSILON && distance < max_distance;
+	}
+
 	//a method to implement what color does the hit returns, basically depends on the material
 	__forceinline virtual vec4 shading(const hit_record& record)const override
 	{
@@ -226,9 +326,19 @@ struct sphere : public hittable
 	}
 
 	//a method to implement the reflected ray from a hit, basically depends on the material
-	__forceinline virtual ray propagate(const ray& in, const hit_record& record)const override
+	__forceinline virtual ray propagate(const ray& in, const hit_record& record, sequence_sampler& sampler)const override
+	{
+		return _material == nullptr ? ray{} : _material->propagate(in, record, sampler);
+	}
+
+	//a method to give out the smallest axis aligned box containing the whole sphere
+	__forceinline virtual aabb bounds()const override
 	{
-		return _material == nullptr ? ray{} : _material->propagate(in, record);
+		vec3 extent{ _radius, _radius, _radius };
+		aabb box;
+		box.min = _center - extent;
+		box.max = _center + extent;
+		return box;
 	}
 };
 
@@ -0,0 +1,142 @@
+#ifndef __RAYTRACE_CPU_MESH_H__
+#define __RAYTRACE_CPU_MESH_H__
+
+#include "RaytraceCPUBVH.h"
+#include "RaytraceCPUSIMD.h"
+
+/*
+* a mesh of triangles the CPU raytracer can trace, as a single object of the scene.
+* the vertices are indexed, and stored as a structure of arrays.
+* the mesh has its own bvh over its triangles, and its triangles are copied in the order of the bvh's leaves
+* so that the SIMD kernels go through a leaf without indirection.
+* the mesh owns its materials, each triangle referencing one of them.
+*/
+struct triangle_mesh : public hittable
+{
+	//the position of each vertex, one array per axis
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_pos_x;
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_pos_y;
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_pos_z;
+	//the normal of each vertex, one array per axis (not allocated if the mesh has no normals)
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_normal_x;
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_normal_y;
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_normal_z;
+	//the three vertices of each triangle
+	MultipleScopedMemory<uint32_t>				_indices;
+	//the material of each triangle, as an index in _materials
+	MultipleScopedMemory<uint32_t>				_material_id;
+	//the materials of the mesh
+	ScopedLoopArray<material*>					_materials;
+	//the number of vertices
+	uint32_t									_vertex_nb{ 0 };
+	//the number of triangles
+	uint32_t									_triangle_nb{ 0 };
+	//whether the hit normal is interpolated from the vertices' normals, or is the triangle's
+	bool										_has_normals{ false };
+
+	//the acceleration structure built over the triangles
+	bvh											_BVH;
+	//the triangles in the order of the bvh's leaves, for the kernels
+	triangle_soa								_Triangles;
+	//the box around every vertex
+	aabb										_bounds;
+
+	triangle_mesh() = default;
+	triangle_mesh(const triangle_mesh&) = delete;
+
+	~triangle_mesh()
+	{
+		clear();
+	}
+
+	/*
+	* allocates the mesh's arrays. the normals are only allocated if has_normals is true.
+	* the materials are all set to nullptr.
+	*/
+	void alloc(uint32_t vertex_nb, uint32_t triangle_nb, uint32_t material_nb, bool has_normals);
+
+	/*
+	* frees the mesh's arrays and materials.
+	*/
+	void clear();
+
+	/*
+	* sets the vertex at index.
+	*/
+	__forceinline void set_vertex(uint32_t index, const vec3& pos)
+	{
+		_pos_x[index] = pos.x;
+		_pos_y[index] = pos.y;
+		_pos_z[index] = pos.z;
+	}
+
+	/*
+	* sets the normal of the vertex at index.
+	*/
+	__forceinline void set_normal(uint32_t index, const vec3& normal)
+	{
+		_normal_x[index] = normal.x;
+		_normal_y[index] = normal.y;
+		_normal_z[index] = normal.z;
+	}
+
+	__forceinline vec3 get_vertex(uint32_t index)const
+	{
+		return vec3{ _pos_x[index], _pos_y[index], _pos_z[index] };
+	}
+
+	__forceinline vec3 get_normal(uint32_t index)const
+	{
+		return vec3{ _normal_x[index], _normal_y[index], _normal_z[index] };
+	}
+
+	/*
+	* scales and moves the vertices so that the mesh is "height" tall, and the center of the bottom of its box is at "base".
+	* this should be called before build.
+	*/
+	void fit(const vec3& base, float height);
+
+	/*
+	* builds the bvh and the triangles' arrays from the vertices and indices. this should be called once they are set.
+	* if a pool is given, its threads help building the bvh.
+	*/
+	void build(ThreadPool* Pool = nullptr);
+
+	//finds the closest triangle hit by the ray
+	virtual bool hit(const ray& incomming, hit_record& record)const override;
+
+	//finds whether any triangle is hit by the ray closer than max_distance, stopping at the first leaf that has a hit
+	virtual bool any_hit(const ray& incomming, float max_distance)const override;
+
+	//a method to implement what color does the hit returns, basically depends on the material of the triangle
+	__forceinline virtual vec4 shading(const hit_record& record)const override
+	{
+		return record.mat == nullptr ? vec4{ 0.0f, 0.0f, 0.0f, 0.0f } : record.mat->shading(record);
+	}
+
+	//a method to implement the reflected ray from a hit, basically depends on the material of the triangle
+	__forceinline virtual ray propagate(const ray& in, const hit_record& record, sequence_sampler& sampler)const override
+	{
+		return record.mat == nullptr ? ray{} : record.mat->propagate(in, record, sampler);
+	}
+
+	//a method to give out the smallest axis aligned box containing the whole mesh
+	__forceinline virtual aabb bounds()const override
+	{
+		return _bounds;
+	}
+};
+
+/*
+* loads the meshes of the default scene of a glTF file as a single triangle mesh, with a diffuse or metal material for each of its materials.
+* a textured material gets the average color of its texture.
+* returns false if the file could not be read, or has no triangles.
+*/
+bool load_gltf_mesh(const char* file_name, triangle_mesh& mesh);
+
+/*
+* makes the triangle mesh of the cornell box used by the other scenes, with its red, green and white diffuse materials.
+*/
+void create_cornell_box_mesh(float scale, triangle_mesh& mesh);
+
+#endif //__RAYTRACE_CPU_MESH_H__
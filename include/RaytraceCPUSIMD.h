@@ -0,0 +1,218 @@
+#ifndef __RAYTRACE_CPU_SIMD_H__
+#define __RAYTRACE_CPU_SIMD_H__
+
+#include "RaytraceCPUHelper.h"
+
+//the widest vector we use is 8 floats (AVX), arrays are aligned and padded for it
+#define SIMD_MAX_WIDTH 8
+#define SIMD_ALIGNMENT 32
+
+/*
+* the instruction sets the CPU raytracer has kernels for.
+* the best one is picked at runtime from what the CPU supports, the others are kept as fallback.
+*/
+enum class simd_level
+{
+	SCALAR	= 0,
+	SSE		= 1,//4-wide
+	AVX2	= 2,//8-wide
+
+	NB
+};
+
+//gives out the best instruction set supported by the CPU (and OS) we are running on
+simd_level detect_simd_level();
+
+//gives out a readable name for the instruction set
+const char* simd_level_name(simd_level level);
+
+/*
+* a structure of arrays representation of a set of spheres, to intersect a ray with multiple spheres at once.
+* every array is aligned on the SIMD width, and padded so that a kernel can always read a full vector.
+*/
+struct sphere_soa
+{
+	/*
+	* a kernel testing a ray with the spheres [first, first + nb).
+	* it gives out the index and the distance of the closest sphere hit closer than "closest".
+	* returns true if such a sphere was hit.
+	*/
+	typedef bool (*hit_kernel)(const sphere_soa& spheres, const ray& incoming, uint32_t first, uint32_t nb, float& closest, uint32_t& hit_index);
+
+	//the position of the center of each sphere, one array per axis
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_center_x;
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_center_y;
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_center_z;
+	//the radius of each sphere
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_radius;
+	//the index of the material of each sphere
+	AlignedLoopArray<uint32_t, SIMD_ALIGNMENT>	_material_id;
+	//the number of actual spheres (arrays are bigger because of the padding)
+	uint32_t									_nb{ 0 };
+
+	//the kernel used in hit
+	hit_kernel	_kernel{ nullptr };
+	//the instruction set of the kernel used in hit
+	simd_level	_level{ simd_level::SCALAR };
+
+	/*
+	* allocates the arrays for nb spheres, and chooses the best kernel available if none was chosen.
+	*/
+	void alloc(uint32_t nb);
+
+	/*
+	* frees the arrays.
+	*/
+	void clear();
+
+	/*
+	* sets the sphere at index.
+	*/
+	__forceinline void set(uint32_t index, const vec3& center, float radius, uint32_t material_id)
+	{
+		_center_x[index]	= center.x;
+		_center_y[index]	= center.y;
+		_center_z[index]	= center.z;
+		_radius[index]		= radius;
+		_material_id[index] = material_id;
+	}
+
+	/*
+	* chooses the kernel to use. if the CPU does not support the instruction set, the best supported one is used instead.
+	*/
+	void select_kernel(simd_level level);
+
+	/*
+	* gives out the kernel for the instruction set (nullptr if not compiled for this platform)
+	*/
+	static hit_kernel get_kernel(simd_level level);
+
+	/*
+	* tests a ray with the spheres [first, first + nb) using the chosen kernel.
+	*/
+	__forceinline bool hit(const ray& incoming, uint32_t first, uint32_t nb, float& closest, uint32_t& hit_index)const
+	{
+		return _kernel(*this, incoming, first, nb, closest, hit_index);
+	}
+
+	/*
+	* fills up a hit record from the index and distance given out by a kernel.
+	*/
+	__forceinline void record(const ray& incoming, uint32_t index, float distance, hit_record& record)const
+	{
+		vec3 center{ _center_x[index], _center_y[index], _center_z[index] };
+
+		record.distance		= distance;
+		record.hit_point	= incoming.at(distance);
+		record.hit_normal	= (record.hit_point - center) / _radius[index];//this is a normalized vector
+	}
+};
+
+/*
+* a structure of arrays representation of a set of triangles, to intersect a ray with multiple triangles at once.
+* each triangle is stored as its first vertex and its two edges from it, which is what the Moller-Trumbore test uses.
+* like the spheres, every array is aligned on the SIMD width, and padded so that a kernel can always read a full vector.
+*/
+struct triangle_soa
+{
+	/*
+	* a kernel testing a ray with the triangles [first, first + nb).
+	* it gives out the index and the distance of the closest triangle hit closer than "closest".
+	* returns true if such a triangle was hit.
+	*/
+	typedef bool (*hit_kernel)(const triangle_soa& triangles, const ray& incoming, uint32_t first, uint32_t nb, float& closest, uint32_t& hit_index);
+
+	//the first vertex of each triangle, one array per axis
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_v0_x;
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_v0_y;
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_v0_z;
+	//the edge from the first to the second vertex of each triangle, one array per axis
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_edge1_x;
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_edge1_y;
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_edge1_z;
+	//the edge from the first to the third vertex of each triangle, one array per axis
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_edge2_x;
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_edge2_y;
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_edge2_z;
+	//the index of each triangle in the mesh it comes from
+	AlignedLoopArray<uint32_t, SIMD_ALIGNMENT>	_triangle_id;
+	//the number of actual triangles (arrays are bigger because of the padding)
+	uint32_t									_nb{ 0 };
+
+	//the kernel used in hit
+	hit_kernel	_kernel{ nullptr };
+	//the instruction set of the kernel used in hit
+	simd_level	_level{ simd_level::SCALAR };
+
+	/*
+	* allocates the arrays for nb triangles, and chooses the best kernel available if none was chosen.
+	*/
+	void alloc(uint32_t nb);
+
+	/*
+	* frees the arrays.
+	*/
+	void clear();
+
+	/*
+	* sets the triangle at index from its three vertices.
+	*/
+	__forceinline void set(uint32_t index, const vec3& v0, const vec3& v1, const vec3& v2, uint32_t triangle_id)
+	{
+		_v0_x[index]		= v0.x;
+		_v0_y[index]		= v0.y;
+		_v0_z[index]		= v0.z;
+		_edge1_x[index]		= v1.x - v0.x;
+		_edge1_y[index]		= v1.y - v0.y;
+		_edge1_z[index]		= v1.z - v0.z;
+		_edge2_x[index]		= v2.x - v0.x;
+		_edge2_y[index]		= v2.y - v0.y;
+		_edge2_z[index]		= v2.z - v0.z;
+		_triangle_id[index] = triangle_id;
+	}
+
+	/*
+	* chooses the kernel to use. if the CPU does not support the instruction set, the best supported one is used instead.
+	*/
+	void select_kernel(simd_level level);
+
+	/*
+	* gives out the kernel for the instruction set (nullptr if not compiled for this platform)
+	*/
+	static hit_kernel get_kernel(simd_level level);
+
+	/*
+	* tests a ray with the triangles [first, first + nb) using the chosen kernel.
+	*/
+	__forceinline bool hit(const ray& incoming, uint32_t first, uint32_t nb, float& closest, uint32_t& hit_index)const
+	{
+		return _kernel(*this, incoming, first, nb, closest, hit_index);
+	}
+
+	/*
+	* gives out the barycentric coordinates of the hit point of the ray on the triangle at index,
+	* (the weight of the second and of the third vertex) for a ray the kernels said hits it.
+	*/
+	__forceinline void barycentrics(const ray& incoming, uint32_t index, float& u, float& v)const
+	{
+		vec3 edge1{ _edge1_x[index], _edge1_y[index], _edge1_z[index] };
+		vec3 edge2{ _edge2_x[index], _edge2_y[index], _edge2_z[index] };
+		vec3 to_origin = incoming.origin - vec3{ _v0_x[index], _v0_y[index], _v0_z[index] };
+
+		vec3 p = cross(incoming.direction, edge2);
+		float inv_det = 1.0f / dot(edge1, p);
+
+		u = dot(to_origin, p) * inv_det;
+		v = dot(incoming.direction, cross(to_origin, edge1)) * inv_det;
+	}
+
+	/*
+	* gives out the normal of the plane of the triangle at index (following the triangle's winding).
+	*/
+	__forceinline vec3 face_normal(uint32_t index)const
+	{
+		return normalize(cross(vec3{ _edge1_x[index], _edge1_y[index], _edge1_z[index] }, vec3{ _edge2_x[index], _edge2_y[index], _edge2_z[index] }));
+	}
+};
+
+#endif //__RAYTRACE_CPU_SIMD_H__
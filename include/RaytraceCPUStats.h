@@ -0,0 +1,189 @@
+#ifndef __RAYTRACE_CPU_STATS_H__
+#define __RAYTRACE_CPU_STATS_H__
+
+#include "Utilities.h"
+#include "Define.h"
+
+/*
+* what a job traced, counted in plain integers while it runs, then given to the counters of its thread once it is done
+*/
+struct trace_counters
+{
+	//the rays that looked for their closest hit, by depth (the camera rays first, the deeper ones all in the last)
+	uint64_t	_ray_nb[CPU_STATS_DEPTH_NB]{};
+	//the shadow rays sent towards the light
+	uint64_t	_shadow_ray_nb{ 0 };
+	//the primitives of the scene tested against a ray, in the leaves of the scene's bvh
+	uint64_t	_prim_test_nb{ 0 };
+	//the nodes of the scene's bvh the rays went through
+	uint64_t	_node_visit_nb{ 0 };
+
+	__forceinline void count_ray(uint32_t depth)
+	{
+		_ray_nb[depth < CPU_STATS_DEPTH_NB ? depth : CPU_STATS_DEPTH_NB - 1]++;
+	}
+
+	//every ray traced, shadow rays included
+	__forceinline uint64_t total_ray_nb()const
+	{
+		uint64_t rayNb = _shadow_ray_nb;
+		for (uint32_t i = 0; i < CPU_STATS_DEPTH_NB; i++)
+			rayNb += _ray_nb[i];
+		return rayNb;
+	}
+
+	void add(const trace_counters& counters);
+};
+
+/*
+* the counters of a single thread : only the jobs running on it add to them, and the main thread takes them once per frame.
+* they are padded so that two threads never write the same cache line.
+*/
+struct thread_trace_counters
+{
+	std::atomic<uint64_t>	_ray_nb[CPU_STATS_DEPTH_NB];
+	std::atomic<uint64_t>	_shadow_ray_nb;
+	std::atomic<uint64_t>	_prim_test_nb;
+	std::atomic<uint64_t>	_node_visit_nb;
+	uint8_t					_padding[64];
+
+	__forceinline thread_trace_counters()
+	{
+		trace_counters discarded;
+		take(discarded);
+	}
+
+	//adds what a job counted
+	void add(const trace_counters& counters);
+
+	//gives out what was counted since the last take, and starts over
+	void take(trace_counters& counters);
+};
+
+/*
+* what a thread of the pool did during a frame
+*/
+struct thread_frame_stats
+{
+	//the rays traced by the jobs the thread ran, shadow rays included
+	uint64_t	_ray_nb{ 0 };
+	//the number of jobs the thread ran
+	uint64_t	_job_nb{ 0 };
+	//the time the thread spent running jobs
+	float		_busy_ms{ 0.0f };
+	//the time the jobs it ran waited in the queue before
+	float		_queue_wait_ms{ 0.0f };
+	//the time the thread spent waiting for a job
+	float		_idle_ms{ 0.0f };
+};
+
+/*
+* what the CPU raytracer did during a frame, over every thread
+*/
+struct frame_stats
+{
+	//the time the frame took
+	float			_frame_ms{ 0.0f };
+	//what the jobs traced
+	trace_counters	_Counters;
+	//what the threads did, summed over every thread
+	thread_frame_stats	_Threads;
+};
+
+/*
+* the values the statistics can show a graph of, over the frames they keep
+*/
+enum class stats_graph
+{
+	RAYS				= 0,//the rays traced during the frame, shadow rays included
+	PRIM_TESTS_PER_RAY	= 1,//the primitives tested for each ray
+	NODE_VISITS_PER_RAY = 2,//the bvh nodes each ray went through
+	BUSY				= 3,//the part of the frame the threads spent running jobs
+	QUEUE_WAIT			= 4,//the average time a job waited in the queue
+	IDLE				= 5,//the part of the frame the threads spent waiting for a job
+
+	NB
+};
+
+//gives out a readable name for the graph
+const char* stats_graph_name(stats_graph graph);
+
+/*
+* the statistics of the CPU raytracer : the jobs count what they trace on the thread they run on, the pool times what its threads do,
+* and both are gathered once per frame in the history of the last CPU_STATS_HISTORY_NB frames, for the graphs and the export.
+*/
+struct render_stats
+{
+	//the counters the jobs add to, one for each thread of the pool, then one for any other thread
+	ScopedLoopArray<thread_trace_counters>	_ThreadCounters;
+	//the number of threads of the pool
+	uint32_t								_thread_nb{ 0 };
+	//the busy, queue wait and idle times, and job number of each thread of the pool at the last collect, to only keep what the frame added
+	MultipleScopedMemory<uint64_t>			_LastPoolValues;
+
+	//the last frames, as a ring starting at _first
+	MultipleScopedMemory<frame_stats>		_History;
+	//what each thread did on the last frames, as a ring of CPU_STATS_HISTORY_NB frames for each thread
+	MultipleScopedMemory<thread_frame_stats>	_ThreadHistory;
+	//the oldest frame of the rings
+	uint32_t								_first{ 0 };
+	//the number of frames in the rings
+	uint32_t								_frame_nb{ 0 };
+
+	/*
+	* allocates the counters and the history for a pool of thread_nb threads, without any frame.
+	* the jobs add to the counters while they run : this should be called before any job is created.
+	*/
+	void alloc(uint32_t thread_nb);
+
+	/*
+	* frees the counters and the history.
+	*/
+	void clear();
+
+	/*
+	* adds what a job counted to the counters of the thread it runs on. this may be called by any job at any time.
+	*/
+	__forceinline void record(const trace_counters& counters)
+	{
+		if (_ThreadCounters.Nb() == 0)
+			return;
+
+		uint32_t threadIndex = ThreadPool::GetCurrentThreadIndex();
+		_ThreadCounters[threadIndex < _thread_nb ? threadIndex : _thread_nb].add(counters);
+	}
+
+	/*
+	* gathers what the jobs and the pool's threads did since the last collect as a new frame of the history.
+	*/
+	void collect(const ThreadPool& Pool, float frame_ms);
+
+	//the frame that is "age" frames old (0 being the last one)
+	__forceinline const frame_stats& frame(uint32_t age)const
+	{
+		return _History[(_first + _frame_nb - 1 - age) % CPU_STATS_HISTORY_NB];
+	}
+
+	__forceinline const thread_frame_stats& thread_frame(uint32_t thread_index, uint32_t age)const
+	{
+		return _ThreadHistory[thread_index * CPU_STATS_HISTORY_NB + (_first + _frame_nb - 1 - age) % CPU_STATS_HISTORY_NB];
+	}
+
+	/*
+	* gives out what the thread did on average over the frames of the history.
+	*/
+	thread_frame_stats thread_average(uint32_t thread_index)const;
+
+	/*
+	* gives out the value of the graph for the frame that is index frames after the oldest one.
+	*/
+	float graph_value(stats_graph graph, uint32_t index)const;
+
+	/*
+	* writes every frame of the history, oldest first, in a json file.
+	* returns false if the file could not be written.
+	*/
+	bool export_json(const char* file_name)const;
+};
+
+#endif //__RAYTRACE_CPU_STATS_H__
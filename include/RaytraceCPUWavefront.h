@@ -0,0 +1,207 @@
+#ifndef __RAYTRACE_CPU_WAVEFRONT_H__
+#define __RAYTRACE_CPU_WAVEFRONT_H__
+
+#include "RaytraceCPUSIMD.h"
+
+/*
+* the stages of the wavefront pipeline, run one after the other on every ray of a wave.
+* extend and shade are repeated until no ray of the wave goes on.
+*/
+enum class wavefront_stage
+{
+	GENERATE	= 0,//creates the camera ray of every path of the wave
+	EXTEND		= 1,//finds the closest hit of every ray
+	SHADE		= 2,//ends the rays that missed or bounced too much, and bounces the others (packed in the other buffer)
+	ACCUMULATE	= 3,//averages the samples of the pixels of the wave into the image
+
+	NB
+};
+
+//gives out a readable name for the stage
+const char* wavefront_stage_name(wavefront_stage stage);
+
+/*
+* the rays of a wave as a structure of arrays, so that a stage only brings in cache the parts it uses.
+* a ray always goes with the state of the path it belongs to.
+*/
+struct wavefront_rays
+{
+	//the origin of each ray, one array per axis
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_origin_x;
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_origin_y;
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_origin_z;
+	//the direction of each ray, one array per axis
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_direction_x;
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_direction_y;
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_direction_z;
+	//the light the path kept through its bounces, one array per channel
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_color_r;
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_color_g;
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_color_b;
+	//the light the path gathered from the light source on its hits, one array per channel
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_radiance_r;
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_radiance_g;
+	AlignedLoopArray<float, SIMD_ALIGNMENT>		_radiance_b;
+	//the pixel, sample and number of surfaces hit of the path of each ray
+	AlignedLoopArray<uint32_t, SIMD_ALIGNMENT>	_pixel_index;
+	AlignedLoopArray<uint32_t, SIMD_ALIGNMENT>	_sample;
+	AlignedLoopArray<uint32_t, SIMD_ALIGNMENT>	_bounce;
+
+	//the number of bytes needed for a single ray
+	static constexpr uint32_t ray_size = 12 * sizeof(float) + 3 * sizeof(uint32_t);
+
+	/*
+	* allocates the arrays for nb rays.
+	*/
+	void alloc(uint32_t nb);
+
+	/*
+	* frees the arrays.
+	*/
+	void clear();
+
+	__forceinline ray get_ray(uint32_t index)const
+	{
+		return ray{ vec3{ _origin_x[index], _origin_y[index], _origin_z[index] }, vec3{ _direction_x[index], _direction_y[index], _direction_z[index] } };
+	}
+
+	__forceinline vec4 get_color(uint32_t index)const
+	{
+		return vec4{ _color_r[index], _color_g[index], _color_b[index], 1.0f };
+	}
+
+	__forceinline vec4 get_radiance(uint32_t index)const
+	{
+		return vec4{ _radiance_r[index], _radiance_g[index], _radiance_b[index], 0.0f };
+	}
+
+	__forceinline void set_ray(uint32_t index, const ray& launched, const vec4& color)
+	{
+		_origin_x[index]	= launched.origin.x;
+		_origin_y[index]	= launched.origin.y;
+		_origin_z[index]	= launched.origin.z;
+		_direction_x[index]	= launched.direction.x;
+		_direction_y[index]	= launched.direction.y;
+		_direction_z[index]	= launched.direction.z;
+		_color_r[index]		= color.x;
+		_color_g[index]		= color.y;
+		_color_b[index]		= color.z;
+	}
+
+	__forceinline void set_radiance(uint32_t index, const vec4& radiance)
+	{
+		_radiance_r[index]	= radiance.x;
+		_radiance_g[index]	= radiance.y;
+		_radiance_b[index]	= radiance.z;
+	}
+
+	__forceinline void set_path(uint32_t index, uint32_t pixel_index, uint32_t sample, uint32_t bounce)
+	{
+		_pixel_index[index] = pixel_index;
+		_sample[index]		= sample;
+		_bounce[index]		= bounce;
+	}
+
+	/*
+	* copies the ray at index in "from" to to_index in our arrays.
+	*/
+	__forceinline void copy(uint32_t to_index, const wavefront_rays& from, uint32_t index)
+	{
+		_origin_x[to_index]		= from._origin_x[index];
+		_origin_y[to_index]		= from._origin_y[index];
+		_origin_z[to_index]		= from._origin_z[index];
+		_direction_x[to_index]	= from._direction_x[index];
+		_direction_y[to_index]	= from._direction_y[index];
+		_direction_z[to_index]	= from._direction_z[index];
+		_color_r[to_index]		= from._color_r[index];
+		_color_g[to_index]		= from._color_g[index];
+		_color_b[to_index]		= from._color_b[index];
+		_radiance_r[to_index]	= from._radiance_r[index];
+		_radiance_g[to_index]	= from._radiance_g[index];
+		_radiance_b[to_index]	= from._radiance_b[index];
+		_pixel_index[to_index]	= from._pixel_index[index];
+		_sample[to_index]		= from._sample[index];
+		_bounce[to_index]		= from._bounce[index];
+	}
+};
+
+/*
+* the state of the wavefront pipeline : the paths of the image are traced by waves of a fixed size,
+* each stage running over every ray of the wave as parallel jobs before the next one starts.
+* the last job of a stage is the one starting the next stage.
+*/
+struct wavefront
+{
+	//the rays of the wave : the ones being traced, and the ones going on after shading
+	wavefront_rays			_rays[2];
+	//the buffer of the rays being traced
+	uint32_t				_current{ 0 };
+	//the closest hit of every ray being traced
+	MultipleScopedMemory<hit_record>	_hits;
+	//whether every ray being traced has hit something
+	MultipleScopedMemory<uint8_t>		_has_hit;
+	//the max number of paths in a wave
+	uint32_t				_capacity{ 0 };
+
+	//the number of paths of the image (a path for each sample of each pixel)
+	uint32_t				_path_nb{ 0 };
+	//the first path of the current wave
+	uint32_t				_first_path{ 0 };
+	//the number of paths of the current wave
+	uint32_t				_wave_path_nb{ 0 };
+	//the number of rays being traced
+	uint32_t				_ray_nb{ 0 };
+	//the number of rays going on, packed in the other buffer by the shade stage
+	std::atomic<uint32_t>	_next_ray_nb{ 0 };
+
+	//the stage currently running
+	wavefront_stage			_stage{ wavefront_stage::GENERATE };
+	//the number of jobs of the current stage that are not done yet
+	std::atomic<uint32_t>	_pending_job_nb{ 0 };
+	//changes every time the image is restarted, so that the jobs of an old image do nothing
+	render_epoch			_epoch;
+	//whether every path of the image was traced
+	std::atomic<bool>		_done{ false };
+
+	//the time spent in each stage for the current image, summed over every thread, in ns
+	std::atomic<uint64_t>	_stage_ns[static_cast<uint32_t>(wavefront_stage::NB)];
+
+	__forceinline wavefront()
+	{
+		reset(0);
+	}
+
+	/*
+	* allocates the buffers for waves of "capacity" paths.
+	*/
+	void alloc(uint32_t capacity);
+
+	/*
+	* frees the buffers.
+	*/
+	void clear();
+
+	/*
+	* gets ready to trace an image of path_nb paths, from the first wave.
+	*/
+	void reset(uint32_t path_nb);
+
+	/*
+	* moves on to the next wave, starting from its generate stage.
+	* returns false if every path of the image was already traced.
+	*/
+	bool next_wave();
+
+	/*
+	* gives out the number of bytes used by the buffers.
+	*/
+	__forceinline size_t byte_size()const
+	{
+		return static_cast<size_t>(_capacity) * (2 * wavefront_rays::ray_size + sizeof(hit_record) + sizeof(uint8_t));
+	}
+
+	__forceinline wavefront_rays& current_rays() { return _rays[_current]; }
+	__forceinline wavefront_rays& next_rays() { return _rays[_current ^ 1]; }
+};
+
+#endif //__RAYTRACE_CPU_WAVEFRONT_H__
@@ -0,0 +1,78 @@
+#ifndef __RAYTRACE_GPU_SAMPLING_H__
+#define __RAYTRACE_GPU_SAMPLING_H__
+
+/*
+* the glsl functions giving out the samples of the GPU raytracers, shared by every shader that needs random numbers.
+* it is the same Owen scrambled Sobol sequence as the CPU raytracer's (see sequence_sampler in Maths.h) :
+* every pixel has its own scrambling, and every pair of dimensions its own shuffling, so the samples of a pixel stay stratified.
+* it should be put right after the version and extensions of a shader's source.
+*
+* the code only uses the part of glsl that C++ also understands, and is written as the argument of GPU_SAMPLING_GLSL, which makes a string of it :
+* defining GPU_SAMPLING_GLSL before this file and the few glsl types it uses compiles it as C++ instead, to check it against the CPU sequence (see tests/GPUSamplingCheck.cpp).
+*/
+#ifndef GPU_SAMPLING_GLSL
+#define GPU_SAMPLING_GLSL(...) #__VA_ARGS__
+#endif
+
+inline const char* gpu_sampling_glsl()
+{
+	return GPU_SAMPLING_GLSL(
+			//the pcg hash (found from this https://www.reedbeta.com/blog/hash-functions-for-gpu-rendering/)
+			uint HashUint(uint x)
+			{
+				uint state = x * 747796405u + 2891336453u;
+				uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+				return (word >> 22u) ^ word;
+			}
+
+			//scrambles an integer so that each bit only depends on itself and the bits below it ("Practical Hash-based Owen Scrambling", Burley 2020)
+			uint LaineKarrasPermutation(uint x, uint seed)
+			{
+				x += seed;
+				x ^= x * 0x6c50b47cu;
+				x ^= x * 0xb82f1e52u;
+				x ^= x * 0xc7afe638u;
+				x ^= x * 0x8d22f6e6u;
+				return x;
+			}
+
+			//Owen scrambles a fixed point number in [0, 1), the first bit being the half
+			uint NestedUniformScramble(uint x, uint seed)
+			{
+				return bitfieldReverse(LaineKarrasPermutation(bitfieldReverse(x), seed));
+			}
+
+			//the index-th point of the first two dimensions of the Sobol sequence, as fixed point numbers
+			uvec2 Sobol2D(uint index)
+			{
+				//the first dimension is the van der corput sequence, taken before the loop shifts the index away
+				uint x = bitfieldReverse(index);
+				uint y = 0u;
+				for (uint v = 1u << 31u; index != 0u; index >>= 1u, v ^= v >> 1u)
+					if ((index & 1u) != 0u)
+						y ^= v;
+				return uvec2(x, y);
+			}
+
+			//the index-th sample of a pixel for the pair of dimensions dim_pair, between 0.0 and 1.0 (1.0 excluded)
+			vec2 SobolOwen2D(uint index, uint pixel_seed, uint dim_pair)
+			{
+				uint pairSeed	= HashUint(pixel_seed ^ HashUint(dim_pair));
+				uvec2 point		= Sobol2D(NestedUniformScramble(index, pairSeed));
+				point.x			= NestedUniformScramble(point.x, HashUint(pairSeed + 1u));
+				point.y			= NestedUniformScramble(point.y, HashUint(pairSeed + 2u));
+				return vec2(point >> 8u) * (1.0 / 16777216.0);
+			}
+
+			//a direction picked uniformly on the unit sphere from a 2D sample
+			vec3 UniformSphere(vec2 u)
+			{
+				float z		= 1.0 - 2.0 * u.x;
+				float r		= sqrt(max(0.0, 1.0 - z * z));
+				float phi	= 2.0 * 3.14159265 * u.y;
+				return vec3(r * cos(phi), r * sin(phi), z);
+			}
+	);
+}
+
+#endif //__RAYTRACE_GPU_SAMPLING_H__
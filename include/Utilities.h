@@ -11,8 +11,13 @@
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
 /**
 * A simple class representing an allocated RAM memory block.
 * You may ask, why not use the standard library, and things such as vector ?
@@ -172,6 +177,15 @@ void ExpandHeap(HeapMemory<T, scoped, single_data>& heap, uint32_t oldSize, uint
 		}
 	}
 }
+
+//exchanges the memory of two heaps, without copying nor freeing any of it
+template<typename T, bool scoped, bool single_data>
+void SwapHeap(HeapMemory<T, scoped, single_data>& lhs, HeapMemory<T, scoped, single_data>& rhs)
+{
+	T* tmp	= *lhs;
+	lhs		= *rhs;
+	rhs		= tmp;
+}
 	
 
 template<typename T>
@@ -351,9 +365,100 @@ using VolatileLoopArray = LoopArray<T, false>;
 template<typename T>
 using ScopedLoopArray = LoopArray<T, true>;
 
+/**
+* A simple class representing an array of data you would need to loop through, that is aligned in memory.
+* new[] does not guarantee any alignment over the one of the type before C++17, 
+* so this one is for data we want to start on a cache line or a SIMD register boundary.
+* As it uses raw allocation, T is expected to be a POD type (no constructor or destructor will be called).
+*/
+template<typename T, uint32_t alignment>
+class AlignedLoopArray
+{
+private:
+	T*			_raw_data{ nullptr };
+	uint32_t	_nb{ 0 };
+
+public:
+
+	/*===== Constructor =====*/
+
+	AlignedLoopArray() = default;
+	AlignedLoopArray(const AlignedLoopArray&) = delete;
+
+	AlignedLoopArray(uint32_t nb)
+	{
+		Alloc(nb);
+	}
+
+	~AlignedLoopArray()
+	{
+		Clear();
+	}
+
+	/*===== Accessor =====*/
+
+	__forceinline T& operator[](int32_t i)const
+	{
+		return _raw_data[i];
+	}
+
+	__forceinline T* operator*()const noexcept
+	{
+		return _raw_data;
+	}
+
+	__forceinline const uint32_t& Nb()const { return _nb; }
+
+	/*===== Assignement =====*/
+
+	AlignedLoopArray& operator=(const AlignedLoopArray&) = delete;
+
+	/*===== Memory Management =====*/
+
+	void Clear()
+	{
+		if (_raw_data)
+		{
+#ifdef _WIN32
+			_aligned_free(_raw_data);
+#else
+			free(_raw_data);
+#endif
+		}
+		_raw_data = nullptr;
+		_nb = 0;
+	}
+
+	void Alloc(uint32_t nb)
+	{
+		Clear();
+
+		if (nb == 0)
+			return;
+
+		//the allocated size needs to be a multiple of the alignment
+		size_t size = ((static_cast<size_t>(nb) * sizeof(T) + alignment - 1) / alignment) * alignment;
+#ifdef _WIN32
+		_raw_data = static_cast<T*>(_aligned_malloc(size, alignment));
+#else
+		void* data = nullptr;
+		if (posix_memalign(&data, alignment, size) != 0)
+			data = nullptr;
+		_raw_data = static_cast<T*>(data);
+#endif
+		_nb = _raw_data == nullptr ? 0 : nb;
+	}
+
+};
+
+//the size of a cache line on the platform we target, useful to align data that threads work with
+#define CACHE_LINE_SIZE 64
+
 /**
 * A simple class representing the familiar list container.
 * an uncontiguous memory container, linking node with pointer from one to the next.
+* the nodes of a list emptied with Clear(false) are kept aside for the next adds, so that a list filled and emptied over and over
+* only allocates until it holds the most nodes it ever held at once. the list only frees these on its own.
 */
 template<typename T>
 class List
@@ -387,13 +492,69 @@ private:
 	ListNode* toe{ nullptr };//last node
 
 	uint32_t	nb{ 0 };
+
+	//the nodes removed from the list, linked by their next pointer, waiting to be added again
+	ListNode* spare{ nullptr };
+
+	//keeps the node aside for the next adds, releasing its data
+	__forceinline void Recycle(ListNode* node)
+	{
+		node->data = T{};
+		node->prev = nullptr;
+		node->next = spare;
+		spare = node;
+	}
+
+	//frees the nodes kept aside
+	__forceinline void FreeSpare()
+	{
+		while (spare != nullptr)
+		{
+			ListNode* nextNode = spare->next;
+			delete spare;
+			spare = nextNode;
+		}
+	}
+
 public:
 
+	/*===== Constructor =====*/
+
+	List() = default;
+
+	//a copy shares the nodes of the list, but not the ones kept aside (each list frees its own)
+	List(const List& other) :
+		head{ other.head },
+		toe{ other.toe },
+		nb{ other.nb }
+	{
+	}
+
+	List& operator=(const List& other)
+	{
+		FreeSpare();
+		head	= other.head;
+		toe		= other.toe;
+		nb		= other.nb;
+
+		return *this;
+	}
+
+	//the nodes still in the list are the caller's to clear, as ever
+	~List()
+	{
+		FreeSpare();
+	}
+
 	/*===== Manipulation =====*/
 
 	__forceinline void Add(const T& data)
 	{
-		ListNode* newNode = new ListNode;
+		ListNode* newNode = spare;
+		if (newNode != nullptr)
+			spare = newNode->next;
+		else
+			newNode = new ListNode;
 		newNode->data = data;
 
 		Add(newNode);
@@ -401,65 +562,37 @@ public:
 
 	__forceinline void Add(ListNode* newNode)
 	{
+		newNode->prev = toe;
+		newNode->next = nullptr;
+
 		if (head == nullptr)
-		{
 			head = newNode;
-			toe = newNode;
-		}
-		else if (toe != nullptr)
-		{
+		else
 			toe->next = newNode;
-			newNode->prev = toe;
-			toe = newNode;
-		}
+		toe = newNode;
 		nb++;
 	}
 
+	//takes the node out of the list. if clearData, the node is freed, otherwise it is given back to the caller.
 	__forceinline void Remove(ListNode* node, bool clearData = true)
 	{
-		if (node == head)
-		{
-			if (node->next != nullptr)
-			{
-				head = node->next;
-				head->prev = nullptr;
-			}
-			else
-			{
-				head = nullptr;
-			}
-
-			if (clearData)
-				delete node;
-
-			nb--;
-			return;
-		}
-
-		ListNode* iNode = head;
-		for (uint32_t i = 0; i < nb; i++)
-		{
-			if (iNode == node)
-			{
-				if (iNode->prev != nullptr)
-				{
-					iNode->prev->next = iNode->next;
-				}
-				if (iNode->next != nullptr)
-				{
-					iNode->next->prev = iNode->prev;
-				}
-
-				if (clearData)
-					delete iNode;
-
-				break;
-			}
-
-			iNode++;
-		}
-
+		//the neighbours are linked together, the node being the first or the last one otherwise
+		if (node->prev != nullptr)
+			node->prev->next = node->next;
+		else
+			head = node->next;
+
+		if (node->next != nullptr)
+			node->next->prev = node->prev;
+		else
+			toe = node->prev;
+
+		node->prev = nullptr;
+		node->next = nullptr;
 		nb--;
+
+		if (clearData)
+			delete node;
 	}
 
 	/*===== Accessor =====*/
@@ -481,35 +614,40 @@ public:
 
 	/*===== Memory Management =====*/
 
-	__forceinline void Clear()
+	//empties the list. if shouldFree, every node is freed, otherwise they are kept for the next adds.
+	__forceinline void Clear(bool shouldFree = true)
 	{
-		if (toe == nullptr)
-			return;
-
 		//going from back
 		ListNode* iNode = toe;
-		do
+		while (iNode != nullptr)
 		{
 			//getting back next node to clear
 			ListNode* prevNode = iNode->prev;
-			//freeing current node
-			delete iNode;
+			//freeing current node, or keeping it aside
+			if (shouldFree)
+				delete iNode;
+			else
+				Recycle(iNode);
 			//make next node to clear current node
 			iNode = prevNode;
-		} while (iNode != nullptr);
+		}
 
 		head = nullptr;
 		toe = nullptr;
 		nb = 0;
+
+		if (shouldFree)
+			FreeSpare();
 	}
 };
 
+//the number of batches a queue has room for once it is first pushed to (rounded up to a power of two)
 #define QUEUE_NODE_CAPACITY 100
 
 /**
 * A simple class representing the familiar queue container.
 * This queue will work in FIFO (First-in First-Out).
-* As for memory it will not be contiguous, to avoid huge copy of memory.
+* As for memory, the batches are kept in a contiguous ring that doubles when full, the data itself never being copied.
 * This queue also expects that value will be pushed as batches (though one at a time will work too).
 */
 template<typename T>
@@ -537,20 +675,52 @@ public:
 
 		uint32_t offset{ 0 };
 		uint32_t nb{ 0 };
-
-		__forceinline T* GetCurrent()const
-		{
-			return &data[index];
-		}
 	};
 
 private:
 
-	List<QueueNode> nodes;
+	//the batches, as a ring starting at first
+	QueueNode*	nodes{ nullptr };
+	uint32_t	capacity{ 0 };
+	uint32_t	first{ 0 };
+	uint32_t	node_nb{ 0 };
+
 	uint32_t nb{ 0 };
 
+	//doubles the ring, the batches being moved to its start in order
+	__forceinline void Grow()
+	{
+		uint32_t newCapacity = capacity;
+		if (newCapacity == 0)
+		{
+			newCapacity = 1;
+			while (newCapacity < QUEUE_NODE_CAPACITY)
+				newCapacity *= 2;
+		}
+		else
+			newCapacity *= 2;
+
+		QueueNode* newNodes = new QueueNode[newCapacity];
+		for (uint32_t i = 0; i < node_nb; i++)
+			newNodes[i] = std::move(nodes[(first + i) & (capacity - 1)]);
+
+		delete[] nodes;
+		nodes		= newNodes;
+		capacity	= newCapacity;
+		first		= 0;
+	}
 
 public:
+
+	Queue() = default;
+	Queue(const Queue&) = delete;
+	Queue& operator=(const Queue&) = delete;
+
+	__forceinline ~Queue()
+	{
+		Clear();
+	}
+
 	/*===== Manipulation =====*/
 
 	//pushing a new data. as this is a copy, the data is considered to be allocated.
@@ -558,37 +728,28 @@ public:
 	template<typename PolyT>
 	__forceinline void Push(const PolyT& data)
 	{
-		//creating the node
-		QueueNode newNode{};
-		newNode.data = (T)(data);
-		newNode.nb = 1;
-
-		//pushing it into the list
-		nodes.Add(newNode);
-
-		nb++;
+		PushNode(QueueNode{ (T)(data), 0, 1 });
 	}
 
 	//pushing a new batch. the batch is considered to be allocated.
 	template<typename PolyT>
 	__forceinline void PushBatch(const PolyT& batch, uint32_t batchNb)
 	{
-		//creating the node
-		QueueNode newNode{};
-		newNode.data = (T)batch;
-		newNode.nb = batchNb;
-
-		//pushing it into the list
-		nodes.Add(newNode);
-
-		nb += batchNb;
+		PushNode(QueueNode{ (T)batch, 0, batchNb });
 	}
 
 	//pushing a new batch. the batch is considered to be allocated.
 	__forceinline void PushNode(const QueueNode& node)
 	{
-		//pushing the node into the list
-		nodes.Add(node);
+		//an empty batch would only stand in the way of the pops
+		if (node.nb == 0)
+			return;
+
+		if (node_nb == capacity)
+			Grow();
+
+		nodes[(first + node_nb) & (capacity - 1)] = node;
+		node_nb++;
 
 		nb += node.nb;
 	}
@@ -596,20 +757,8 @@ public:
 	//pops a single data. is nullptr if queue is empty.
 	__forceinline QueueNode Pop()
 	{
-		if (nb <= 0)
-			return QueueNode{};
-
-		QueueNode& headNode = nodes.GetHead()->data;
-		QueueNode data = headNode;
-		headNode.offset++;
-		data.nb = 1;
-
-		if (headNode.offset >= headNode.nb)
-			nodes.Remove(nodes.GetHead(), true);
-
-		nb--;
-
-		return data;
+		uint32_t wantedNb = 1;
+		return PopBatch(wantedNb);
 	}
 
 	//pops a batch. we cannot guarantee that you'll get all the requested data in the returned array, 
@@ -622,7 +771,7 @@ public:
 			return QueueNode{};
 		}
 
-		QueueNode& headNode = nodes.GetHead()->data;
+		QueueNode& headNode = nodes[first];
 		uint32_t remaining = headNode.nb;
 		if (remaining < wantedBatchNb)
 			wantedBatchNb = remaining;
@@ -632,8 +781,13 @@ public:
 		headNode.nb -= wantedBatchNb;
 		data.nb = wantedBatchNb;
 
+		//the batch is done, releasing its data
 		if (headNode.nb <= 0)
-			nodes.Remove(nodes.GetHead(), true);
+		{
+			headNode	= QueueNode{};
+			first		= (first + 1) & (capacity - 1);
+			node_nb--;
+		}
 
 		nb -= wantedBatchNb;
 
@@ -649,143 +803,964 @@ public:
 
 	/*===== Memory Management =====*/
 
+	//empties the queue. if shouldFree, the ring is freed, otherwise it is kept for the next pushes.
 	__forceinline void Clear(bool shouldFree = true)
 	{
-		//no need if already empty
-		if (nb <= 0)
-			return;
+		if (shouldFree)
+		{
+			delete[] nodes;
+			nodes		= nullptr;
+			capacity	= 0;
+		}
+		else
+		{
+			for (uint32_t i = 0; i < node_nb; i++)
+				nodes[(first + i) & (capacity - 1)] = QueueNode{};
+		}
 
-		nodes.Clear();
-		nb = 0;
+		first	= 0;
+		node_nb = 0;
+		nb		= 0;
 	}
 
 };
 
-class ThreadJob
-{
-public:
-    virtual ~ThreadJob(){}
-    
-	virtual void Execute() {};
-};
-
-class ThreadPool
+/**
+* A bounded queue that any number of threads can push to and pop from at once, without any lock.
+* Each cell has a sequence number telling whether it is free for the producers of this turn or holds a value for the consumers,
+* so that the threads only fight over moving the position they push or pop at, never over a cell.
+* The capacity is rounded up to a power of two : a push fails when the queue is full, and a pop when it is empty.
+*/
+template<typename T>
+class BoundedQueue
 {
 private:
-	std::mutex						jobs_mutex;
-	Queue<ThreadJob*>				jobs;
-	ScopedLoopArray<std::thread>	threads;
-	std::condition_variable_any		thread_wait;
+	struct Cell
+	{
+		std::atomic<size_t>	sequence;
+		T					data;
+	};
+
+	Cell*				cells{ nullptr };
+	size_t				mask{ 0 };
 
-	bool killThread{ false };
-	bool pause{ false };
+	//the producers and the consumers each move their own position, on their own cache line
+	uint8_t				padding0[CACHE_LINE_SIZE];
+	std::atomic<size_t>	push_pos{ 0 };
+	uint8_t				padding1[CACHE_LINE_SIZE];
+	std::atomic<size_t>	pop_pos{ 0 };
+	uint8_t				padding2[CACHE_LINE_SIZE];
 
 public:
 
-	__forceinline ~ThreadPool()
+	BoundedQueue() = default;
+	BoundedQueue(const BoundedQueue&) = delete;
+	BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+	__forceinline ~BoundedQueue()
 	{
 		Clear();
 	}
 
-	__forceinline void ThreadLoop()
+	/*===== Manipulation =====*/
+
+	//pushes a copy of the data. returns false if the queue is full (or not allocated).
+	__forceinline bool Push(const T& data)
 	{
-		ThreadJob* job = nullptr;
-		while (!killThread)
+		if (cells == nullptr)
+			return false;
+
+		Cell* cell;
+		size_t pos = push_pos.load(std::memory_order_relaxed);
+		while (true)
 		{
-			{
-				jobs_mutex.lock();
+			cell = &cells[pos & mask];
+			size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			intptr_t diff	= static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
 
-				thread_wait.wait(jobs_mutex, [this]() {return (jobs.GetNb() > 0 && !pause) || killThread; });
+			//the cell is free for this turn, we try to take it
+			if (diff == 0)
+			{
+				if (push_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			//the cell still holds the value of the previous turn : the queue is full
+			else if (diff < 0)
+				return false;
+			//another producer took it first
+			else
+				pos = push_pos.load(std::memory_order_relaxed);
+		}
 
-				if (killThread)
-				{
-					jobs_mutex.unlock();
-					return;
-				}
+		cell->data = data;
+		cell->sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
 
-				//gets the job
-				job = jobs.Pop().data;
+	//pops the oldest data. returns false if the queue is empty.
+	__forceinline bool Pop(T& data)
+	{
+		if (cells == nullptr)
+			return false;
 
-				//unlocks the mutex
-				jobs_mutex.unlock();
-			}
+		Cell* cell;
+		size_t pos = pop_pos.load(std::memory_order_relaxed);
+		while (true)
+		{
+			cell = &cells[pos & mask];
+			size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			intptr_t diff	= static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
 
-			if (job != nullptr)
+			//the cell holds a value for this turn, we try to take it
+			if (diff == 0)
 			{
-				job->Execute();
-				delete job;
+				if (pop_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
 			}
-
+			//the cell was not written yet : the queue is empty
+			else if (diff < 0)
+				return false;
+			//another consumer took it first
+			else
+				pos = pop_pos.load(std::memory_order_relaxed);
 		}
+
+		data = cell->data;
+		//the cell is free for the producers of the next turn
+		cell->sequence.store(pos + mask + 1, std::memory_order_release);
+		return true;
 	}
 
-	/*===== Manipulation =====*/
+	/*===== Accessor =====*/
 
-	template<typename Job>
-	__forceinline void Add(const Job& job)
+	//the number of data in the queue (only exact when no thread is pushing or popping)
+	__forceinline uint32_t GetNb()const
 	{
-		{
-			//locks the mutex to try to get a job
-			jobs_mutex.lock();
-
-			//add a new job to do
-			jobs.Push(new Job(job));
-
-			//unlocks the mutex
-			jobs_mutex.unlock();
-		}
-		thread_wait.notify_one();
+		size_t pushed	= push_pos.load();
+		size_t popped	= pop_pos.load();
+		return pushed > popped ? static_cast<uint32_t>(pushed - popped) : 0;
 	}
 
-	template<typename Job>
-	__forceinline void SilentAdd(const Job& job)
+	__forceinline uint32_t GetCapacity()const
 	{
-		{
-			//locks the mutex to try to get a job
-			jobs_mutex.lock();
-
-			//add a new job to do
-			jobs.Push(new Job(job));
-
-			//unlocks the mutex
-			jobs_mutex.unlock();
-		}
+		return cells != nullptr ? static_cast<uint32_t>(mask + 1) : 0;
 	}
 
-	__forceinline void ClearJobs()
+	/*===== Memory Management =====*/
+
+	//allocates an empty queue of at least "capacity" data. no thread may use the queue meanwhile.
+	__forceinline void Alloc(uint32_t capacity)
 	{
-		//locks the mutex 
-		jobs_mutex.lock();
+		Clear();
 
-		//clears all pending jobs
-		jobs.Clear();
+		size_t size = 1;
+		while (size < capacity)
+			size *= 2;
 
-		//unlocks the mutex
-		jobs_mutex.unlock();
+		cells = new Cell[size];
+		for (size_t i = 0; i < size; i++)
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+		mask = size - 1;
 	}
 
-	__forceinline void Pause()
+	//frees the queue. no thread may use the queue meanwhile.
+	__forceinline void Clear()
 	{
-		//locks the mutex 
-		jobs_mutex.lock();
-
-		//sets the flag
-		pause = true;
-
-		//unlocks the mutex
-		jobs_mutex.unlock();
+		delete[] cells;
+		cells	= nullptr;
+		mask	= 0;
+		push_pos.store(0);
+		pop_pos.store(0);
 	}
+};
 
-	__forceinline void Resume()
-	{
-		//locks the mutex 
-		jobs_mutex.lock();
+class TaskState;
 
-		//sets the flag
-		pause = false;
+class ThreadJob
+{
+public:
+	//when the job was added to the pool, to know how long it waited for a thread
+	std::chrono::high_resolution_clock::time_point queued_at;
+	//the next job of the pool's shared queue
+	ThreadJob* next_job{ nullptr };
+	//the cache of the pool the job's slot comes from, UINT32_MAX if it was allocated on its own
+	uint32_t slot_cache{ UINT32_MAX };
+	//the task the job is the work of, if any
+	TaskState* task{ nullptr };
 
-		//unlocks the mutex
-		jobs_mutex.unlock();
+    virtual ~ThreadJob(){}
+    
+	virtual void Execute() {};
+};
+
+#define THREAD_DEQUE_CAPACITY 1024
+//the size of the slots the pool copies the jobs in : enough for any raytracing job, the bigger ones being allocated on their own
+#define THREAD_JOB_SLOT_SIZE (10 * CACHE_LINE_SIZE)
+//the number of slots a cache allocates at once when it runs out of them
+#define THREAD_JOB_SLOT_BLOCK_NB 64
+
+//the memory a job is copied in, reused once it is done
+union JobSlot
+{
+	JobSlot*	next;
+	uint8_t		data[THREAD_JOB_SLOT_SIZE];
+};
+
+/**
+* The slots a thread copies the jobs it adds in.
+* Only its thread takes slots, but the jobs are done (and their slots given back) on any thread :
+* those go in a lock-free stack its thread takes all at once when it runs out of slots, so that the slots go round without any allocation.
+* The slots are allocated by blocks aligned on cache lines, and only freed with the cache.
+*/
+class JobSlotCache
+{
+private:
+	//the slots its thread can take
+	JobSlot*				free_slots{ nullptr };
+	//the slots given back by the other threads
+	std::atomic<JobSlot*>	returned_slots{ nullptr };
+	//the blocks allocated so far, each linked to the previous one by its first slot
+	JobSlot*				blocks{ nullptr };
+	uint8_t					padding[CACHE_LINE_SIZE];
+
+	__forceinline JobSlot* AllocBlock()
+	{
+		size_t size = sizeof(JobSlot) * THREAD_JOB_SLOT_BLOCK_NB;
+#ifdef _WIN32
+		return static_cast<JobSlot*>(_aligned_malloc(size, CACHE_LINE_SIZE));
+#else
+		void* data = nullptr;
+		if (posix_memalign(&data, CACHE_LINE_SIZE, size) != 0)
+			data = nullptr;
+		return static_cast<JobSlot*>(data);
+#endif
+	}
+
+	__forceinline void FreeBlock(JobSlot* block)
+	{
+#ifdef _WIN32
+		_aligned_free(block);
+#else
+		free(block);
+#endif
+	}
+
+public:
+
+	__forceinline ~JobSlotCache()
+	{
+		Clear();
+	}
+
+	/*===== Manipulation =====*/
+
+	//takes a free slot. only its thread may call this. is nullptr if no memory is left.
+	__forceinline JobSlot* Take()
+	{
+		//the ones given back since we last looked
+		if (free_slots == nullptr)
+			free_slots = returned_slots.exchange(nullptr, std::memory_order_acquire);
+
+		if (free_slots == nullptr)
+		{
+			JobSlot* block = AllocBlock();
+			if (block == nullptr)
+				return nullptr;
+
+			block[0].next = blocks;
+			blocks = block;
+			for (uint32_t i = 1; i < THREAD_JOB_SLOT_BLOCK_NB; i++)
+			{
+				block[i].next = free_slots;
+				free_slots = &block[i];
+			}
+		}
+
+		JobSlot* slot = free_slots;
+		free_slots = slot->next;
+		return slot;
+	}
+
+	//gives back a slot taken from this cache. only its thread may call this.
+	__forceinline void Give(JobSlot* slot)
+	{
+		slot->next = free_slots;
+		free_slots = slot;
+	}
+
+	//gives back a slot taken from this cache. any thread may call this.
+	__forceinline void Return(JobSlot* slot)
+	{
+		//only pushing, and taking them all at once, the stack cannot see a slot go and come back in between
+		JobSlot* head = returned_slots.load(std::memory_order_relaxed);
+		do
+		{
+			slot->next = head;
+		} while (!returned_slots.compare_exchange_weak(head, slot, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	/*===== Memory Management =====*/
+
+	//frees every block. no slot may be used anymore.
+	__forceinline void Clear()
+	{
+		while (blocks != nullptr)
+		{
+			JobSlot* previous = blocks[0].next;
+			FreeBlock(blocks);
+			blocks = previous;
+		}
+
+		free_slots = nullptr;
+		returned_slots.store(nullptr);
+	}
+};
+
+/**
+* The jobs of a single thread of the pool, as a fixed size ring.
+* Only its thread pushes and pops at its bottom, without any lock (the last jobs pushed come first, as they are the most likely to be in cache),
+* while the other threads steal at its top (the oldest jobs first).
+* a steal and the owner's pop only fight for the last job left.
+*/
+class JobDeque
+{
+private:
+	std::atomic<int64_t>	top{ 0 };
+	//keeps the thieves from writing the cache line the owner keeps on reading
+	uint8_t					padding[CACHE_LINE_SIZE];
+	std::atomic<int64_t>	bottom{ 0 };
+	std::atomic<ThreadJob*>	slots[THREAD_DEQUE_CAPACITY];
+
+public:
+	/*===== Manipulation =====*/
+
+	//pushes a job at the bottom. only the owner may call this. returns false if the deque is full.
+	__forceinline bool Push(ThreadJob* job)
+	{
+		int64_t b = bottom.load(std::memory_order_relaxed);
+		int64_t t = top.load(std::memory_order_acquire);
+		if (b - t >= THREAD_DEQUE_CAPACITY)
+			return false;
+
+		slots[b & (THREAD_DEQUE_CAPACITY - 1)].store(job, std::memory_order_relaxed);
+		//the job is written before a thief can see it
+		std::atomic_thread_fence(std::memory_order_release);
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	//pops the last job pushed. only the owner may call this. is nullptr if the deque is empty.
+	__forceinline ThreadJob* Pop()
+	{
+		int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+		bottom.store(b, std::memory_order_relaxed);
+		//the thieves see the job as taken before we look at what they took
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = top.load(std::memory_order_relaxed);
+
+		if (t > b)
+		{
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		ThreadJob* job = slots[b & (THREAD_DEQUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+
+		//the last job may be stolen at the same time, whoever moves the top first gets it
+		if (t == b)
+		{
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				job = nullptr;
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+
+		return job;
+	}
+
+	//steals the oldest job. any thread may call this. is nullptr if the deque is empty.
+	__forceinline ThreadJob* Steal()
+	{
+		while (true)
+		{
+			int64_t t = top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t b = bottom.load(std::memory_order_acquire);
+			if (t >= b)
+				return nullptr;
+
+			//the slot cannot be written again before the top moves past it
+			ThreadJob* job = slots[t & (THREAD_DEQUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+			if (top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				return job;
+
+			//another thread took it first, we try the next one
+		}
+	}
+};
+
+//a task waiting for another one to be done
+struct TaskEdge
+{
+	TaskState*	task;
+	TaskEdge*	next;
+};
+
+/**
+* The state of a task of a pool, shared by its handles.
+* A task gives its job to the pool once every task it depends on is done,
+* and is itself done once its job and every one of its children are, which may then start the tasks depending on it.
+*/
+class TaskState
+{
+public:
+	//the job to run, until it is given to the pool (nullptr for a group of tasks without any job of its own)
+	ThreadJob*				job{ nullptr };
+	//the task that is only done once this one is
+	TaskState*				parent{ nullptr };
+	//the tasks it still waits for, plus one until it is submitted
+	std::atomic<int32_t>	dependency_nb{ 1 };
+	//its job and its children that are not done yet
+	std::atomic<int32_t>	unfinished_nb{ 1 };
+	//the handles, plus one for the pool until the task is done
+	std::atomic<uint32_t>	ref_nb{ 2 };
+	std::atomic<bool>		done{ false };
+
+	//the tasks depending on this one, taken once it is done
+	std::mutex				continuations_mutex;
+	TaskEdge*				continuations{ nullptr };
+
+	__forceinline void Release()
+	{
+		if (ref_nb.fetch_sub(1) == 1)
+			delete this;
+	}
+};
+
+/**
+* A handle on a task of a pool, keeping its state alive.
+*/
+class TaskHandle
+{
+private:
+	TaskState* state{ nullptr };
+
+	friend class ThreadPool;
+
+	//takes a reference the caller already has
+	__forceinline explicit TaskHandle(TaskState* state_) : state{ state_ }
+	{
+	}
+
+public:
+
+	TaskHandle() = default;
+
+	__forceinline TaskHandle(const TaskHandle& other) : state{ other.state }
+	{
+		if (state != nullptr)
+			state->ref_nb.fetch_add(1);
+	}
+
+	__forceinline ~TaskHandle()
+	{
+		if (state != nullptr)
+			state->Release();
+	}
+
+	__forceinline TaskHandle& operator=(const TaskHandle& other)
+	{
+		if (other.state != nullptr)
+			other.state->ref_nb.fetch_add(1);
+		if (state != nullptr)
+			state->Release();
+		state = other.state;
+		return *this;
+	}
+
+	/*===== Accessor =====*/
+
+	__forceinline bool IsValid()const
+	{
+		return state != nullptr;
+	}
+
+	//whether the task's job and every one of its children are done (an empty handle is always done)
+	__forceinline bool IsDone()const
+	{
+		return state == nullptr || state->done.load();
+	}
+};
+
+/**
+* A pool of threads executing the jobs it is given.
+* Each thread has its own JobDeque : the jobs added by a job go in the deque of the thread running it,
+* the ones added by any other thread go in a shared queue, from which the threads take their share at once.
+* a thread without any job steals from the others, and sleeps once there is nothing left to steal :
+* adding a job only wakes a thread if one is sleeping, and a thread taking a job wakes the next one if there are more.
+* The jobs are copied in the slots of a JobSlotCache of the adding thread (the threads from outside the pool sharing one),
+* and the shared queue links them through the jobs themselves, so that adding a job does not allocate anything once the slots went round.
+* On top of that, jobs can be made tasks : a task only starts once the tasks it depends on are done, may have children it waits for,
+* and can be waited for, the waiting thread running the pool's jobs in the meantime.
+*/
+class ThreadPool
+{
+private:
+	//the jobs added from outside the pool, first to last
+	std::mutex						jobs_mutex;
+	ThreadJob*						shared_first{ nullptr };
+	ThreadJob*						shared_last{ nullptr };
+	//the number of jobs in the shared queue, to not lock it when it is empty
+	std::atomic<int32_t>			shared_nb{ 0 };
+	//the jobs of each thread
+	JobDeque*						deques{ nullptr };
+	//the slots of the jobs each thread adds, then the ones of the jobs added from outside the pool (used under jobs_mutex)
+	JobSlotCache*					slot_caches{ nullptr };
+	ScopedLoopArray<std::thread>	threads;
+
+	//the threads sleep on this once there is nothing to do
+	std::mutex						sleep_mutex;
+	std::condition_variable_any		thread_wait;
+	std::atomic<uint32_t>			sleeping{ 0 };
+
+	//the number of jobs waiting to be taken (it may be off by a few while jobs are moved)
+	std::atomic<int32_t>			queued{ 0 };
+	//the number of jobs waiting or executing : a job is only removed once it is done, so that one adding others is never seen idle
+	std::atomic<uint32_t>			pending{ 0 };
+	//the number of threads currently executing a job, or looking for one
+	std::atomic_uint32_t			working{ 0 };
+	//the threads waiting for a task sleep on this once there is nothing to help with
+	std::mutex						task_mutex;
+	std::condition_variable_any		task_wait;
+	std::atomic<uint32_t>			task_waiter_nb{ 0 };
+
+	//the time each thread spent executing jobs, in ns
+	std::atomic<uint64_t>*			busy_ns{ nullptr };
+	//the time each thread spent waiting for a job, in ns
+	std::atomic<uint64_t>*			idle_ns{ nullptr };
+	//when each thread started waiting for a job, in ns since the clock's epoch (0 while it executes one)
+	std::atomic<int64_t>*			idle_since_ns{ nullptr };
+	//the time the jobs each thread executed spent waiting in the queue before, in ns
+	std::atomic<uint64_t>*			queue_wait_ns{ nullptr };
+	//the number of jobs each thread executed
+	std::atomic<uint64_t>*			job_nb{ nullptr };
+
+	//the index of the calling thread in its pool
+	static __forceinline uint32_t& ThreadIndex()
+	{
+		static thread_local uint32_t thread_index = UINT32_MAX;
+		return thread_index;
+	}
+
+	//the pool the calling thread belongs to
+	static __forceinline ThreadPool*& ThreadOwner()
+	{
+		static thread_local ThreadPool* thread_owner = nullptr;
+		return thread_owner;
+	}
+
+	std::atomic<bool> killThread{ false };
+	std::atomic<bool> pause{ false };
+
+	//copies the job in a slot of the cache, or allocates it on its own if it does not fit
+	template<typename Job>
+	__forceinline ThreadJob* NewJob(const Job& job, uint32_t cache_index)
+	{
+		JobSlot* slot = nullptr;
+		if (sizeof(Job) <= THREAD_JOB_SLOT_SIZE && alignof(Job) <= CACHE_LINE_SIZE && slot_caches != nullptr)
+			slot = slot_caches[cache_index].Take();
+
+		ThreadJob* newJob	= slot != nullptr ? new (slot->data) Job(job) : new Job(job);
+		newJob->slot_cache	= slot != nullptr ? cache_index : UINT32_MAX;
+		newJob->queued_at	= std::chrono::high_resolution_clock::now();
+		return newJob;
+	}
+
+	//destroys the job, and gives its slot back to its cache
+	__forceinline void DeleteJob(ThreadJob* job)
+	{
+		uint32_t cacheIndex = job->slot_cache;
+		if (cacheIndex == UINT32_MAX)
+		{
+			delete job;
+			return;
+		}
+
+		job->~ThreadJob();
+		JobSlot* slot = reinterpret_cast<JobSlot*>(job);
+		if (ThreadOwner() == this && ThreadIndex() == cacheIndex)
+			slot_caches[cacheIndex].Give(slot);
+		else
+			slot_caches[cacheIndex].Return(slot);
+	}
+
+	//adds the job at the end of the shared queue. jobs_mutex is expected to be locked.
+	__forceinline void PushShared(ThreadJob* job)
+	{
+		job->next_job = nullptr;
+		if (shared_last != nullptr)
+			shared_last->next_job = job;
+		else
+			shared_first = job;
+		shared_last = job;
+		shared_nb.fetch_add(1);
+	}
+
+	//takes the first job of the shared queue. jobs_mutex is expected to be locked. is nullptr if the queue is empty.
+	__forceinline ThreadJob* PopShared()
+	{
+		ThreadJob* job = shared_first;
+		if (job == nullptr)
+			return nullptr;
+
+		shared_first = job->next_job;
+		if (shared_first == nullptr)
+			shared_last = nullptr;
+		shared_nb.fetch_sub(1);
+		return job;
+	}
+
+	//adds a job in the deque of the calling thread if it is one of ours, in the shared queue otherwise
+	template<typename Job>
+	__forceinline void Push(const Job& job)
+	{
+		pending.fetch_add(1);
+
+		if (ThreadOwner() == this)
+		{
+			ThreadJob* newJob = NewJob(job, ThreadIndex());
+			if (!deques[ThreadIndex()].Push(newJob))
+			{
+				jobs_mutex.lock();
+				PushShared(newJob);
+				jobs_mutex.unlock();
+			}
+		}
+		else
+		{
+			//the slots of the threads from outside the pool are shared as well
+			jobs_mutex.lock();
+			PushShared(NewJob(job, threads.Nb()));
+			jobs_mutex.unlock();
+		}
+
+		queued.fetch_add(1);
+	}
+
+	//wakes a sleeping thread, if any
+	__forceinline void WakeOne()
+	{
+		//a thread going to sleep counts itself before looking at the jobs one last time, so that we cannot miss it
+		if (sleeping.load() == 0)
+			return;
+
+		//it may not be waiting yet, we wait for it to be
+		sleep_mutex.lock();
+		sleep_mutex.unlock();
+		thread_wait.notify_one();
+	}
+
+	//takes a job from the shared queue, and moves a share of the others in the thread's deque
+	__forceinline ThreadJob* TakeShared(uint32_t thread_index)
+	{
+		if (shared_nb.load() <= 0)
+			return nullptr;
+
+		jobs_mutex.lock();
+
+		ThreadJob* job = PopShared();
+
+		//the others may steal it from us (a thread from outside the pool only takes the one)
+		uint32_t share = thread_index < threads.Nb() ? static_cast<uint32_t>(shared_nb.load()) / threads.Nb() : 0;
+		if (share > THREAD_DEQUE_CAPACITY / 2)
+			share = THREAD_DEQUE_CAPACITY / 2;
+		for (uint32_t i = 0; i < share; i++)
+		{
+			ThreadJob* sharedJob = PopShared();
+			if (!deques[thread_index].Push(sharedJob))
+			{
+				PushShared(sharedJob);
+				break;
+			}
+		}
+
+		jobs_mutex.unlock();
+
+		return job;
+	}
+
+	//finds a job for the thread : its own first, then the shared ones, then the other threads'. is nullptr if there are none or the pool is paused.
+	//(a thread from outside the pool gives UINT32_MAX)
+	__forceinline ThreadJob* FindJob(uint32_t thread_index)
+	{
+		//counted before looking at the pause, so that a pause either is seen, or waits for us
+		working.fetch_add(1);
+		if (pause.load())
+		{
+			working.fetch_sub(1);
+			return nullptr;
+		}
+
+		//a thread from outside the pool has no deque of its own
+		bool ownDeque	= thread_index < threads.Nb();
+		ThreadJob* job	= ownDeque ? deques[thread_index].Pop() : nullptr;
+		if (job == nullptr)
+			job = TakeShared(thread_index);
+		//the pool's threads look at the deques after their own, an outsider goes over them all from the first
+		uint32_t first = ownDeque ? thread_index + 1 : 0;
+		for (uint32_t i = 0; i < threads.Nb() - (ownDeque ? 1 : 0) && job == nullptr; i++)
+			job = deques[(first + i) % threads.Nb()].Steal();
+
+		if (job == nullptr)
+		{
+			working.fetch_sub(1);
+			return nullptr;
+		}
+
+		queued.fetch_sub(1);
+		return job;
+	}
+
+	//sleeps until there are jobs to take. returns false if the pool is being cleared.
+	__forceinline bool Sleep()
+	{
+		sleep_mutex.lock();
+
+		sleeping.fetch_add(1);
+		thread_wait.wait(sleep_mutex, [this]() {return (queued.load() > 0 && !pause.load()) || killThread.load(); });
+		sleeping.fetch_sub(1);
+
+		sleep_mutex.unlock();
+
+		return !killThread.load();
+	}
+
+	//deletes every job waiting to be taken (their tasks are done without them)
+	__forceinline void DeleteJobs()
+	{
+		//the tasks are only finished once the lock is released, as they may add the tasks depending on them
+		ThreadJob* deletedTasks = nullptr;
+
+		jobs_mutex.lock();
+		while (ThreadJob* job = PopShared())
+		{
+			if (job->task != nullptr)
+			{
+				job->next_job = deletedTasks;
+				deletedTasks = job;
+				continue;
+			}
+			DeleteJob(job);
+			queued.fetch_sub(1);
+			pending.fetch_sub(1);
+		}
+		jobs_mutex.unlock();
+
+		for (uint32_t i = 0; i < threads.Nb(); i++)
+		{
+			while (ThreadJob* job = deques[i].Steal())
+			{
+				if (job->task != nullptr)
+				{
+					job->next_job = deletedTasks;
+					deletedTasks = job;
+					continue;
+				}
+				DeleteJob(job);
+				queued.fetch_sub(1);
+				pending.fetch_sub(1);
+			}
+		}
+
+		while (deletedTasks != nullptr)
+		{
+			ThreadJob* job	= deletedTasks;
+			deletedTasks	= job->next_job;
+
+			TaskState* task = job->task;
+			DeleteJob(job);
+			FinishWork(task);
+			queued.fetch_sub(1);
+			pending.fetch_sub(1);
+		}
+	}
+
+	//copies the job for the calling thread, locking the shared slots if it is not one of ours
+	template<typename Job>
+	__forceinline ThreadJob* CopyJob(const Job& job)
+	{
+		if (ThreadOwner() == this)
+			return NewJob(job, ThreadIndex());
+
+		jobs_mutex.lock();
+		ThreadJob* newJob = NewJob(job, threads.Nb());
+		jobs_mutex.unlock();
+		return newJob;
+	}
+
+	//adds a job already copied, in the deque of the calling thread if it is one of ours, in the shared queue otherwise
+	__forceinline void PushJob(ThreadJob* job)
+	{
+		pending.fetch_add(1);
+
+		job->queued_at = std::chrono::high_resolution_clock::now();
+		if (ThreadOwner() != this || !deques[ThreadIndex()].Push(job))
+		{
+			jobs_mutex.lock();
+			PushShared(job);
+			jobs_mutex.unlock();
+		}
+
+		queued.fetch_add(1);
+		WakeOne();
+	}
+
+	//gives the task's job to the pool, now that every task it depends on is done
+	__forceinline void Schedule(TaskState* task)
+	{
+		ThreadJob* job = task->job;
+		task->job = nullptr;
+
+		if (job != nullptr)
+			PushJob(job);
+		else
+			FinishWork(task);
+	}
+
+	//tells that the job or a child of the task is done, which may make it done, then its parent
+	__forceinline void FinishWork(TaskState* task)
+	{
+		while (task != nullptr && task->unfinished_nb.fetch_sub(1) == 1)
+		{
+			//from now on, no task can depend on this one anymore
+			task->continuations_mutex.lock();
+			task->done.store(true);
+			TaskEdge* edge = task->continuations;
+			task->continuations = nullptr;
+			task->continuations_mutex.unlock();
+
+			while (edge != nullptr)
+			{
+				if (edge->task->dependency_nb.fetch_sub(1) == 1)
+					Schedule(edge->task);
+
+				TaskEdge* next = edge->next;
+				delete edge;
+				edge = next;
+			}
+
+			//a thread waiting for a task counts itself before looking at it one last time, so that we cannot miss it
+			if (task_waiter_nb.load() > 0)
+			{
+				task_mutex.lock();
+				task_mutex.unlock();
+				task_wait.notify_all();
+			}
+
+			TaskState* parent = task->parent;
+			task->Release();
+			task = parent;
+		}
+	}
+
+	//executes the job taken by the thread, then frees it (the thread is expected to count itself in working)
+	__forceinline void RunJob(ThreadJob* job, uint32_t thread_index)
+	{
+		if (thread_index < threads.Nb())
+			queue_wait_ns[thread_index].fetch_add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - job->queued_at).count()));
+
+		job->Execute();
+
+		//the tasks depending on this one are added before the job stops being pending, so that the pool is never seen idle in between
+		TaskState* task = job->task;
+		DeleteJob(job);
+		if (task != nullptr)
+			FinishWork(task);
+
+		if (thread_index < threads.Nb())
+			job_nb[thread_index].fetch_add(1);
+		pending.fetch_sub(1);
+		working.fetch_sub(1);
+	}
+
+public:
+
+	__forceinline ~ThreadPool()
+	{
+		Clear();
+	}
+
+	__forceinline void ThreadLoop(uint32_t thread_index)
+	{
+		ThreadIndex() = thread_index;
+		ThreadOwner() = this;
+
+		while (!killThread.load())
+		{
+			std::chrono::high_resolution_clock::time_point idleStart = std::chrono::high_resolution_clock::now();
+			idle_since_ns[thread_index].store(static_cast<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(idleStart.time_since_epoch()).count()));
+
+			//gets the job
+			ThreadJob* job = nullptr;
+			while ((job = FindJob(thread_index)) == nullptr)
+			{
+				if (!Sleep())
+					return;
+			}
+
+			//the jobs left may keep another thread busy
+			if (queued.load() > 0)
+				WakeOne();
+
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			idle_ns[thread_index].fetch_add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(start - idleStart).count()));
+			idle_since_ns[thread_index].store(0);
+
+			RunJob(job, thread_index);
+			busy_ns[thread_index].fetch_add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count()));
+		}
+	}
+
+	/*===== Manipulation =====*/
+
+	template<typename Job>
+	__forceinline void Add(const Job& job)
+	{
+		//add a new job to do
+		Push(job);
+
+		//let a sleeping thread know
+		WakeOne();
+	}
+
+	template<typename Job>
+	__forceinline void SilentAdd(const Job& job)
+	{
+		//add a new job to do, the threads only see it once they look for one
+		Push(job);
+	}
+
+	__forceinline void ClearJobs()
+	{
+		//clears all pending jobs
+		DeleteJobs();
+	}
+
+	__forceinline void Pause()
+	{
+		//sets the flag
+		pause.store(true);
+	}
+
+	__forceinline void Resume()
+	{
+		//locks the mutex, so that a thread going to sleep sees the flag or is waiting already
+		sleep_mutex.lock();
+
+		//sets the flag
+		pause.store(false);
+
+		//unlocks the mutex
+		sleep_mutex.unlock();
 
 		//notify to resume
 		thread_wait.notify_all();
@@ -793,11 +1768,120 @@ public:
 	}
 
 
+	//waits for the jobs currently executing to finish.
+	//this is expected to be called after Pause (and ClearJobs), otherwise threads may keep on taking new jobs.
+	__forceinline void WaitIdle()
+	{
+		while (working.load() > 0)
+			std::this_thread::yield();
+	}
+
+	/*===== Tasks =====*/
+
+	/*
+	* creates a task running a copy of the job, that only starts once submitted and once every task it depends on is done.
+	* if given, the parent is only done once this task is : it should not be done yet (the task may be created by the parent's job).
+	* every task created is expected to be submitted.
+	*/
+	template<typename Job>
+	__forceinline TaskHandle CreateTask(const Job& job, const TaskHandle& parent = TaskHandle{})
+	{
+		TaskHandle task = CreateGroup(parent);
+		task.state->job			= CopyJob(job);
+		task.state->job->task	= task.state;
+		return task;
+	}
+
+	/*
+	* creates a task without any job of its own, only done once every one of its children is : it is a counter for the tasks created with it as parent.
+	* it is expected to be submitted once its first children are created, so that it is not done before.
+	*/
+	__forceinline TaskHandle CreateGroup(const TaskHandle& parent = TaskHandle{})
+	{
+		TaskState* state = new TaskState();
+		if (parent.state != nullptr)
+		{
+			state->parent = parent.state;
+			parent.state->unfinished_nb.fetch_add(1);
+		}
+		return TaskHandle(state);
+	}
+
+	/*
+	* makes the task wait for "on" to be done before it starts. this should be called before the task is submitted.
+	*/
+	__forceinline void Depend(const TaskHandle& task, const TaskHandle& on)
+	{
+		if (on.state == nullptr)
+			return;
+
+		on.state->continuations_mutex.lock();
+		if (!on.state->done.load())
+		{
+			task.state->dependency_nb.fetch_add(1);
+			on.state->continuations = new TaskEdge{ task.state, on.state->continuations };
+		}
+		on.state->continuations_mutex.unlock();
+	}
+
+	/*
+	* lets the task start once every task it depends on is done (right away if there are none).
+	*/
+	__forceinline void Submit(const TaskHandle& task)
+	{
+		if (task.state->dependency_nb.fetch_sub(1) == 1)
+			Schedule(task.state);
+	}
+
+	/*
+	* waits for the task to be done, running the pool's jobs in the meantime, and sleeping when there are none to run.
+	* the pool is expected not to be paused, as the task could never be done.
+	*/
+	__forceinline void Wait(const TaskHandle& task)
+	{
+		uint32_t threadIndex = ThreadOwner() == this ? ThreadIndex() : UINT32_MAX;
+
+		while (!task.IsDone())
+		{
+			if (ThreadJob* job = FindJob(threadIndex))
+			{
+				RunJob(job, threadIndex);
+				continue;
+			}
+
+			//the jobs left are already running : we sleep until a task is done, looking for new ones to help with from time to time
+			task_mutex.lock();
+			task_waiter_nb.fetch_add(1);
+			task_wait.wait_for(task_mutex, std::chrono::milliseconds(1), [&task]() {return task.IsDone(); });
+			task_waiter_nb.fetch_sub(1);
+			task_mutex.unlock();
+		}
+	}
+
 	/*===== Accessor =====*/
 
 	__forceinline uint32_t GetJobsNb()const
 	{
-		return jobs.GetNb();
+		int32_t queuedNb = queued.load();
+		return queuedNb > 0 ? static_cast<uint32_t>(queuedNb) : 0;
+	}
+
+	//the number of jobs waiting or executing.
+	__forceinline uint32_t GetPendingNb()
+	{
+		return pending.load();
+	}
+
+	//whether there are no jobs waiting nor executing.
+	//(a job is only removed once done, and the ones it adds are counted before, so we cannot miss it in between)
+	__forceinline bool IsIdle()
+	{
+		return pending.load() == 0;
+	}
+
+	__forceinline bool IsPaused()const
+	{
+		return pause.load();
 	}
 
 	__forceinline uint32_t GetThreadsNb()const
@@ -805,28 +1889,87 @@ public:
 		return threads.Nb();
 	}
 
+	//the time the thread spent executing jobs since the last reset, in ns
+	__forceinline uint64_t GetThreadBusyTime(uint32_t thread_index)const
+	{
+		return busy_ns[thread_index].load();
+	}
+
+	__forceinline void ResetThreadBusyTimes()
+	{
+		for (uint32_t i = 0; i < threads.Nb(); i++)
+			busy_ns[i].store(0);
+	}
+
+	//the time the thread spent waiting for a job since it started, in ns
+	__forceinline uint64_t GetThreadIdleTime(uint32_t thread_index)const
+	{
+		uint64_t idle	= idle_ns[thread_index].load();
+		int64_t since	= idle_since_ns[thread_index].load();
+
+		//a thread still waiting has its wait so far counted as well
+		int64_t now = static_cast<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count());
+		if (since != 0 && now > since)
+			idle += static_cast<uint64_t>(now - since);
+		return idle;
+	}
+
+	//the time the jobs the thread executed waited in the queue since it started, in ns
+	__forceinline uint64_t GetThreadQueueWaitTime(uint32_t thread_index)const
+	{
+		return queue_wait_ns[thread_index].load();
+	}
+
+	//the number of jobs the thread executed since it started
+	__forceinline uint64_t GetThreadJobNb(uint32_t thread_index)const
+	{
+		return job_nb[thread_index].load();
+	}
+
+	//the index of the calling thread in its pool, or UINT32_MAX if it is not one of a pool's threads
+	static __forceinline uint32_t GetCurrentThreadIndex()
+	{
+		return ThreadIndex();
+	}
+
 	/*===== Memory Management =====*/
 
 	__forceinline void MakeThreads(uint32_t threadsNb)
 	{
-		killThread = false;
+		killThread.store(false);
 		threads.Alloc(threadsNb);
+		deques = new JobDeque[threadsNb];
+		slot_caches = new JobSlotCache[threadsNb + 1];
+
+		busy_ns			= new std::atomic<uint64_t>[threadsNb];
+		idle_ns			= new std::atomic<uint64_t>[threadsNb];
+		idle_since_ns	= new std::atomic<int64_t>[threadsNb];
+		queue_wait_ns	= new std::atomic<uint64_t>[threadsNb];
+		job_nb			= new std::atomic<uint64_t>[threadsNb];
+		for (uint32_t i = 0; i < threadsNb; i++)
+		{
+			busy_ns[i].store(0);
+			idle_ns[i].store(0);
+			idle_since_ns[i].store(0);
+			queue_wait_ns[i].store(0);
+			job_nb[i].store(0);
+		}
 
 		for (uint32_t i = 0; i < threads.Nb(); i++)
 		{
-			new (&threads[i]) std::thread(&ThreadPool::ThreadLoop, this);
+			new (&threads[i]) std::thread(&ThreadPool::ThreadLoop, this, i);
 		}
 	}
 
 	__forceinline void Clear()
 	{
 		{
-			jobs_mutex.lock();
+			sleep_mutex.lock();
 
 			//say we want them to stop
-			killThread = true;
+			killThread.store(true);
 
-			jobs_mutex.unlock();
+			sleep_mutex.unlock();
 		}
 
 		//let them know we want them to stop
@@ -837,9 +1980,28 @@ public:
 		{
 			threads[i].join();
 		}
-		//then clear
+		//then clear (the tasks done without their job may have added the ones depending on them)
+		do
+		{
+			DeleteJobs();
+		} while (queued.load() > 0);
 		threads.Clear();
-		jobs.Clear();
+
+		delete[] deques;
+		delete[] slot_caches;
+		deques			= nullptr;
+		slot_caches		= nullptr;
+
+		delete[] busy_ns;
+		delete[] idle_ns;
+		delete[] idle_since_ns;
+		delete[] queue_wait_ns;
+		delete[] job_nb;
+		busy_ns			= nullptr;
+		idle_ns			= nullptr;
+		idle_since_ns	= nullptr;
+		queue_wait_ns	= nullptr;
+		job_nb			= nullptr;
 	}
 };
 
@@ -33,6 +33,8 @@
 
 
 #include <cstdio>
+#include <cstring>
+#include <cstdlib>
 #include <time.h>
 
 //directly taken from imgui
@@ -192,8 +194,119 @@ void RefreshAppWideContext(const GraphicsAPIManager& GAPI, AppWideContext& AppCo
 
 }
 
-int main()
+static int PrintOfflineUsage()
 {
+	printf("usage : --offline [--width w] [--height h] [--spp n] [--depth n] [--seed n] [--scene spheres|cornell|model] [--model path.gltf] [--grid n] [--mode heap|tiles|wavefront] [--adaptive 0|1] [--threshold f] [--heatmap 0|1] [--light 0|1] [--sequence white|sobol|bluenoise] [--threads n] [--output path.png|path.hdr]\n");
+	return 1;
+}
+
+/*
+* renders a single image of the CPU raytracer's scene without creating any window or Graphics API resource,
+* writes it to disk and prints the timings (for benchmarking and regression comparisons).
+*/
+static int RenderOffline(int argc, char** argv)
+{
+	OfflineRenderParams params;
+
+	//reading the options, each of them followed by its value
+	for (int i = 2; i < argc; i += 2)
+	{
+		if (i + 1 >= argc)
+			return PrintOfflineUsage();
+
+		const char* option	= argv[i];
+		const char* value	= argv[i + 1];
+		if (strcmp(option, "--width") == 0)
+			params._width = static_cast<uint32_t>(atoi(value));
+		else if (strcmp(option, "--height") == 0)
+			params._height = static_cast<uint32_t>(atoi(value));
+		else if (strcmp(option, "--spp") == 0)
+			params._rtParams._pixel_sample_nb = static_cast<uint32_t>(atoi(value));
+		else if (strcmp(option, "--depth") == 0)
+			params._rtParams._max_depth = static_cast<uint32_t>(atoi(value));
+		else if (strcmp(option, "--seed") == 0)
+			params._seed = static_cast<uint32_t>(atoi(value));
+		else if (strcmp(option, "--grid") == 0)
+			params._random_sphere_grid = static_cast<uint32_t>(atoi(value));
+		else if (strcmp(option, "--threads") == 0)
+			params._thread_nb = static_cast<uint32_t>(atoi(value));
+		else if (strcmp(option, "--output") == 0)
+			params._output_path = value;
+		else if (strcmp(option, "--adaptive") == 0)
+			params._adaptive = atoi(value) != 0;
+		else if (strcmp(option, "--threshold") == 0)
+			params._noise_threshold = static_cast<float>(atof(value));
+		else if (strcmp(option, "--heatmap") == 0)
+			params._sample_heatmap = atoi(value) != 0;
+		else if (strcmp(option, "--light") == 0)
+			params._light_sampling = atoi(value) != 0;
+		else if (strcmp(option, "--model") == 0)
+			params._model_path = value;
+		else if (strcmp(option, "--scene") == 0)
+		{
+			if (strcmp(value, "spheres") == 0)
+				params._scene_type = CPUSceneType::RANDOM_SPHERES;
+			else if (strcmp(value, "cornell") == 0)
+				params._scene_type = CPUSceneType::CORNELL_BOX;
+			else if (strcmp(value, "model") == 0)
+				params._scene_type = CPUSceneType::MODEL;
+			else
+				return PrintOfflineUsage();
+		}
+		else if (strcmp(option, "--sequence") == 0)
+		{
+			if (strcmp(value, "white") == 0)
+				params._sample_sequence = sample_sequence::WHITE_NOISE;
+			else if (strcmp(value, "sobol") == 0)
+				params._sample_sequence = sample_sequence::SOBOL;
+			else if (strcmp(value, "bluenoise") == 0)
+				params._sample_sequence = sample_sequence::BLUE_NOISE;
+			else
+				return PrintOfflineUsage();
+		}
+		else if (strcmp(option, "--mode") == 0)
+		{
+			if (strcmp(value, "heap") == 0)
+				params._render_mode = CPURenderMode::RAY_HEAP;
+			else if (strcmp(value, "tiles") == 0)
+				params._render_mode = CPURenderMode::TILES;
+			else if (strcmp(value, "wavefront") == 0)
+				params._render_mode = CPURenderMode::WAVEFRONT;
+			else
+				return PrintOfflineUsage();
+		}
+		else
+			return PrintOfflineUsage();
+	}
+
+	if (params._width == 0 || params._height == 0 || params._rtParams._pixel_sample_nb == 0 || params._random_sphere_grid > MAX_CPU_RANDOM_SPHERE_GRID)
+		return PrintOfflineUsage();
+
+	//this is so that destructor are called before the end of the program
+	int result = 0;
+	{
+		AppWideContext AppContext;
+		uint32_t threadNb = params._thread_nb > 0 ? params._thread_nb : std::thread::hardware_concurrency();
+		AppContext.threadPool.MakeThreads(threadNb > 0 ? threadNb : 1);
+
+		//same camera as the one the window starts with
+		AppContext.view_mat = translate(AppContext.camera_pos) * extrinsic_rot(AppContext.camera_rot.x, -AppContext.camera_rot.y, 0.0f);
+
+		RaytraceCPU raytracer;
+		result = raytracer.RenderOffline(AppContext, params) ? 0 : 1;
+
+		AppContext.threadPool.Clear();
+	}
+
+	return result;
+}
+
+int main(int argc, char** argv)
+{
+	//the offline render needs neither the window nor the Graphics API
+	if (argc > 1 && strcmp(argv[1], "--offline") == 0)
+		return RenderOffline(argc, argv);
+
 	//set error callback and init window manager lib
 	glfwSetErrorCallback(glfw_error_callback);
 	if (!glfwInit())
@@ -14,6 +14,12 @@
 //include serialization
 #include "SerializationHelper.h"
 
+//for benchmark timing
+#include <chrono>
+
+//to write the offline renders
+#include "stb_image_write.h"
+
 /*===== Import =====*/
 
 void RaytraceCPU::Import(const rapidjson::Value& AppSettings)
@@ -27,6 +33,60 @@ void RaytraceCPU::Import(const rapidjson::Value& AppSettings)
 		{
 
 			SerializationHelper::LoadRaytracingParams("Raytracing Params", SceneObject, _rtParams);
+
+			//what the scene is made of
+			if (SceneObject.HasMember("Scene Type") && SceneObject["Scene Type"].GetUint() < static_cast<uint32_t>(CPUSceneType::NB))
+				_scene_type = static_cast<CPUSceneType>(SceneObject["Scene Type"].GetUint());
+
+			//the size of the random sphere field, bounded as in the UI
+			if (SceneObject.HasMember("Random Sphere Grid"))
+			{
+				uint32_t grid		= SceneObject["Random Sphere Grid"].GetUint();
+				_random_sphere_grid = grid < MAX_CPU_RANDOM_SPHERE_GRID ? grid : MAX_CPU_RANDOM_SPHERE_GRID;
+			}
+
+			//the seed of the render
+			if (SceneObject.HasMember("Render Seed"))
+				_render_seed = SceneObject["Render Seed"].GetUint();
+			if (SceneObject.HasMember("Sample Sequence") && SceneObject["Sample Sequence"].GetUint() < static_cast<uint32_t>(sample_sequence::NB))
+				_sample_sequence = static_cast<sample_sequence>(SceneObject["Sample Sequence"].GetUint());
+
+			//the light sampled by the diffuse hits
+			SerializationHelper::LoadLight("Light", SceneObject, _light);
+			if (SceneObject.HasMember("Light Sampling"))
+				_light_sampling = SceneObject["Light Sampling"].GetBool();
+
+			//the scheduling of the jobs
+			if (SceneObject.HasMember("Frame Budget"))
+				_frame_budget = SceneObject["Frame Budget"].GetBool();
+			if (SceneObject.HasMember("Target Frame Time"))
+				_target_frame_time = SceneObject["Target Frame Time"].GetFloat();
+			if (SceneObject.HasMember("Dynamic Resolution"))
+				_dynamic_resolution = SceneObject["Dynamic Resolution"].GetBool();
+
+			//the format the image is sent to the GPU in (only changed when the window is resized)
+			if (SceneObject.HasMember("Display Format") && SceneObject["Display Format"].GetUint() < static_cast<uint32_t>(display_format::NB))
+				_Display._format = static_cast<display_format>(SceneObject["Display Format"].GetUint());
+
+			//the progressive image
+			if (SceneObject.HasMember("Progressive"))
+				_progressive = SceneObject["Progressive"].GetBool();
+			if (SceneObject.HasMember("Progressive Target Samples"))
+				_progressive_target_spp = SceneObject["Progressive Target Samples"].GetUint();
+			if (SceneObject.HasMember("Progressive Noise Threshold"))
+				_progressive_noise_threshold = SceneObject["Progressive Noise Threshold"].GetFloat();
+			if (SceneObject.HasMember("Reprojection"))
+				_reprojection = SceneObject["Reprojection"].GetBool();
+
+			//the adaptive sampling
+			if (SceneObject.HasMember("Adaptive Sampling"))
+				_adaptive = SceneObject["Adaptive Sampling"].GetBool();
+			if (SceneObject.HasMember("Adaptive Min Samples"))
+				_adaptive_min_spp = SceneObject["Adaptive Min Samples"].GetUint();
+
+			//how the work is distributed
+			if (SceneObject.HasMember("Render Mode") && SceneObject["Render Mode"].GetUint() < static_cast<uint32_t>(CPURenderMode::NB))
+				_render_mode = static_cast<CPURenderMode>(SceneObject["Render Mode"].GetUint());
 			return;
 		}
 
@@ -46,6 +106,41 @@ void RaytraceCPU::Export(rapidjson::Value& AppSettings, rapidjson::MemoryPoolAll
 		//copy our transform
 		SerializationHelper::SerializRaytracingParams("Raytracing Params", SceneObject, _rtParams, Allocator);
 
+		//copy what the scene is made of
+		SceneObject.AddMember("Scene Type", static_cast<uint32_t>(_scene_type), Allocator);
+
+		//copy the size of the random sphere field
+		SceneObject.AddMember("Random Sphere Grid", _random_sphere_grid, Allocator);
+
+		//copy the seed of the render
+		SceneObject.AddMember("Render Seed", _render_seed, Allocator);
+		SceneObject.AddMember("Sample Sequence", static_cast<uint32_t>(_sample_sequence), Allocator);
+
+		//copy the light sampled by the diffuse hits
+		SerializationHelper::SerializeLight("Light", SceneObject, _light, Allocator);
+		SceneObject.AddMember("Light Sampling", _light_sampling, Allocator);
+
+		//copy the scheduling of the jobs
+		SceneObject.AddMember("Frame Budget", _frame_budget, Allocator);
+		SceneObject.AddMember("Target Frame Time", _target_frame_time, Allocator);
+		SceneObject.AddMember("Dynamic Resolution", _dynamic_resolution, Allocator);
+
+		//copy the format the image is sent to the GPU in
+		SceneObject.AddMember("Display Format", static_cast<uint32_t>(_Display._format), Allocator);
+
+		//copy the progressive image parameters
+		SceneObject.AddMember("Progressive", _progressive, Allocator);
+		SceneObject.AddMember("Progressive Target Samples", _progressive_target_spp, Allocator);
+		SceneObject.AddMember("Progressive Noise Threshold", _progressive_noise_threshold, Allocator);
+		SceneObject.AddMember("Reprojection", _reprojection, Allocator);
+
+		//copy the adaptive sampling parameters
+		SceneObject.AddMember("Adaptive Sampling", _adaptive, Allocator);
+		SceneObject.AddMember("Adaptive Min Samples", _adaptive_min_spp, Allocator);
+
+		//copy how the work is distributed
+		SceneObject.AddMember("Render Mode", static_cast<uint32_t>(_render_mode), Allocator);
+
 	}
 
 	AppSettings.AddMember(rapidjson::StringRef(Name()), SceneObject, Allocator);
@@ -289,27 +384,42 @@ void RaytraceCPU::PrepareVulkanProps(GraphicsAPIManager& GAPI, VkShaderModule& V
 
 
 
-void RaytraceCPU::Prepare(GraphicsAPIManager& GAPI)
+void RaytraceCPU::GenerateScene(ThreadPool* Pool)
 {
-	//the shaders needed
-	VkShaderModule VertexShader, FragmentShader;
+	switch (_scene_type)
+	{
+		case CPUSceneType::CORNELL_BOX:
+			GenerateCornellBox(Pool);
+			break;
+		case CPUSceneType::MODEL:
+			GenerateModel(Pool);
+			break;
+		default:
+			GenerateRandomSpheres();
+			break;
+	}
 
-	//compile the shaders here...
-	PrepareVulkanScripts(GAPI, VertexShader, FragmentShader);
-	//then create the pipeline
-	PrepareVulkanProps(GAPI, VertexShader, FragmentShader);
+	//the scene changed, so does its acceleration structure
+	RebuildSceneBVH(Pool);
+}
+
+void RaytraceCPU::GenerateRandomSpheres()
+{
+	//the random spheres are on a grid around the examples
+	int32_t gridExtent		= static_cast<int32_t>(_random_sphere_grid);
+	uint32_t randomSphereNb = (2 * _random_sphere_grid + 1) * (2 * _random_sphere_grid + 1);
 
 	//Allocate for teh materil of a random scene (we are overallocating here as dieletrics will always have the same material)
-	_Materials.Alloc(29);
-	ZERO_SET(_Materials, 29 * sizeof(material*));
+	_Materials.Alloc(4 + randomSphereNb);
+	ZERO_SET(_Materials, _Materials.Nb() * sizeof(material*));
 	_Materials[0] = new diffuse( vec4{ 0.5f,0.5f,0.5f, 1.0f} );//the ground material
 	_Materials[1] = new diffuse( vec4{ 0.4f, 0.2f, 0.1f, 1.0f });//a lambertian diffuse example
     _Materials[2] = new dieletrics( vec4{ 1.0f,1.0f,1.0f,1.0f }, 1.50f);//a dieletric example (this is a glass sphere)
 	_Materials[3] = new metal( vec4{ 0.7f, 0.6f, 0.5f, 1.0f });//a metal example
 
 	//Allocate for a random scene (all the space allocated will be used)
-	_Scene.Alloc(29);
-	ZERO_SET(_Scene, 29 * sizeof(hittable*));
+	_Scene.Alloc(4 + randomSphereNb);
+	ZERO_SET(_Scene, _Scene.Nb() * sizeof(hittable*));
 	_Scene[0] = new sphere(vec3{ 0.0f, -1000.0f, 0.0f }, 1000.0f, _Materials[0]);//the ground
 	_Scene[1] = new sphere(vec3{ 0.0f, 5.0f, 0.0f }, 5.0f, _Materials[1]);//a lambertian diffuse example
 	_Scene[2] = new sphere(vec3{ -10.0f, 5.0f, 0.0f }, 5.0f, _Materials[2]);//a dieletric example (this is a glass sphere)
@@ -320,9 +430,9 @@ void RaytraceCPU::Prepare(GraphicsAPIManager& GAPI)
 	//we already have example sphere, so further objects will be created after
 	uint32_t sphereNb = 4;
 	//we create sphere at random place with random materials for the demo
-	for (int32_t x = -2; x <= 2; x++)
+	for (int32_t x = -gridExtent; x <= gridExtent; x++)
 	{
-		for (int32_t z = -2; z <= 2; z++)
+		for (int32_t z = -gridExtent; z <= gridExtent; z++)
 		{
 			float choose_mat = randf();
 			vec3 sphereCenter = vec3{(static_cast<float>(x)+ randf(-1.0f,1.0f)) * 10.0f, 1.5f, (static_cast<float>(z) + randf(-1.0f,1.0f)) * 10.0f };
@@ -343,6 +453,223 @@ void RaytraceCPU::Prepare(GraphicsAPIManager& GAPI)
 			}
 		}
 	}
+}
+
+void RaytraceCPU::GenerateCornellBox(ThreadPool* Pool)
+{
+	//the box brings its own materials
+	_Materials.Alloc(0);
+
+	triangle_mesh* box = new triangle_mesh();
+	create_cornell_box_mesh(CPU_CORNELL_BOX_SCALE, *box);
+	box->build(Pool);
+
+	_Scene.Alloc(1);
+	_Scene[0] = box;
+}
+
+void RaytraceCPU::GenerateModel(ThreadPool* Pool)
+{
+	_Materials.Alloc(1);
+	_Materials[0] = new diffuse(vec4{ 0.5f,0.5f,0.5f, 1.0f });//the ground material
+
+	//the model stands on the ground, at the center of the scene
+	triangle_mesh* model = new triangle_mesh();
+	if (!load_gltf_mesh(_model_path, *model))
+	{
+		delete model;
+
+		//only the ground is left to trace
+		_Scene.Alloc(1);
+		_Scene[0] = new sphere(vec3{ 0.0f, -1000.0f, 0.0f }, 1000.0f, _Materials[0]);
+		return;
+	}
+	model->fit(vec3{ 0.0f, 0.0f, 0.0f }, CPU_MODEL_HEIGHT);
+	model->build(Pool);
+
+	_Scene.Alloc(2);
+	_Scene[0] = new sphere(vec3{ 0.0f, -1000.0f, 0.0f }, 1000.0f, _Materials[0]);//the ground
+	_Scene[1] = model;
+}
+
+void RaytraceCPU::RebuildSceneBVH(ThreadPool* Pool)
+{
+	//the bvh only needs the bounds of our objects
+	MultipleScopedMemory<aabb> sceneBounds(_Scene.Nb());
+	for (uint32_t i = 0; i < _Scene.Nb(); i++)
+		sceneBounds[i] = _Scene[i]->bounds();
+
+	_SceneBVH.build(*sceneBounds, _Scene.Nb(), Pool);
+
+	//copying the spheres in the order of the leaves, so that the kernels can go through a leaf without indirection
+	_SceneSpheres.alloc(_SceneBVH._prim_nb);
+	for (uint32_t i = 0; i < _SceneBVH._prim_nb; i++)
+	{
+		const sphere* leafSphere = dynamic_cast<const sphere*>(_Scene[_SceneBVH._prim_indices[i]]);
+
+		//the kernels only know about spheres, the other objects go through their virtual hit
+		if (leafSphere == nullptr)
+		{
+			_SceneSpheres.clear();
+			return;
+		}
+
+		//the material id is the index of the material in our material array
+		uint32_t materialId = 0;
+		while (materialId < _Materials.Nb() && _Materials[materialId] != leafSphere->_material)
+			materialId++;
+
+		//a sphere without one of our materials cannot be shaded from its id
+		if (materialId == _Materials.Nb())
+		{
+			_SceneSpheres.clear();
+			return;
+		}
+
+		_SceneSpheres.set(i, leafSphere->_center, leafSphere->_radius, materialId);
+	}
+}
+
+void RaytraceCPU::ClearScene()
+{
+	for (uint32_t i = 0; i < _Scene.Nb(); i++)
+	{
+		if (_Scene[i] != nullptr)
+			delete _Scene[i];
+	}
+	_Scene.Clear();
+
+	for (uint32_t i = 0; i < _Materials.Nb(); i++)
+	{
+		if (_Materials[i] != nullptr)
+			delete _Materials[i];
+	}
+	_Materials.Clear();
+
+	_SceneBVH.clear();
+	_SceneSpheres.clear();
+}
+
+//runs the intersection of every ray, giving out the time it took in nanoseconds per ray
+template<typename RayHit>
+static float TimeSphereBenchmark(const ray* rays, uint32_t ray_nb, RayHit& ray_hit, uint32_t& hit_nb)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	hit_nb = 0;
+	for (uint32_t i = 0; i < ray_nb; i++)
+		hit_nb += ray_hit(rays[i]) ? 1 : 0;
+
+	return std::chrono::duration<float, std::nano>(std::chrono::high_resolution_clock::now() - start).count() / static_cast<float>(ray_nb);
+}
+
+void RaytraceCPU::BenchmarkSphereKernels()
+{
+	for (uint32_t i = 0; i < 1 + static_cast<uint32_t>(simd_level::NB); i++)
+	{
+		_sphere_benchmark[i][0] = _sphere_benchmark[i][1] = -1.0f;
+		_sphere_benchmark_hits[i][0] = _sphere_benchmark_hits[i][1] = 0;
+	}
+
+	if (_SceneBVH._node_nb == 0)
+		return;
+
+	//random rays starting above the sphere field, the same for every run
+	float fieldExtent = static_cast<float>(_random_sphere_grid + 1) * 10.0f;
+	pcg32 benchmarkSampler;
+	MultipleScopedMemory<ray> rays(SPHERE_BENCHMARK_RAY_NB);
+	for (uint32_t i = 0; i < SPHERE_BENCHMARK_RAY_NB; i++)
+	{
+		rays[i].origin		= vec3{ benchmarkSampler.next_float(-fieldExtent, fieldExtent), benchmarkSampler.next_float(1.0f, 20.0f), benchmarkSampler.next_float(-fieldExtent, fieldExtent) };
+		rays[i].direction	= normalize(vec3{ benchmarkSampler.next_float(-1.0f, 1.0f), benchmarkSampler.next_float(-1.0f, 1.0f), benchmarkSampler.next_float(-1.0f, 1.0f) });
+	}
+
+	/* Virtual hit, what the jobs use when the kernels are disabled */
+
+	auto virtualAll = [this](const ray& incoming)
+	{
+		bool has_hit = false;
+		float closest = FLT_MAX;
+		for (uint32_t j = 0; j < _Scene.Nb(); j++)
+		{
+			hit_record jHit{};
+			if (_Scene[j]->hit(incoming, jHit) && jHit.distance < closest)
+			{
+				closest = jHit.distance;
+				has_hit = true;
+			}
+		}
+		return has_hit;
+	};
+	_sphere_benchmark[0][0] = TimeSphereBenchmark(*rays, SPHERE_BENCHMARK_RAY_NB, virtualAll, _sphere_benchmark_hits[0][0]);
+
+	auto virtualBVH = [this](const ray& incoming)
+	{
+		float closestDistance = FLT_MAX;
+		auto leaf_hit = [this, &incoming](uint32_t first, uint32_t nb, float& closest)
+		{
+			bool leaf_has_hit = false;
+			for (uint32_t j = first; j < first + nb; j++)
+			{
+				hit_record jHit{};
+				if (_Scene[_SceneBVH._prim_indices[j]]->hit(incoming, jHit) && jHit.distance < closest)
+				{
+					closest = jHit.distance;
+					leaf_has_hit = true;
+				}
+			}
+			return leaf_has_hit;
+		};
+		return _SceneBVH.closest_hit(incoming, closestDistance, leaf_hit);
+	};
+	_sphere_benchmark[0][1] = TimeSphereBenchmark(*rays, SPHERE_BENCHMARK_RAY_NB, virtualBVH, _sphere_benchmark_hits[0][1]);
+
+	/* Sphere kernels, for each instruction set the CPU supports */
+
+	if (_SceneSpheres._nb != _SceneBVH._prim_nb)
+		return;
+
+	simd_level supported = detect_simd_level();
+	for (uint32_t level = 0; level <= static_cast<uint32_t>(supported); level++)
+	{
+		sphere_soa::hit_kernel kernel = sphere_soa::get_kernel(static_cast<simd_level>(level));
+		if (kernel == nullptr)
+			continue;
+
+		auto kernelAll = [this, kernel](const ray& incoming)
+		{
+			float closest = FLT_MAX;
+			uint32_t index = 0;
+			return kernel(_SceneSpheres, incoming, 0, _SceneSpheres._nb, closest, index);
+		};
+		_sphere_benchmark[1 + level][0] = TimeSphereBenchmark(*rays, SPHERE_BENCHMARK_RAY_NB, kernelAll, _sphere_benchmark_hits[1 + level][0]);
+
+		auto kernelBVH = [this, kernel](const ray& incoming)
+		{
+			float closestDistance = FLT_MAX;
+			uint32_t index = 0;
+			auto leaf_hit = [this, kernel, &incoming, &index](uint32_t first, uint32_t nb, float& closest)
+			{
+				return kernel(_SceneSpheres, incoming, first, nb, closest, index);
+			};
+			return _SceneBVH.closest_hit(incoming, closestDistance, leaf_hit);
+		};
+		_sphere_benchmark[1 + level][1] = TimeSphereBenchmark(*rays, SPHERE_BENCHMARK_RAY_NB, kernelBVH, _sphere_benchmark_hits[1 + level][1]);
+	}
+}
+
+void RaytraceCPU::Prepare(GraphicsAPIManager& GAPI)
+{
+	//the shaders needed
+	VkShaderModule VertexShader, FragmentShader;
+
+	//compile the shaders here...
+	PrepareVulkanScripts(GAPI, VertexShader, FragmentShader);
+	//then create the pipeline
+	PrepareVulkanProps(GAPI, VertexShader, FragmentShader);
+
+	//creates our objects and the acceleration structure to go through them
+	GenerateScene();
 
 	enabled = true;
 }
@@ -350,23 +677,36 @@ void RaytraceCPU::Prepare(GraphicsAPIManager& GAPI)
 
 /*==== Resize =====*/
 
+//the format of the GPU images for the display format : the sRGB one gives back the linear values when sampled
+static VkFormat DisplayVkFormat(display_format format)
+{
+	return format == display_format::RGBA8 ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R16G16B16A16_SFLOAT;
+}
+
 void RaytraceCPU::ResizeVulkanResource(GraphicsAPIManager& GAPI, int32_t width, int32_t height, int32_t old_nb_frames)
 {
 	VkResult result = VK_SUCCESS;
 
 	/*===== CLEAR RESOURCES ======*/
 
+	//the jobs writing the staging memory should be done with it before it is unmapped
+	_Display.reset(nullptr, 0, 0, 0, GAPI._nb_vk_frames);
+	if (_ImageCopyMemory != VK_NULL_HANDLE)
+		vkUnmapMemory(GAPI._VulkanDevice, _ImageCopyMemory);
+
 	//clear the fullscreen images buffer
-	VK_CLEAR_ARRAY(_ImageCopyBuffer, old_nb_frames, vkDestroyBuffer, GAPI._VulkanDevice);
+	VK_CLEAR_ARRAY(_ImageCopyBuffer, CPU_DISPLAY_BUFFER_NB, vkDestroyBuffer, GAPI._VulkanDevice);
 	VK_CLEAR_ARRAY(_GPULocalImageViews, old_nb_frames, vkDestroyImageView, GAPI._VulkanDevice);
 	VK_CLEAR_ARRAY(_GPULocalImageBuffers, old_nb_frames, vkDestroyImage, GAPI._VulkanDevice);
 	VK_CLEAR_ARRAY(_FullScreenOutput, GAPI._nb_vk_frames, vkDestroyFramebuffer, GAPI._VulkanDevice);
-	_MappedCPUImage.Clear();
+	_GPULocalImageVersions.Clear();
+	_ImageCopyRegions.Clear();
 	_RaytracedImage.Clear();
 
 	//free the allocated memory for the fullscreen images
 	vkFreeMemory(GAPI._VulkanDevice, _GPULocalImageMemory, nullptr);
 	vkFreeMemory(GAPI._VulkanDevice, _ImageCopyMemory, nullptr);
+	_ImageCopyMemory = VK_NULL_HANDLE;
 	vkDestroyDescriptorPool(GAPI._VulkanDevice, _GPUImageDescriptorPool, nullptr);
 	_GPUImageDescriptorSets.Clear();
 
@@ -386,13 +726,15 @@ void RaytraceCPU::ResizeVulkanResource(GraphicsAPIManager& GAPI, int32_t width,
 
 	//allocating a new space for the CPU image
 	_RaytracedImage.Alloc(GAPI._vk_width * GAPI._vk_height);
+	ZERO_SET(_RaytracedImage, GAPI._vk_width * GAPI._vk_height * sizeof(vec4));
 
 	//reallocate the fullscreen image buffers with the new number of available images
 	_FullScreenOutput.Alloc(GAPI._nb_vk_frames);
-	_ImageCopyBuffer.Alloc(GAPI._nb_vk_frames);
+	_ImageCopyBuffer.Alloc(CPU_DISPLAY_BUFFER_NB);
 	_GPULocalImageViews.Alloc(GAPI._nb_vk_frames);
 	_GPULocalImageBuffers.Alloc(GAPI._nb_vk_frames);
-	_MappedCPUImage.Alloc(GAPI._nb_vk_frames);
+	_GPULocalImageVersions.Alloc(GAPI._nb_vk_frames);
+	ZERO_SET(_GPULocalImageVersions, GAPI._nb_vk_frames * sizeof(uint32_t));
 
 
 	/*===== DESCRIPTORS ======*/
@@ -434,27 +776,38 @@ void RaytraceCPU::ResizeVulkanResource(GraphicsAPIManager& GAPI, int32_t width,
 
 	/*===== GPU SIDE IMAGE BUFFERS ======*/
 
-	// the size of the fullscreen image's buffer : a fullscreen rgba texture
-	VkDeviceSize bufferSize = static_cast<VkDeviceSize>(_FullScreenViewport.width * _FullScreenViewport.height * sizeof(vec4));
+	// the size of the fullscreen image's buffer : a fullscreen rgba texture in the display format.
+	// it is aligned so that the second image of the staging memory can be bound at its offset
+	VkDeviceSize bufferSize = static_cast<VkDeviceSize>(_FullScreenScissors.extent.width) * _FullScreenScissors.extent.height * display_pixel_size(_Display._format);
+	bufferSize = (bufferSize + 255) & ~static_cast<VkDeviceSize>(255);
 
 	//allocate the memory for buffer and image
 	{
 		//allocate memory for buffer
 		{
-			VulkanHelper::CreateVulkanBufferAndMemory(GAPI._VulkanUploader, bufferSize * static_cast<VkDeviceSize>(GAPI._nb_vk_frames), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _ImageCopyBuffer[0], _ImageCopyMemory, 0, true);
-			
-			VkMemoryRequirements memRequirements;
-			vkGetBufferMemoryRequirements(GAPI._VulkanDevice, _ImageCopyBuffer[0], &memRequirements);
-			_ImageCopyBufferSize = memRequirements.size / static_cast<VkDeviceSize>(GAPI._nb_vk_frames);
+			VulkanHelper::CreateVulkanBufferAndMemory(GAPI._VulkanUploader, bufferSize * CPU_DISPLAY_BUFFER_NB, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _ImageCopyBuffer[0], _ImageCopyMemory, 0, true);
+			_ImageCopyBufferSize = bufferSize;
 
 			vkDestroyBuffer(GAPI._VulkanDevice, _ImageCopyBuffer[0], nullptr);
 		}
 
+		//the staging memory stays mapped, the jobs writing the image in it directly
+		void* CPUMap = nullptr;
+		VK_CALL_PRINT(vkMapMemory(GAPI._VulkanDevice, _ImageCopyMemory, 0, _ImageCopyBufferSize * CPU_DISPLAY_BUFFER_NB, 0, &CPUMap));
+		_Display.reset(static_cast<uint8_t*>(CPUMap), static_cast<size_t>(_ImageCopyBufferSize), _FullScreenScissors.extent.width, _FullScreenScissors.extent.height, GAPI._nb_vk_frames);
+		_ImageCopyRegions.Alloc(_Display.tile_nb());
+
+		for (uint32_t i = 0; i < CPU_DISPLAY_BUFFER_NB; i++)
+		{
+			//create the buffer object that will be used to copy from CPU to GPU
+			VulkanHelper::CreateVulkanBufferAndMemory(GAPI._VulkanUploader, _ImageCopyBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _ImageCopyBuffer[i], _ImageCopyMemory, _ImageCopyBufferSize * i, false);
+		}
+
 		// creating the image object with data given in parameters
 		VkImageCreateInfo imageInfo{};
 		imageInfo.sType			= VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 		imageInfo.imageType		= VK_IMAGE_TYPE_2D;//we copy a fullscreen image
-		imageInfo.format		= VK_FORMAT_R32G32B32A32_SFLOAT;//easier to manipulate (may be unsuppoorted by some GPUs)
+		imageInfo.format		= DisplayVkFormat(_Display._format);//the format the jobs write the image in
 		imageInfo.extent.width	= _FullScreenScissors.extent.width;
 		imageInfo.extent.height = _FullScreenScissors.extent.height;
 		imageInfo.extent.depth	= 1;
@@ -505,11 +858,8 @@ void RaytraceCPU::ResizeVulkanResource(GraphicsAPIManager& GAPI, int32_t width,
 		framebufferInfo.pAttachments = &GAPI._VulkanBackColourBuffers[i];
 		VK_CALL_PRINT(vkCreateFramebuffer(GAPI._VulkanDevice, &framebufferInfo, nullptr, &_FullScreenOutput[i]))
 
-		//create the buffer object that will be used to copy from CPU to GPU
-		VulkanHelper::CreateVulkanBufferAndMemory(GAPI._VulkanUploader, _ImageCopyBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _ImageCopyBuffer[i], _ImageCopyMemory, _ImageCopyBufferSize * i, false);
-
 		//create the image that will be used to write from texture to screen frame buffer
-		VulkanHelper::CreateImage(GAPI._VulkanUploader, _GPULocalImageBuffers[i], _GPULocalImageMemory, _FullScreenScissors.extent.width, _FullScreenScissors.extent.height, 1, VK_IMAGE_TYPE_2D, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _GPULocalImageBufferSize * i, false);
+		VulkanHelper::CreateImage(GAPI._VulkanUploader, _GPULocalImageBuffers[i], _GPULocalImageMemory, _FullScreenScissors.extent.width, _FullScreenScissors.extent.height, 1, VK_IMAGE_TYPE_2D, DisplayVkFormat(_Display._format), VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _GPULocalImageBufferSize * i, false);
 
 		// changing the image to allow read from shader
 		VkImageMemoryBarrier barrier{};
@@ -534,7 +884,7 @@ void RaytraceCPU::ResizeVulkanResource(GraphicsAPIManager& GAPI, int32_t width,
 		VkImageViewCreateInfo viewCreateInfo{};
 		viewCreateInfo.sType						= VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 		viewCreateInfo.subresourceRange.aspectMask	= VK_IMAGE_ASPECT_COLOR_BIT;
-		viewCreateInfo.format						= VK_FORMAT_R32G32B32A32_SFLOAT;
+		viewCreateInfo.format						= DisplayVkFormat(_Display._format);
 		viewCreateInfo.image						= _GPULocalImageBuffers[i];
 		viewCreateInfo.subresourceRange.layerCount	= 1;
 		viewCreateInfo.subresourceRange.levelCount	= 1;
@@ -564,10 +914,72 @@ void RaytraceCPU::ResizeVulkanResource(GraphicsAPIManager& GAPI, int32_t width,
 void RaytraceCPU::Resize(GraphicsAPIManager& GAPI, int32_t old_width, int32_t old_height, uint32_t old_nb_frames)
 {
 	ResizeVulkanResource(GAPI, old_width, old_height, old_nb_frames);
+	AllocateComputeHeap();
+
+	//the progressive sums only depend on the screen size
+	_AccumulatedRadiance.Alloc(_FullScreenScissors.extent.width * _FullScreenScissors.extent.height);
+	_AccumulatedLuminanceSq.Alloc(_FullScreenScissors.extent.width * _FullScreenScissors.extent.height);
+	_ProgressiveTiles.Alloc(((_FullScreenScissors.extent.width + CPU_TILE_SIZE - 1) / CPU_TILE_SIZE) * ((_FullScreenScissors.extent.height + CPU_TILE_SIZE - 1) / CPU_TILE_SIZE));
+	AllocateReprojection();
+
+	//the previous image was of another size
+	_need_refresh	= true;
+	_camera_refresh = false;
+}
+
+void RaytraceCPU::AllocateReprojection()
+{
+	uint32_t pixelNb = _FullScreenScissors.extent.width * _FullScreenScissors.extent.height;
+	_PixelDepth.Alloc(pixelNb);
+	_HistoryRadiance.Alloc(pixelNb);
+	_HistoryLuminanceSq.Alloc(pixelNb);
+	_HistoryDepth.Alloc(pixelNb);
+	_history_valid = false;
+}
+
+void RaytraceCPU::AllocateComputeHeap()
+{
+	ClearRayBatches();
 	_ComputeBatch.Clear();
 	_ComputeHeap.Clear();
-	_ComputeHeap = MultipleSharedMemory<ray_compute>(_FullScreenScissors.extent.width * _FullScreenScissors.extent.height + _FullScreenScissors.extent.width * _FullScreenScissors.extent.height * _rtParams._pixel_sample_nb);
-	_need_refresh = true;
+	_SampleRadiance.Clear();
+	_PixelSampleDoneNb.Clear();
+	_Wavefront.clear();
+
+	//tiles do not need anything more than their locals
+	if (_render_mode == CPURenderMode::TILES)
+		return;
+
+	uint32_t pixelNb = _FullScreenScissors.extent.width * _FullScreenScissors.extent.height;
+
+	//the waves have a fixed size, whatever the size of the screen
+	if (_render_mode == CPURenderMode::WAVEFRONT)
+	{
+		_Wavefront.alloc(CPU_WAVEFRONT_SIZE);
+		_SampleRadiance.Alloc(pixelNb * _rtParams._pixel_sample_nb);
+		ZERO_SET(_SampleRadiance, pixelNb * _rtParams._pixel_sample_nb * sizeof(vec4));
+		return;
+	}
+
+	//one ray for each pixel, then one ray for each sample of each pixel
+	_ComputeHeap.Alloc(pixelNb + pixelNb * _rtParams._pixel_sample_nb);
+
+	//a job gives back at most a batch for each CPU_MIN_RAYS_PER_JOB rays of the heap, plus the first contact's ones.
+	//the jobs are never smaller, and the ones finding it full add the jobs of their rays themselves
+	_ComputeBatch.Alloc((pixelNb + pixelNb * _rtParams._pixel_sample_nb) / CPU_MIN_RAYS_PER_JOB + pixelNb / CPU_MIN_RAYS_PER_JOB + 1);
+	_SampleRadiance.Alloc(pixelNb * _rtParams._pixel_sample_nb);
+	ZERO_SET(_SampleRadiance, pixelNb * _rtParams._pixel_sample_nb * sizeof(vec4));
+	_PixelSampleDoneNb.Alloc(pixelNb);
+}
+
+void RaytraceCPU::ClearRayBatches()
+{
+	RayBatch dropped;
+	while (_ComputeBatch.Pop(dropped))
+		;
+
+	_BatchLeft = RayBatch{};
+	_pending_ray_nb.store(0);
 }
 
 
@@ -578,7 +990,6 @@ void RaytraceCPU::DispatchSceneRay(AppWideContext& AppContext)
 	//2D viewport values
 	float windowHeight	= static_cast<float>(_FullScreenScissors.extent.height);
 	float windowWidth	= static_cast<float>(_FullScreenScissors.extent.width);
-	float aspectRatio	= windowWidth / windowHeight;
 
 	//3D viewport and Camera values
 	float focalLength			= 1.0f;
@@ -598,61 +1009,440 @@ void RaytraceCPU::DispatchSceneRay(AppWideContext& AppContext)
 	//first sample dir and sample steps
 	vec3 viewportUpperLeft	= cameraCenter - viewportW - (viewportU * 0.5f) - (viewportV * 0.5f);
 	vec3 firstPixel			= viewportUpperLeft + ((pixelDeltaU + pixelDeltaV) * 0.5f);
-	
-	{
-		//going over every pixel
-		for (uint32_t h = 0; h < _FullScreenScissors.extent.height; h++)
-			for (uint32_t w = 0; w < _FullScreenScissors.extent.width; w++)
-			{
-				//first get the pixel's "3D position", (we anti-aliase using random)
-				vec3 pixelCenter = firstPixel + pixelDeltaU * (static_cast<float>(w) + randf() - 0.5f) 
-												+ pixelDeltaV * (static_cast<float>(h) + randf() - 0.5f);
-				//create a direction from the camera's position to the 3D viewport for this pixel
-				vec3 rayDir = normalize(pixelCenter - cameraCenter);//normalizing is very slow, we'll still do it, but you may want to remove it
 
-				ray pixelRay = ray{ pixelCenter, rayDir };
+	//what the jobs need to generate the ray of any pixel
+	_CameraRays.center			= cameraCenter;
+	_CameraRays.first_pixel		= firstPixel;
+	_CameraRays.pixel_delta_u	= pixelDeltaU;
+	_CameraRays.pixel_delta_v	= pixelDeltaV;
 
-                _ComputeHeap[(h * _FullScreenScissors.extent.width) + w].launched = pixelRay;
-                _ComputeHeap[(h * _FullScreenScissors.extent.width) + w].pixel = &_RaytracedImage[(h * _FullScreenScissors.extent.width) + w];
-			}
-		
-		//clearing the current work and sending the new one
-		_batch_fence.lock();
-		_ComputeBatch.Clear();
-		_ComputeBatch.PushBatch(_ComputeHeap, _FullScreenScissors.extent.width * _FullScreenScissors.extent.height);
-		_batch_fence.unlock();
-	}
+	//a new image makes the work of the previous one obsolete : its jobs drop it by themselves as soon as they see the new epoch,
+	//we only wait for the ones in the middle of writing a row (or a batch of rays) of the image
+	if (!_is_moving)
+		_RenderEpoch.advance();
+
+	//the wavefront does not need to go on with an image that is not shown anymore
+	_Wavefront._epoch.advance();
 
 	//pause the thread loop to add the new concurrent work
 	AppContext.threadPool.Pause();
-	if (!_is_moving)//if we are moving the old work are obsolete
-		AppContext.threadPool.ClearJobs();
 
-	//going over all the screen
-	for (uint32_t i = 0; i < _FullScreenScissors.extent.width * _FullScreenScissors.extent.height;)
+	//a still camera in progressive mode starts a new image, that is then refined one pass at a time
+	if (_progressive && !_is_moving)
+	{
+		//when only the camera moved, the previous image is kept for the first pass to reproject it
+		_history_valid = _reprojection && _camera_refresh && _progressive_pass_nb > 0;
+		if (_history_valid)
+		{
+			SwapHeap(_AccumulatedRadiance, _HistoryRadiance);
+			SwapHeap(_AccumulatedLuminanceSq, _HistoryLuminanceSq);
+			SwapHeap(_PixelDepth, _HistoryDepth);
+			_HistoryCamera = _AccumulatedCamera;
+		}
+		_AccumulatedCamera = _CameraRays;
+
+		uint32_t pixelNb = _FullScreenScissors.extent.width * _FullScreenScissors.extent.height;
+		ZERO_SET(_AccumulatedRadiance, pixelNb * sizeof(vec4));
+		ZERO_SET(_AccumulatedLuminanceSq, pixelNb * sizeof(float));
+		uint32_t tileNb = ((_FullScreenScissors.extent.width + CPU_TILE_SIZE - 1) / CPU_TILE_SIZE) * ((_FullScreenScissors.extent.height + CPU_TILE_SIZE - 1) / CPU_TILE_SIZE);
+		for (uint32_t i = 0; i < tileNb; i++)
+			_ProgressiveTiles[i] = progressive_tile{};
+		_progressive_pass_nb	= 0;
+		_progressive_noise		= FLT_MAX;
+		_progressive_done		= false;
+		_progressive_sample_nb	= 0;
+		_progressive_active_tile_nb = tileNb;
+
+		DispatchSceneTiles(AppContext, true);
+		_progressive_pass_nb++;
+		AppContext.threadPool.Resume();
+		return;
+	}
+
+	//the wavefront starts its first wave, the stages then start one another
+	if (_render_mode == CPURenderMode::WAVEFRONT && !_is_moving)
+	{
+		uint32_t pathNb = _FullScreenScissors.extent.width * _FullScreenScissors.extent.height * _rtParams._pixel_sample_nb;
+		ZERO_SET(_SampleRadiance, pathNb * sizeof(vec4));
+		_Wavefront.reset(pathNb);
+
+		if (_Wavefront.next_wave())
+			DispatchWavefrontStage(AppContext.threadPool, _Wavefront._epoch.current());
+		AppContext.threadPool.Resume();
+		return;
+	}
+
+	//in tile mode, the jobs generate their rays themselves.
+	//every mode shows the scene through them while moving, as they can trace a single ray for a block of pixels
+	if (_is_moving || _render_mode == CPURenderMode::TILES)
+	{
+		DispatchSceneTiles(AppContext);
+		AppContext.threadPool.Resume();
+		return;
+	}
+	
+	//the rays of the previous image left in the heap are not needed anymore (the jobs of the previous image do not push any since the epoch changed)
+	ClearRayBatches();
+
+	//going over all the screen : the jobs generate the camera rays of their own pixels
+	uint32_t pixelNb = _FullScreenScissors.extent.width * _FullScreenScissors.extent.height;
+
+	//the pixels are averaged in the image by the job ending their last sample
+	for (uint32_t i = 0; i < pixelNb; i++)
+		_PixelSampleDoneNb[i].store(0);
+
+	//the threads of the pool never change, so they get their shading memory once
+	if (_ShadingScratch.Nb() != AppContext.threadPool.GetThreadsNb())
+		_ShadingScratch.Alloc(AppContext.threadPool.GetThreadsNb());
+	for (uint32_t i = 0; i < pixelNb; i += _compute_per_frames)
+	{
+		//a batch of the size user chose, the offset in the heap being its first pixel
+		RayBatch newBatch{ _ComputeHeap, i, i + _compute_per_frames < pixelNb ? _compute_per_frames : pixelNb - i };
+
+		//adding the job without asking for immediate execution
+		FirstContactRaytraceJob newJob(newBatch, AppContext.threadPool, *this);
+		AppContext.threadPool.SilentAdd(newJob);
+	}
+
+	//now asking for all thread to start working
+	AppContext.threadPool.Resume();
+}
+
+void RaytraceCPU::DispatchSceneTiles(AppWideContext& AppContext, bool progressive)
+{
+	uint32_t tileNbX = (_FullScreenScissors.extent.width + CPU_TILE_SIZE - 1) / CPU_TILE_SIZE;
+	uint32_t tileNbY = (_FullScreenScissors.extent.height + CPU_TILE_SIZE - 1) / CPU_TILE_SIZE;
+
+	//the hilbert curve goes through a square grid with a power of two side, we skip the cells outside of the screen
+	uint32_t curveSide = 1;
+	while (curveSide < tileNbX || curveSide < tileNbY)
+		curveSide *= 2;
+
+	for (uint32_t i = 0; i < curveSide * curveSide; i++)
 	{
-		//asking for a Batch for the job to work on with the size user chose
-		uint32_t computeNb				= _compute_per_frames;
-		const RayBatch& computes_job	= _ComputeBatch.PopBatch(computeNb);
+		uint32_t tileX, tileY;
+		hilbert_to_xy(curveSide, i, tileX, tileY);
+
+		if (tileX >= tileNbX || tileY >= tileNbY)
+			continue;
 
-		if (computeNb > 0)
+		//adding the job without asking for immediate execution
+		if (progressive)
 		{
-			RayBatch newBatch{ computes_job.data,computes_job.offset,computes_job.nb };
+			//adaptive sampling leaves out the tiles that are clean enough
+			progressive_tile& tile = _ProgressiveTiles[tileY * tileNbX + tileX];
+			if (tile._converged)
+				continue;
 
-			//adding the job without asking for immediate execution
-			FirstContactRaytraceJob newJob(newBatch,*this);
+			ProgressiveRaytraceJob newJob(tileX * CPU_TILE_SIZE, tileY * CPU_TILE_SIZE, tile, *this);
 			AppContext.threadPool.SilentAdd(newJob);
+
+			uint32_t tileWidth	= _FullScreenScissors.extent.width - tileX * CPU_TILE_SIZE;
+			uint32_t tileHeight = _FullScreenScissors.extent.height - tileY * CPU_TILE_SIZE;
+			_progressive_sample_nb += (tileWidth < CPU_TILE_SIZE ? tileWidth : CPU_TILE_SIZE) * (tileHeight < CPU_TILE_SIZE ? tileHeight : CPU_TILE_SIZE);
 		}
+		else
+		{
+			TileRaytraceJob newJob(tileX * CPU_TILE_SIZE, tileY * CPU_TILE_SIZE, *this);
+			AppContext.threadPool.SilentAdd(newJob);
+		}
+	}
+}
+
+void RaytraceCPU::DispatchPendingRays(AppWideContext& AppContext)
+{
+	//keeping a few jobs in line for every worker, so that none of them waits for the next frame to have work
+	uint32_t pendingNb	= AppContext.threadPool.GetPendingNb();
+	uint32_t maxJobNb	= AppContext.threadPool.GetThreadsNb() * CPU_JOBS_PER_WORKER;
+
+	for (uint32_t i = pendingNb; i < maxJobNb; i++)
+	{
+		//the batch we were cutting is done, taking the next one the jobs gave back
+		if (_BatchLeft.nb == 0 && !_ComputeBatch.Pop(_BatchLeft))
+			break;
+
+		//a batch for the job to work on with the size of a job
+		RayBatch computes	= _BatchLeft;
+		computes.nb			= _BatchLeft.nb < _compute_per_frames ? _BatchLeft.nb : _compute_per_frames;
+		_BatchLeft.offset	+= computes.nb;
+		_BatchLeft.nb		-= computes.nb;
+
+		AnyHitRaytraceJob newJob(computes, AppContext.threadPool, *this);
+
+		//adding the job and asking for immediate execution
+		AppContext.threadPool.Add(newJob);
 
-		//adding the number of processed pixel
-		i += computeNb;
+		//only once the pool counts the job, so that its rays are never seen done in between
+		_pending_ray_nb.fetch_sub(computes.nb);
 	}
-	//now asking for all thread to start working
+}
+
+void RaytraceCPU::CancelJobs(ThreadPool& Pool)
+{
+	//the jobs of the wavefront that are still running will not start the next stage
+	_Wavefront._epoch.advance();
+	//nor will the ones of the image, even those added by a running job once the queue was full
+	_RenderEpoch.advance();
+
+	Pool.Pause();
+	//the jobs still running may add some (when their batch queue is full), so we clear until none are left
+	do
+	{
+		Pool.ClearJobs();
+		Pool.WaitIdle();
+	} while (Pool.GetPendingNb() > 0);
+
+	//the jobs writing the staging memory were removed as well, their tiles are written by the next ones
+	_Display.cancel();
+	_Display._queued_job_nb.store(0);
+}
+
+bool RaytraceCPU::RenderJobsIdle(ThreadPool& Pool)
+{
+	//the pool is asked first : a display job being done in between only makes us think a job of the image is left
+	uint32_t pendingNb = Pool.GetPendingNb();
+	return pendingNb <= _Display._queued_job_nb.load();
+}
+
+void RaytraceCPU::DispatchDisplayEncode(ThreadPool& Pool)
+{
+	//the image the jobs finished writing is the one copied from now on
+	_Display.publish();
+
+	//the tiles written while the back image is still copied wait for the next frames
+	if (!_Display.can_encode() || !_Display.collect(_Display._version + 1))
+		return;
+
+	//a tile a render job writes while we read it is told changed once the job is done, and written again after this
+	_Display._encoding = true;
+	uint32_t since = _Display._image_version[_Display._front ^ 1];
+	for (uint32_t tileY = 0; tileY < _Display._tile_nb_y; tileY++)
+	{
+		bool rowChanged = false;
+		for (uint32_t tileX = 0; tileX < _Display._tile_nb_x && !rowChanged; tileX++)
+			rowChanged = _Display.tile_changed(tileY * _Display._tile_nb_x + tileX, since);
+
+		if (!rowChanged)
+			continue;
+
+		//counted before the job is added, so that the writing is never seen done in between
+		_Display._pending_job_nb.fetch_add(1);
+		_Display._queued_job_nb.fetch_add(1);
+		DisplayEncodeJob newJob(tileY, *this);
+		Pool.Add(newJob);
+	}
+}
+
+void RaytraceCPU::NextWavefrontStage(ThreadPool& Pool, uint32_t epoch)
+{
+	//the image was restarted, the new one has its own jobs
+	if (_Wavefront._epoch.stale(epoch))
+		return;
+
+	switch (_Wavefront._stage)
+	{
+		case wavefront_stage::GENERATE:
+		{
+			_Wavefront._ray_nb	= _Wavefront._wave_path_nb;
+			_Wavefront._stage	= wavefront_stage::EXTEND;
+			break;
+		}
+		case wavefront_stage::EXTEND:
+		{
+			_Wavefront._next_ray_nb.store(0);
+			_Wavefront._stage = wavefront_stage::SHADE;
+			break;
+		}
+		case wavefront_stage::SHADE:
+		{
+			//the rays going on are now the ones being traced
+			_Wavefront._current ^= 1;
+			_Wavefront._ray_nb	= _Wavefront._next_ray_nb.load();
+			_Wavefront._stage	= _Wavefront._ray_nb > 0 ? wavefront_stage::EXTEND : wavefront_stage::ACCUMULATE;
+			break;
+		}
+		default:
+		{
+			//every path of the image is done
+			if (!_Wavefront.next_wave())
+				return;
+			break;
+		}
+	}
+
+	DispatchWavefrontStage(Pool, epoch);
+}
+
+void RaytraceCPU::DispatchWavefrontStage(ThreadPool& Pool, uint32_t epoch)
+{
+	//the part of the wave the stage works on
+	uint32_t first	= 0;
+	uint32_t end	= 0;
+	switch (_Wavefront._stage)
+	{
+		case wavefront_stage::GENERATE:
+			end = _Wavefront._wave_path_nb;
+			break;
+		case wavefront_stage::EXTEND:
+		case wavefront_stage::SHADE:
+			end = _Wavefront._ray_nb;
+			break;
+		default:
+		{
+			//the pixels the paths of the wave belong to
+			uint32_t sampleNb	= _rtParams._pixel_sample_nb;
+			first				= _Wavefront._first_path / sampleNb;
+			end					= (_Wavefront._first_path + _Wavefront._wave_path_nb - 1) / sampleNb + 1;
+			break;
+		}
+	}
+
+	//the counter is set before any job can end
+	uint32_t jobNb = (end - first + CPU_WAVEFRONT_CHUNK - 1) / CPU_WAVEFRONT_CHUNK;
+	_Wavefront._pending_job_nb.store(jobNb);
+
+	for (uint32_t i = first; i < end; i += CPU_WAVEFRONT_CHUNK)
+	{
+		WavefrontRaytraceJob newJob(_Wavefront._stage, i, i + CPU_WAVEFRONT_CHUNK < end ? i + CPU_WAVEFRONT_CHUNK : end, Pool, epoch, *this);
+		Pool.Add(newJob);
+	}
+}
+
+float RaytraceCPU::EstimateProgressiveNoise()
+{
+	uint32_t pixelNb	= _FullScreenScissors.extent.width * _FullScreenScissors.extent.height;
+	uint32_t tileNb		= ((_FullScreenScissors.extent.width + CPU_TILE_SIZE - 1) / CPU_TILE_SIZE) * ((_FullScreenScissors.extent.height + CPU_TILE_SIZE - 1) / CPU_TILE_SIZE);
+
+	//the tiles left out keep the noise they had on their last pass
+	double noiseSum = 0.0;
+	bool noiseKnown = true;
+	_progressive_active_tile_nb = 0;
+	_progressive_reprojected_nb = 0;
+	for (uint32_t i = 0; i < tileNb; i++)
+	{
+		const progressive_tile& tile = _ProgressiveTiles[i];
+		if (!tile._converged)
+			_progressive_active_tile_nb++;
+		_progressive_reprojected_nb += tile._reprojected_nb;
+
+		//the variance cannot be estimated from a single sample
+		if (tile._noise_sum == FLT_MAX)
+			noiseKnown = false;
+		else
+			noiseSum += tile._noise_sum;
+	}
+
+	if (!noiseKnown)
+		return FLT_MAX;
+
+	return pixelNb > 0 ? static_cast<float>(noiseSum / static_cast<double>(pixelNb)) : 0.0f;
+}
+
+bool RaytraceCPU::NextProgressivePass(AppWideContext& AppContext)
+{
+	//waiting for the whole pass, so that a pixel is only ever written by one job at a time
+	if (_progressive_done || _progressive_pass_nb == 0 || !RenderJobsIdle(AppContext.threadPool))
+		return false;
+
+	//the left out tiles are checked again on their next pass, as what makes them clean enough changed
+	if (_adaptive_reset)
+	{
+		uint32_t tileNb = ((_FullScreenScissors.extent.width + CPU_TILE_SIZE - 1) / CPU_TILE_SIZE) * ((_FullScreenScissors.extent.height + CPU_TILE_SIZE - 1) / CPU_TILE_SIZE);
+		for (uint32_t i = 0; i < tileNb; i++)
+			_ProgressiveTiles[i]._converged = false;
+		_adaptive_reset = false;
+	}
+
+	_progressive_noise	= EstimateProgressiveNoise();
+	//adaptive sampling stops once every tile is clean enough, rather than on the average of the image
+	_progressive_done	= _progressive_pass_nb >= _progressive_target_spp
+						|| (!_adaptive && _progressive_noise_threshold > 0.0f && _progressive_noise <= _progressive_noise_threshold)
+						|| _progressive_active_tile_nb == 0;
+
+	if (_progressive_done)
+		return false;
+
+	AppContext.threadPool.Pause();
+	DispatchSceneTiles(AppContext, true);
+	_progressive_pass_nb++;
 	AppContext.threadPool.Resume();
+	return true;
+}
+
+void RaytraceCPU::ResolveProgressiveImage()
+{
+	uint32_t pixelNb	= _FullScreenScissors.extent.width * _FullScreenScissors.extent.height;
+	float targetSpp		= static_cast<float>(_progressive_target_spp);
+
+	for (uint32_t i = 0; i < pixelNb; i++)
+	{
+		const vec4& sum = _AccumulatedRadiance[i];
+		if (sum.w == 0.0f)
+			continue;
+
+		_RaytracedImage[i] = _show_sample_heatmap ? heatmap_color(sum.w / targetSpp) : vec4{ sum.x / sum.w, sum.y / sum.w, sum.z / sum.w, 1.0f };
+	}
+
+	_Display.mark_all();
+}
+
+void RaytraceCPU::UpdateRayBudget(const AppWideContext& AppContext)
+{
+	uint64_t rayNb, busyNs;
+	_RayThroughput.collect(rayNb, busyNs);
+
+	//the time is summed over the workers, so this is what a single worker does in a ms
+	if (rayNb > 0 && busyNs > 0)
+	{
+		float measuredRaysPerMs = static_cast<float>(rayNb) / (static_cast<float>(busyNs) * 1e-6f);
+		_worker_rays_per_ms += (measuredRaysPerMs - _worker_rays_per_ms) * CPU_THROUGHPUT_SMOOTHING;
+	}
+	_pool_rays_per_ms = AppContext.delta_time > 0.0f ? static_cast<float>(rayNb) / (AppContext.delta_time * 1000.0f) : 0.0f;
+
+	if (!_frame_budget)
+		return;
+
+	//the main thread waits for the running jobs when the image is refreshed, so a job should only last a part of a frame.
+	//the workers are kept fed with CPU_JOBS_PER_WORKER jobs each, which is about a frame of work in line.
+	float jobRays = _worker_rays_per_ms * _target_frame_time / static_cast<float>(CPU_JOBS_PER_WORKER);
+	_compute_per_frames = jobRays > static_cast<float>(CPU_MIN_RAYS_PER_JOB) ? static_cast<uint32_t>(jobRays) : CPU_MIN_RAYS_PER_JOB;
+}
+
+void RaytraceCPU::UpdatePreviewScale(const AppWideContext& AppContext)
+{
+	if (!_dynamic_resolution)
+	{
+		_preview_scale = 1;
+		return;
+	}
+
+	//the rays the workers can trace during the part of the frame left to them
+	float frameRays = _worker_rays_per_ms * static_cast<float>(AppContext.threadPool.GetThreadsNb()) * _target_frame_time * CPU_PREVIEW_FRAME_SHARE;
+	float pixelNb	= static_cast<float>(_FullScreenScissors.extent.width * _FullScreenScissors.extent.height);
+
+	//a block of scale x scale pixels shares a single ray : the blocks get bigger until the preview fits in the frame
+	uint32_t scale = 1;
+	while (scale < CPU_MAX_PREVIEW_SCALE && pixelNb / static_cast<float>(scale * scale) > frameRays)
+		scale *= 2;
+
+	//getting sharper only once there is room to spare, so that the preview does not flicker between two resolutions
+	while (scale < _preview_scale && pixelNb / static_cast<float>(scale * scale) > frameRays * CPU_PREVIEW_HYSTERESIS)
+		scale *= 2;
+
+	_preview_scale = scale;
 }
 
 void RaytraceCPU::Act(AppWideContext& AppContext)
 {
+	//what the last frame traced, the counters being allocated on the first frame, before any job adds to them (the pool never changes)
+	if (_RenderStats._History == nullptr)
+		_RenderStats.alloc(AppContext.threadPool.GetThreadsNb());
+	_RenderStats.collect(AppContext.threadPool, AppContext.delta_time * 1000.0f);
+
+	//the refresh asked by the camera is set aside, so that we know if the UI asks for one as well
+	bool cameraRefresh	= _need_refresh && _camera_refresh;
+	_need_refresh		= _need_refresh && !cameraRefresh;
+
 	//UI update
 	if (SceneCanShowUI(AppContext))
 	{
@@ -660,52 +1450,303 @@ void RaytraceCPU::Act(AppWideContext& AppContext)
 		_need_refresh |= ImGui::Button("REFRESH");
 
 		//CPU Computes
-		ImGui::Text("Pending Rays to Compute : %d", _ComputeBatch.GetNb());
-		_need_refresh |= ImGui::SliderInt("ComputesPerFrame", (int*)&_compute_per_frames, 1, MAX_CPU_COMPUTE_PER_FRAMES);
+		ImGui::Text("Pending Rays to Compute : %u", _pending_ray_nb.load());
+		ImGui::Checkbox("Frame Time Budget", &_frame_budget);
+		ImGui::Checkbox("Dynamic Resolution", &_dynamic_resolution);
+		//both the jobs and the preview are sized for the target frame time
+		if (_frame_budget || _dynamic_resolution)
+			ImGui::SliderFloat("Target Frame Time (ms)", &_target_frame_time, 1.0f, MAX_CPU_TARGET_FRAME_TIME, "%.1f");
+		if (_frame_budget)
+			ImGui::Text("Rays Per Job : %u", _compute_per_frames);
+		else
+			_need_refresh |= ImGui::SliderInt("ComputesPerFrame", (int*)&_compute_per_frames, CPU_MIN_RAYS_PER_JOB, MAX_CPU_COMPUTE_PER_FRAMES);
+		if (_dynamic_resolution)
+			ImGui::Text("Preview Resolution : 1/%u", _preview_scale);
+		ImGui::Text("Throughput : %.0f rays/ms per worker, %.0f rays/ms for %u workers", _worker_rays_per_ms, _pool_rays_per_ms, AppContext.threadPool.GetThreadsNb());
+		ImGui::Text("Display : %s, %.2f MB per full image, last upload %.1f%% of it", display_format_name(_Display._format), static_cast<float>(_Display.upload_size()) / (1024.0f * 1024.0f),
+			_Display._width * _Display._height > 0 ? 100.0f * static_cast<float>(_Display._copied_pixel_nb) / static_cast<float>(_Display._width * _Display._height) : 0.0f);
+		_need_refresh |= ImGui::InputScalar("Render Seed", ImGuiDataType_U32, &_render_seed);
+		static const char* sampleSequenceNames[static_cast<uint32_t>(sample_sequence::NB)] = { "White Noise", "Sobol", "Blue Noise" };
+		_need_refresh |= ImGui::Combo("Sample Sequence", (int*)&_sample_sequence, sampleSequenceNames, static_cast<int>(sample_sequence::NB));
+
+		//Progressive image
+		if (ImGui::CollapsingHeader("Progressive"))
+		{
+			_need_refresh |= ImGui::Checkbox("Progressive", &_progressive);
+
+			//changing the targets may make the image go on
+			if (ImGui::SliderInt("Target Samples", (int*)&_progressive_target_spp, 1, MAX_CPU_PROGRESSIVE_TARGET_SPP))
+				_progressive_done = false;
+			if (ImGui::SliderFloat("Noise Threshold", &_progressive_noise_threshold, 0.0f, 0.1f, "%.4f"))
+			{
+				_progressive_done	= false;
+				_adaptive_reset		= true;
+			}
+
+			ImGui::Text("Passes : %u / %u%s", _progressive_pass_nb, _progressive_target_spp, _progressive_done ? " (done)" : "");
+
+			//a camera that only moved a bit keeps most of the previous image
+			ImGui::Checkbox("Reprojection", &_reprojection);
+			uint32_t screenPixelNb = _FullScreenScissors.extent.width * _FullScreenScissors.extent.height;
+			ImGui::Text("Reprojected : %.1f%% of the pixels", screenPixelNb > 0 ? 100.0f * static_cast<float>(_progressive_reprojected_nb) / static_cast<float>(screenPixelNb) : 0.0f);
+			if (_progressive_noise != FLT_MAX)
+				ImGui::Text("Noise : %.4f", _progressive_noise);
+			else
+				ImGui::Text("Noise : -");
+
+			//adaptive sampling only goes on with the tiles that are still noisy
+			bool adaptiveChanged = ImGui::Checkbox("Adaptive Sampling", &_adaptive);
+			adaptiveChanged |= ImGui::SliderInt("Min Samples", (int*)&_adaptive_min_spp, 2, MAX_CPU_ADAPTIVE_MIN_SPP);
+			if (adaptiveChanged)
+			{
+				_progressive_done	= false;
+				_adaptive_reset		= true;
+			}
+			_progressive_image_dirty |= ImGui::Checkbox("Sample Heatmap", &_show_sample_heatmap);
+
+			//what adaptive sampling saved, compared to giving every pixel as many samples as the most sampled one
+			uint32_t pixelNb = _FullScreenScissors.extent.width * _FullScreenScissors.extent.height;
+			uint64_t uniformSampleNb = static_cast<uint64_t>(_progressive_pass_nb) * pixelNb;
+			ImGui::Text("Active Tiles : %u", _progressive_active_tile_nb);
+			ImGui::Text("Samples : %.2f per pixel, %.1f%% of uniform", pixelNb > 0 ? static_cast<float>(_progressive_sample_nb) / static_cast<float>(pixelNb) : 0.0f,
+				uniformSampleNb > 0 ? 100.0f * static_cast<float>(_progressive_sample_nb) / static_cast<float>(uniformSampleNb) : 100.0f);
+		}
+
+		//how the work is distributed between jobs, changing it changes what we need to allocate
+		CPURenderMode previousRenderMode = _render_mode;
+		if (ImGui::RadioButton("Ray Heap", _render_mode == CPURenderMode::RAY_HEAP))
+			_render_mode = CPURenderMode::RAY_HEAP;
+		ImGui::SameLine();
+		if (ImGui::RadioButton("Tiles", _render_mode == CPURenderMode::TILES))
+			_render_mode = CPURenderMode::TILES;
+		ImGui::SameLine();
+		if (ImGui::RadioButton("Wavefront", _render_mode == CPURenderMode::WAVEFRONT))
+			_render_mode = CPURenderMode::WAVEFRONT;
+
+		if (previousRenderMode != _render_mode)
+		{
+			CancelJobs(AppContext.threadPool);
+
+			AllocateComputeHeap();
+
+			AppContext.threadPool.Resume();
+			_need_refresh = true;
+		}
+
+		//the memory used to store the rays and samples (nothing for tiles)
+		uint32_t pixelNb = _FullScreenScissors.extent.width * _FullScreenScissors.extent.height;
+		float rayMemory = 0.0f;
+		if (_render_mode == CPURenderMode::RAY_HEAP)
+			rayMemory = static_cast<float>(pixelNb) * (static_cast<float>(1 + _rtParams._pixel_sample_nb) * sizeof(ray_compute) + static_cast<float>(_rtParams._pixel_sample_nb) * sizeof(vec4));
+		else if (_render_mode == CPURenderMode::WAVEFRONT)
+			rayMemory = static_cast<float>(_Wavefront.byte_size()) + static_cast<float>(pixelNb) * static_cast<float>(_rtParams._pixel_sample_nb) * sizeof(vec4);
+		ImGui::Text("Ray Memory : %.1f MB", rayMemory / (1024.0f * 1024.0f));
+
+		//the time spent in each stage of the wavefront, to profile them on their own
+		if (_render_mode == CPURenderMode::WAVEFRONT)
+		{
+			ImGui::Text("Wavefront : %u paths per wave, %s", CPU_WAVEFRONT_SIZE, _Wavefront._done.load() ? "done" : "tracing");
+			for (uint32_t i = 0; i < static_cast<uint32_t>(wavefront_stage::NB); i++)
+				ImGui::Text("%s : %.2f ms", wavefront_stage_name(static_cast<wavefront_stage>(i)), static_cast<float>(_Wavefront._stage_ns[i].load()) * 1e-6f);
+		}
+
+		//what the tracer did over the last frames, to see a regression, or threads waiting on the others
+		if (ImGui::CollapsingHeader("Statistics") && _RenderStats._frame_nb > 0)
+		{
+			const frame_stats& lastFrame	= _RenderStats.frame(0);
+			const trace_counters& counters	= lastFrame._Counters;
+			uint64_t rayNb					= counters.total_ray_nb();
+
+			ImGui::Text("Last Frame : %.2f ms, %llu jobs, %llu rays (%llu shadow rays)", lastFrame._frame_ms, static_cast<unsigned long long>(lastFrame._Threads._job_nb),
+				static_cast<unsigned long long>(rayNb), static_cast<unsigned long long>(counters._shadow_ray_nb));
+			ImGui::Text("Per Ray : %.1f primitive tests, %.1f bvh node visits", rayNb > 0 ? static_cast<float>(counters._prim_test_nb) / static_cast<float>(rayNb) : 0.0f,
+				rayNb > 0 ? static_cast<float>(counters._node_visit_nb) / static_cast<float>(rayNb) : 0.0f);
+
+			//the last depth counts every deeper ray as well
+			ImGui::Text("Camera Rays : %llu", static_cast<unsigned long long>(counters._ray_nb[0]));
+			for (uint32_t i = 1; i < CPU_STATS_DEPTH_NB; i++)
+				ImGui::Text("Depth %u%s : %llu", i, i + 1 == CPU_STATS_DEPTH_NB ? "+" : "", static_cast<unsigned long long>(counters._ray_nb[i]));
+
+			//the graphs go from the oldest frame to the last one
+			struct stats_plot
+			{
+				const render_stats* _Stats;
+				stats_graph			_graph;
+			};
+			for (uint32_t i = 0; i < static_cast<uint32_t>(stats_graph::NB); i++)
+			{
+				stats_plot plot{ &_RenderStats, static_cast<stats_graph>(i) };
+				char overlay[32];
+				snprintf(overlay, sizeof(overlay), "%.2f", _RenderStats.graph_value(plot._graph, _RenderStats._frame_nb - 1));
+
+				ImGui::PlotLines(stats_graph_name(plot._graph), [](void* data, int index) -> float
+					{
+						const stats_plot* plot = static_cast<const stats_plot*>(data);
+						return plot->_Stats->graph_value(plot->_graph, static_cast<uint32_t>(index));
+					}, &plot, static_cast<int>(_RenderStats._frame_nb), 0, overlay, 0.0f, FLT_MAX, ImVec2(0.0f, 40.0f));
+			}
+
+			//a thread a lot more idle than the others is starved of work
+			ImGui::Text("Threads, on average over %u frames :", _RenderStats._frame_nb);
+			for (uint32_t i = 0; i < _RenderStats._thread_nb; i++)
+			{
+				thread_frame_stats average = _RenderStats.thread_average(i);
+				ImGui::Text("Thread %u : %.2f ms busy, %.2f ms idle, %llu jobs waiting %.3f ms each, %llu rays", i, average._busy_ms, average._idle_ms, static_cast<unsigned long long>(average._job_nb),
+					average._job_nb > 0 ? average._queue_wait_ms / static_cast<float>(average._job_nb) : 0.0f, static_cast<unsigned long long>(average._ray_nb));
+			}
+
+			if (ImGui::Button("Export Statistics"))
+			{
+				if (_RenderStats.export_json(CPU_STATS_EXPORT_PATH))
+					printf("Statistics of the last %u frames written in %s\n", _RenderStats._frame_nb, CPU_STATS_EXPORT_PATH);
+				else
+					printf("Could not write the statistics in %s\n", CPU_STATS_EXPORT_PATH);
+			}
+		}
+
+		//Scene and acceleration structure
+		if (ImGui::CollapsingHeader("Scene"))
+		{
+			static const char* sceneTypeNames[static_cast<uint32_t>(CPUSceneType::NB)] = { "Random Spheres", "Cornell Box", "Model" };
+			bool sceneChanged = ImGui::Combo("Scene Type", (int*)&_scene_type, sceneTypeNames, static_cast<int>(CPUSceneType::NB));
+
+			if (_scene_type == CPUSceneType::RANDOM_SPHERES)
+				ImGui::SliderInt("Random Sphere Grid", (int*)&_random_sphere_grid, 0, MAX_CPU_RANDOM_SPHERE_GRID);
+			ImGui::Text("Objects : %u", _Scene.Nb());
+			ImGui::Text("BVH : %u nodes, %u leaves, depth %u", _SceneBVH._node_nb > 0 ? _SceneBVH._node_nb - 1 : 0, _SceneBVH._leaf_nb, _SceneBVH._depth);
+			ImGui::Text("BVH Build Time : %.3f ms", _SceneBVH._build_time);
+
+			//the meshes have their own bvh over their triangles
+			for (uint32_t i = 0; i < _Scene.Nb(); i++)
+			{
+				if (const triangle_mesh* mesh = dynamic_cast<const triangle_mesh*>(_Scene[i]))
+					ImGui::Text("Mesh %u : %u triangles, BVH depth %u, built in %.3f ms, %s", i, mesh->_triangle_nb, mesh->_BVH._depth, mesh->_BVH._build_time, simd_level_name(mesh->_Triangles._level));
+			}
+
+			//the objects are changing, so the jobs should not be working on them anymore
+			if (ImGui::Button("Regenerate Scene") || sceneChanged)
+			{
+				CancelJobs(AppContext.threadPool);
+
+				ClearRayBatches();
+
+				//the pool stays paused while the objects are freed, so that no job can still be reading them
+				ClearScene();
+
+				//the threads can then help building the new bvhs
+				AppContext.threadPool.Resume();
+				GenerateScene(&AppContext.threadPool);
+
+				_need_refresh = true;
+			}
+		}
+
+		//the light is only found through the shadow rays of the diffuse hits
+		_need_refresh |= ImGui::Checkbox("Light Sampling", &_light_sampling);
+		LightType lightType = _light._LightType;
+		ImGuiHelper::LightUI("Light", _light, _need_refresh);
+		_need_refresh |= lightType != _light._LightType;
+
+		//Sphere intersection kernels
+		if (ImGui::CollapsingHeader("Sphere Kernels"))
+		{
+			_need_refresh |= ImGui::Checkbox("Use Sphere Kernels", &_use_sphere_soa);
+
+			//only showing the instruction sets this CPU supports
+			static const simd_level supported = detect_simd_level();
+			if (ImGui::BeginCombo("Instruction Set", simd_level_name(_SceneSpheres._level)))
+			{
+				for (uint32_t level = 0; level <= static_cast<uint32_t>(supported); level++)
+				{
+					if (ImGui::Selectable(simd_level_name(static_cast<simd_level>(level)), _SceneSpheres._level == static_cast<simd_level>(level)))
+					{
+						//the meshes' kernels are read by the jobs while they trace
+						CancelJobs(AppContext.threadPool);
+
+						_SceneSpheres.select_kernel(static_cast<simd_level>(level));
+						for (uint32_t i = 0; i < _Scene.Nb(); i++)
+						{
+							if (triangle_mesh* mesh = dynamic_cast<triangle_mesh*>(_Scene[i]))
+								mesh->_Triangles.select_kernel(static_cast<simd_level>(level));
+						}
+
+						AppContext.threadPool.Resume();
+						_need_refresh = true;
+					}
+				}
+				ImGui::EndCombo();
+			}
+
+			//the jobs are only reading the scene, but they would steal time from the benchmark
+			if (ImGui::Button("Run Benchmark"))
+			{
+				AppContext.threadPool.Pause();
+				AppContext.threadPool.WaitIdle();
+				BenchmarkSphereKernels();
+				AppContext.threadPool.Resume();
+			}
+
+			ImGui::Text("%u random rays, ns per ray (hits) :", SPHERE_BENCHMARK_RAY_NB);
+			for (uint32_t i = 0; i < 1 + static_cast<uint32_t>(simd_level::NB); i++)
+			{
+				const char* benchmarkName = i == 0 ? "Virtual hit" : simd_level_name(static_cast<simd_level>(i - 1));
+				if (_sphere_benchmark[i][0] > 0.0f)
+					ImGui::Text("%s : all spheres %.1f (%u), bvh %.1f (%u)", benchmarkName, _sphere_benchmark[i][0], _sphere_benchmark_hits[i][0], _sphere_benchmark[i][1], _sphere_benchmark_hits[i][1]);
+				else
+					ImGui::Text("%s : -", benchmarkName);
+			}
+		}
 
 		//Raytracing Parameters
 		uint32_t previousSampleNb = _rtParams._pixel_sample_nb;
 		ImGuiHelper::RaytracingParamsUI("RaytracingParams", _rtParams, _need_refresh);
 
 
-		//pixel sample nb changed, we need to reallocate our array
+		//pixel sample nb changed, we need to reallocate our array (once no job uses it anymore)
 		if (previousSampleNb != _rtParams._pixel_sample_nb && _need_refresh)
 		{
-			_ComputeBatch.Clear();
-			_ComputeHeap.Clear();
-			_ComputeHeap = MultipleSharedMemory<ray_compute>(_FullScreenScissors.extent.width * _FullScreenScissors.extent.height + _FullScreenScissors.extent.width * _FullScreenScissors.extent.height * _rtParams._pixel_sample_nb);
+			CancelJobs(AppContext.threadPool);
+
+			AllocateComputeHeap();
+
+			AppContext.threadPool.Resume();
 		}
 	}
+
+	//the previous image may only be reused if nothing but the camera changed
+	_camera_refresh	= cameraRefresh && !_need_refresh;
+	_need_refresh	|= cameraRefresh;
 	
 	_is_moving = AppContext.in_camera_mode;
 
+	//sizing the work of this frame from what the workers did on the last one
+	UpdateRayBudget(AppContext);
+	if (_is_moving)
+		UpdatePreviewScale(AppContext);
+
 	//if refresh is needed or requested, we create a new image
 	if (_need_refresh || _is_moving)
 		DispatchSceneRay(AppContext);
-	else//otherwise we try to converge the current image
+	else if (_progressive)//otherwise we add a pass to the current image, once the previous one is done
 	{
-		_batch_fence.lock();
-		for (uint32_t i = 0; i < AppContext.threadPool.GetThreadsNb(); i++)
+		//the left out tiles are not written anymore, so switching the heatmap writes the whole image again
+		if (_progressive_image_dirty && RenderJobsIdle(AppContext.threadPool))
 		{
-			//asking for a Batch for the job to work on with the size user chose
-			uint32_t computeNb			= _compute_per_frames;
-			const RayBatch& computes	= _ComputeBatch.PopBatch(computeNb);
-
-			if (computeNb > 0)
-			{
-				AnyHitRaytraceJob newJob(computes, *this);
-
-				//adding the job and asking for immediate execution
-				AppContext.threadPool.Add(newJob);
-			}
-			else
-				break;
+			ResolveProgressiveImage();
+			_progressive_image_dirty = false;
 		}
-		_batch_fence.unlock();
+
+		NextProgressivePass(AppContext);
 	}
+	else//otherwise we try to converge the current image
+		DispatchPendingRays(AppContext);
 
 	//if we suddenly stop moving, we can start converging, but for that we need a final refresh
-	_need_refresh = _is_moving;
+	_need_refresh	= _is_moving;
+	_camera_refresh = _is_moving;
+
+	//the workers write the new image in the staging memory, for the next frames to show it
+	DispatchDisplayEncode(AppContext.threadPool);
 }
 
 /*==== Show =====*/
@@ -733,20 +1774,24 @@ void RaytraceCPU::Show(GAPIHandle& GAPIHandle)
 		VK_CALL_PRINT(vkBeginCommandBuffer(commandBuffer, &info));
 
 	}
-	//copy CPU Buffer into GPU Buffer
+	//the jobs already wrote the changed tiles in the staging memory : the GPU image of this frame only needs the ones
+	//that changed since the image it got last (it keeps the others)
+	uint32_t rectNb = 0;
+	_Display._copied_pixel_nb = 0;
+	if (_GPULocalImageVersions[GAPIHandle._vk_current_frame] != _Display._version)
 	{
-		void* CPUMap;
-		VK_CALL_PRINT(vkMapMemory(GAPIHandle._VulkanDevice, _ImageCopyMemory, _ImageCopyBufferSize * GAPIHandle._vk_current_frame, _ImageCopyBufferSize, 0, &CPUMap));
-		memcpy(CPUMap, *_RaytracedImage, _ImageCopyBufferSize);
-		vkUnmapMemory(GAPIHandle._VulkanDevice, _ImageCopyMemory);
+		rectNb = _Display.changed_rects(_GPULocalImageVersions[GAPIHandle._vk_current_frame]);
+		_GPULocalImageVersions[GAPIHandle._vk_current_frame] = _Display._version;
 	}
 
-	// copying from staging buffer to image
+	if (rectNb > 0)
 	{
+		_Display.copied();
+
 		// changing the image to allow transfer from buffer
 		VkImageMemoryBarrier barrier{};
 		barrier.sType							= VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		barrier.oldLayout						= VK_IMAGE_LAYOUT_UNDEFINED;//from nothing
+		barrier.oldLayout						= VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;//keeping the tiles we do not copy
 		barrier.newLayout						= VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;//to transfer dest
 		barrier.srcQueueFamilyIndex				= VK_QUEUE_FAMILY_IGNORED;//could use copy queues in the future
 		barrier.dstQueueFamilyIndex				= VK_QUEUE_FAMILY_IGNORED;//could use copy queues in the future
@@ -756,21 +1801,32 @@ void RaytraceCPU::Show(GAPIHandle& GAPIHandle)
 		barrier.subresourceRange.levelCount		= 1;
 		barrier.subresourceRange.baseArrayLayer = 0;
 		barrier.subresourceRange.layerCount		= 1;
-		barrier.srcAccessMask					= 0;// making the image accessible to
+		barrier.srcAccessMask					= VK_ACCESS_SHADER_READ_BIT;// making the image read by the last frame accessible to
 		barrier.dstAccessMask					= VK_ACCESS_TRANSFER_WRITE_BIT;// ... resources during TRANSFER WRITE
 
-		//layout should change when we go from pipeline doing nothing to transfer stage
-		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		//layout should change when we go from pipeline reading the image to transfer stage
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
 
-		//copy the full image
-		VkBufferImageCopy copyRegion{};
-		copyRegion.imageSubresource.aspectMask	= VK_IMAGE_ASPECT_COLOR_BIT;
-		copyRegion.imageSubresource.layerCount	= 1;
-		copyRegion.imageExtent.width			= _FullScreenScissors.extent.width;
-		copyRegion.imageExtent.height			= _FullScreenScissors.extent.height;
-		copyRegion.imageExtent.depth			= 1;
+		//copy the changed tiles, a region for each run of tiles of a row
+		VkDeviceSize pixelSize = display_pixel_size(_Display._format);
+		for (uint32_t i = 0; i < rectNb; i++)
+		{
+			const display_rect& rect = _Display._CopyRects[i];
+
+			VkBufferImageCopy& copyRegion = _ImageCopyRegions[i];
+			copyRegion = VkBufferImageCopy{};
+			copyRegion.bufferOffset					= (static_cast<VkDeviceSize>(rect._y) * _Display._width + rect._x) * pixelSize;
+			copyRegion.bufferRowLength				= _Display._width;//the staging images are the whole screen
+			copyRegion.imageSubresource.aspectMask	= VK_IMAGE_ASPECT_COLOR_BIT;
+			copyRegion.imageSubresource.layerCount	= 1;
+			copyRegion.imageOffset.x				= static_cast<int32_t>(rect._x);
+			copyRegion.imageOffset.y				= static_cast<int32_t>(rect._y);
+			copyRegion.imageExtent.width			= rect._width;
+			copyRegion.imageExtent.height			= rect._height;
+			copyRegion.imageExtent.depth			= 1;
+		}
 
-		vkCmdCopyBufferToImage(commandBuffer, _ImageCopyBuffer[GAPIHandle._vk_current_frame], _GPULocalImageBuffers[GAPIHandle._vk_current_frame], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+		vkCmdCopyBufferToImage(commandBuffer, _ImageCopyBuffer[_Display._front], _GPULocalImageBuffers[GAPIHandle._vk_current_frame], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, rectNb, *_ImageCopyRegions);
 
 		// changing the image to allow read from shader
 		barrier.sType							= VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -841,39 +1897,49 @@ void RaytraceCPU::Show(GAPIHandle& GAPIHandle)
 		//... and submit it straight away
 		result = vkQueueSubmit(GAPIHandle._VulkanQueues[0], 1, &info, nullptr);
 	}
+
+	//the staging images copied in this frame are free again once its fence is waited for, nb frames later
+	_Display._frame++;
 }
 
 /*==== Close =====*/
 
 void RaytraceCPU::Close(GraphicsAPIManager& GAPI)
 {
+	//the jobs writing the staging memory should be done with it before it is unmapped
+	_Display.reset(nullptr, 0, 0, 0, GAPI._nb_vk_frames);
+	if (_ImageCopyMemory != VK_NULL_HANDLE)
+		vkUnmapMemory(GAPI._VulkanDevice, _ImageCopyMemory);
+
 	//clear the fullscreen images buffer
-	VK_CLEAR_ARRAY(_ImageCopyBuffer, GAPI._nb_vk_frames, vkDestroyBuffer, GAPI._VulkanDevice);
+	VK_CLEAR_ARRAY(_ImageCopyBuffer, CPU_DISPLAY_BUFFER_NB, vkDestroyBuffer, GAPI._VulkanDevice);
 	VK_CLEAR_ARRAY(_GPULocalImageViews, GAPI._nb_vk_frames, vkDestroyImageView, GAPI._VulkanDevice);
 	VK_CLEAR_ARRAY(_GPULocalImageBuffers, GAPI._nb_vk_frames, vkDestroyImage, GAPI._VulkanDevice);
 	VK_CLEAR_ARRAY(_FullScreenOutput, GAPI._nb_vk_frames, vkDestroyFramebuffer, GAPI._VulkanDevice);
-	_MappedCPUImage.Clear();
+	_GPULocalImageVersions.Clear();
+	_ImageCopyRegions.Clear();
 	_RaytracedImage.Clear();
+	ClearRayBatches();
 	_ComputeBatch.Clear();
 	_ComputeHeap.Clear();
-
-	for (uint32_t i = 0; i < _Scene.Nb(); i++)
-	{
-		if (_Scene[i] != nullptr)
-			delete _Scene[i];
-	}
-	_Scene.Clear();
-
-	for (uint32_t i = 0; i < _Materials.Nb(); i++)
-	{
-		if (_Materials[i] != nullptr)
-			delete _Materials[i];
-	}
-	_Materials.Clear();
+	_SampleRadiance.Clear();
+	_PixelSampleDoneNb.Clear();
+	_ShadingScratch.Clear();
+	_AccumulatedRadiance.Clear();
+	_AccumulatedLuminanceSq.Clear();
+	_ProgressiveTiles.Clear();
+	_PixelDepth.Clear();
+	_HistoryRadiance.Clear();
+	_HistoryLuminanceSq.Clear();
+	_HistoryDepth.Clear();
+	_Wavefront.clear();
+
+	ClearScene();
 
 	//free the allocated memory for the fullscreen images
 	vkFreeMemory(GAPI._VulkanDevice, _GPULocalImageMemory, nullptr);
 	vkFreeMemory(GAPI._VulkanDevice, _ImageCopyMemory, nullptr);
+	_ImageCopyMemory = VK_NULL_HANDLE;
 
 	//destroy the descriptors associated with the images
 	vkDestroyDescriptorPool(GAPI._VulkanDevice, _GPUImageDescriptorPool, nullptr);
@@ -886,3 +1952,149 @@ void RaytraceCPU::Close(GraphicsAPIManager& GAPI)
 	vkDestroyPipeline(GAPI._VulkanDevice, _FullScreenPipeline, nullptr);
 	vkDestroyRenderPass(GAPI._VulkanDevice, _FullScreenRenderPass, nullptr);
 }
+
+
+/*==== Offline Render =====*/
+
+bool RaytraceCPU::RenderOffline(AppWideContext& AppContext, const OfflineRenderParams& Params)
+{
+	static const char* renderModeNames[static_cast<uint32_t>(CPURenderMode::NB)] = { "ray heap", "tiles", "wavefront" };
+	static const char* sampleSequenceNames[static_cast<uint32_t>(sample_sequence::NB)] = { "white noise", "sobol", "blue noise" };
+
+	/* Setup : the same scene and image as in the window, without any graphics API */
+
+	_FullScreenScissors.extent.width	= Params._width;
+	_FullScreenScissors.extent.height	= Params._height;
+	_rtParams							= Params._rtParams;
+	_render_seed						= Params._seed;
+	_scene_type							= Params._scene_type;
+	_random_sphere_grid					= Params._random_sphere_grid;
+	_model_path							= Params._model_path;
+	_render_mode						= Params._render_mode;
+	_light_sampling						= Params._light_sampling;
+	_sample_sequence					= Params._sample_sequence;
+	_is_moving							= false;
+
+	//adaptive sampling goes through the progressive passes, the samples of the params being the most a pixel gets
+	_progressive						= Params._adaptive;
+	_adaptive							= Params._adaptive;
+	_progressive_target_spp				= _rtParams._pixel_sample_nb;
+	_progressive_noise_threshold		= Params._noise_threshold;
+	_show_sample_heatmap				= Params._sample_heatmap;
+
+	//the scene is made with rand, which we seed so that the scene is always the same
+	srand(Params._seed);
+	ClearScene();
+	GenerateScene(&AppContext.threadPool);
+
+	uint32_t pixelNb = Params._width * Params._height;
+	_RaytracedImage.Alloc(pixelNb);
+	AllocateComputeHeap();
+	if (_progressive)
+	{
+		_AccumulatedRadiance.Alloc(pixelNb);
+		_AccumulatedLuminanceSq.Alloc(pixelNb);
+		_ProgressiveTiles.Alloc(((Params._width + CPU_TILE_SIZE - 1) / CPU_TILE_SIZE) * ((Params._height + CPU_TILE_SIZE - 1) / CPU_TILE_SIZE));
+		_PixelDepth.Alloc(pixelNb);
+		_history_valid = false;
+	}
+
+	printf("CPU raytracer offline render : %ux%u, %u spp, depth %u, seed %u, %s sampling, %s, %u threads\n", Params._width, Params._height,
+		_rtParams._pixel_sample_nb, _rtParams._max_depth, _render_seed, sampleSequenceNames[static_cast<uint32_t>(_sample_sequence)],
+		renderModeNames[static_cast<uint32_t>(_render_mode)], AppContext.threadPool.GetThreadsNb());
+	printf("Scene : %u objects, BVH of %u leaves built in %.3f ms, sphere kernel %s\n", _Scene.Nb(), _SceneBVH._leaf_nb, _SceneBVH._build_time,
+		_use_sphere_soa && _SceneSpheres._nb == _SceneBVH._prim_nb ? simd_level_name(_SceneSpheres._level) : "none");
+
+	/* Render */
+
+	//only counting what this render does
+	uint64_t rayNb, busyNs;
+	_RayThroughput.collect(rayNb, busyNs);
+	AppContext.threadPool.ResetThreadBusyTimes();
+
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	DispatchSceneRay(AppContext);
+
+	//the ray heap needs to be fed, the progressive passes started one after the other, the other modes only need to be waited for
+	//(the pool is asked first, as a job pushes its rays before it is done)
+	while (true)
+	{
+		if (_progressive)
+		{
+			NextProgressivePass(AppContext);
+			if (_progressive_done && AppContext.threadPool.IsIdle())
+				break;
+
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+			continue;
+		}
+
+		if (_render_mode == CPURenderMode::RAY_HEAP)
+			DispatchPendingRays(AppContext);
+
+		if (AppContext.threadPool.IsIdle() && _pending_ray_nb.load() == 0)
+			break;
+
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+
+	if (_progressive)
+		ResolveProgressiveImage();
+
+	float renderTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	_RayThroughput.collect(rayNb, busyNs);
+
+	printf("Render time : %.1f ms\n", renderTime);
+	printf("Rays : %llu, %.3f Mrays/s\n", static_cast<unsigned long long>(rayNb), renderTime > 0.0f ? static_cast<float>(rayNb) / (renderTime * 1000.0f) : 0.0f);
+	if (_progressive)
+		printf("Adaptive sampling : %.1f samples per pixel in %u passes, %.1f%% of uniform sampling\n", static_cast<float>(_progressive_sample_nb) / static_cast<float>(pixelNb),
+			_progressive_pass_nb, 100.0f * static_cast<float>(_progressive_sample_nb) / (static_cast<float>(pixelNb) * static_cast<float>(_progressive_target_spp)));
+	for (uint32_t i = 0; i < AppContext.threadPool.GetThreadsNb(); i++)
+		printf("Thread %u : %.1f%% busy\n", i, renderTime > 0.0f ? static_cast<float>(AppContext.threadPool.GetThreadBusyTime(i)) * 1e-4f / renderTime : 0.0f);
+
+	/* Output */
+
+	bool written = false;
+	size_t pathLength = strlen(Params._output_path);
+	if (pathLength > 4 && strcmp(Params._output_path + pathLength - 4, ".hdr") == 0)
+	{
+		//the radiance as is
+		written = stbi_write_hdr(Params._output_path, Params._width, Params._height, 4, reinterpret_cast<const float*>(*_RaytracedImage)) != 0;
+	}
+	else
+	{
+		//the window shows the image through an sRGB swapchain, so the written image gets the same encoding
+		MultipleScopedMemory<uint8_t> encodedImage(pixelNb * 4);
+		for (uint32_t i = 0; i < pixelNb; i++)
+		{
+			encodedImage[i * 4 + 0] = encode_srgb8(_RaytracedImage[i].x);
+			encodedImage[i * 4 + 1] = encode_srgb8(_RaytracedImage[i].y);
+			encodedImage[i * 4 + 2] = encode_srgb8(_RaytracedImage[i].z);
+			encodedImage[i * 4 + 3] = 255;
+		}
+		written = stbi_write_png(Params._output_path, Params._width, Params._height, 4, *encodedImage, Params._width * 4) != 0;
+	}
+
+	if (written)
+		printf("Image written to %s\n", Params._output_path);
+	else
+		printf("CPU raytracer offline render error : could not write the image to %s\n", Params._output_path);
+
+	//releasing everything, as there is no Close without a graphics API
+	ClearRayBatches();
+	_ComputeBatch.Clear();
+	_ComputeHeap.Clear();
+	_SampleRadiance.Clear();
+	_PixelSampleDoneNb.Clear();
+	_ShadingScratch.Clear();
+	_AccumulatedRadiance.Clear();
+	_AccumulatedLuminanceSq.Clear();
+	_ProgressiveTiles.Clear();
+	_PixelDepth.Clear();
+	_Wavefront.clear();
+	_RaytracedImage.Clear();
+	ClearScene();
+
+	return written;
+}
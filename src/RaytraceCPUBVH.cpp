@@ -0,0 +1,255 @@
+#include "RaytraceCPUBVH.h"
+
+//for build timing
+#include <chrono>
+
+/*===== Build =====*/
+
+/*
+* splits a node of the tree on a thread of the pool
+*/
+class BVHSubdivideJob : public ThreadJob
+{
+private:
+	bvh&		_BVH;
+	uint32_t	_node_index;
+	uint32_t	_depth;
+	bvh_build&	_Build;
+
+public:
+	BVHSubdivideJob(bvh& BVH, uint32_t node_index, uint32_t depth, bvh_build& Build) :
+		_BVH{ BVH },
+		_node_index{ node_index },
+		_depth{ depth },
+		_Build{ Build }
+	{
+	}
+
+	virtual void Execute()override
+	{
+		_BVH.subdivide(_node_index, _depth, _Build);
+	}
+};
+
+void bvh::build(const aabb* prim_bounds, uint32_t prim_nb, ThreadPool* Pool)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	clear();
+
+	if (prim_nb == 0)
+		return;
+
+	_prim_nb = prim_nb;
+
+	//at the start, the primitives are in the order they were given
+	_prim_indices.Alloc(prim_nb);
+	for (uint32_t i = 0; i < prim_nb; i++)
+		_prim_indices[i] = i;
+
+	MultipleScopedMemory<vec3> prim_centroids(prim_nb);
+	for (uint32_t i = 0; i < prim_nb; i++)
+		prim_centroids[i] = prim_bounds[i].centroid();
+
+	//a binary tree with n leaves has 2n - 1 nodes, and we leave one node unused for alignment
+	_nodes.Alloc(2 * prim_nb);
+
+	//the root is all our primitives
+	bvh_node& root = _nodes[0];
+	root.left_first = 0;
+	root.prim_nb	= prim_nb;
+
+	bvh_build build;
+	build._prim_bounds		= prim_bounds;
+	build._prim_centroids	= *prim_centroids;
+	build._node_nb.store(2);
+
+	//a paused pool would never split the nodes we give it
+	if (Pool != nullptr && Pool->GetThreadsNb() > 0 && !Pool->IsPaused() && prim_nb >= BVH_TASK_MIN_PRIM_NB)
+	{
+		build._Pool		= Pool;
+		build._Build	= Pool->CreateGroup();
+	}
+
+	subdivide(0, 1, build);
+
+	//the root is split, the threads may still be working on its children
+	if (build._Pool != nullptr)
+	{
+		Pool->Submit(build._Build);
+		Pool->Wait(build._Build);
+	}
+
+	_node_nb	= build._node_nb.load();
+	_leaf_nb	= build._leaf_nb.load();
+	_depth		= build._depth.load();
+
+	_build_time = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void bvh::subdivide(uint32_t node_index, uint32_t depth, bvh_build& build)
+{
+	const aabb* prim_bounds		= build._prim_bounds;
+	const vec3* prim_centroids	= build._prim_centroids;
+	bvh_node& node				= _nodes[node_index];
+
+	//first compute the bounds of our primitives (and of their centroids, to bin them)
+	aabb node_bounds, centroid_bounds;
+	for (uint32_t i = 0; i < node.prim_nb; i++)
+	{
+		uint32_t prim_index = _prim_indices[node.left_first + i];
+		node_bounds.grow(prim_bounds[prim_index]);
+		centroid_bounds.grow(prim_centroids[prim_index]);
+	}
+	node.min = node_bounds.min;
+	node.max = node_bounds.max;
+
+	uint32_t deepest = build._depth.load();
+	while (depth > deepest && !build._depth.compare_exchange_weak(deepest, depth))
+		;
+
+	//a single primitive, or we cannot go deeper without overflowing the traversal stack
+	if (node.prim_nb <= 1 || depth >= BVH_MAX_DEPTH - 1)
+	{
+		build._leaf_nb.fetch_add(1);
+		return;
+	}
+
+	/* binned SAH : we sort the primitives in bins along each axis, and try to split between each bins */
+
+	//the best split found so far
+	float		best_cost	= FLT_MAX;
+	int32_t		best_axis	= -1;
+	uint32_t	best_split	= 0;
+
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		float axis_min = centroid_bounds.min[axis];
+		float axis_extent = centroid_bounds.max[axis] - axis_min;
+
+		//every centroid is on the same plane, no split possible on this axis
+		if (axis_extent <= 0.0f)
+			continue;
+
+		//fill up the bins
+		aabb		bin_bounds[BVH_SAH_BIN_NB];
+		uint32_t	bin_count[BVH_SAH_BIN_NB] = {};
+		float		bin_scale = static_cast<float>(BVH_SAH_BIN_NB) / axis_extent;
+		for (uint32_t i = 0; i < node.prim_nb; i++)
+		{
+			uint32_t prim_index = _prim_indices[node.left_first + i];
+			uint32_t bin = static_cast<uint32_t>((prim_centroids[prim_index][axis] - axis_min) * bin_scale);
+			bin = bin >= BVH_SAH_BIN_NB ? BVH_SAH_BIN_NB - 1 : bin;
+			bin_count[bin]++;
+			bin_bounds[bin].grow(prim_bounds[prim_index]);
+		}
+
+		//sweep once from the left and once from the right to get the area and count on each side of each split
+		float		left_area[BVH_SAH_BIN_NB - 1], right_area[BVH_SAH_BIN_NB - 1];
+		uint32_t	left_count[BVH_SAH_BIN_NB - 1], right_count[BVH_SAH_BIN_NB - 1];
+		aabb		left_box, right_box;
+		uint32_t	left_sum = 0, right_sum = 0;
+		for (uint32_t i = 0; i < BVH_SAH_BIN_NB - 1; i++)
+		{
+			left_sum += bin_count[i];
+			left_count[i] = left_sum;
+			left_box.grow(bin_bounds[i]);
+			left_area[i] = left_box.surface_area();
+
+			right_sum += bin_count[BVH_SAH_BIN_NB - 1 - i];
+			right_count[BVH_SAH_BIN_NB - 2 - i] = right_sum;
+			right_box.grow(bin_bounds[BVH_SAH_BIN_NB - 1 - i]);
+			right_area[BVH_SAH_BIN_NB - 2 - i] = right_box.surface_area();
+		}
+
+		//the cost of splitting is proportional to the probability of hitting each side times the number of primitives on each side
+		for (uint32_t i = 0; i < BVH_SAH_BIN_NB - 1; i++)
+		{
+			if (left_count[i] == 0 || right_count[i] == 0)
+				continue;
+
+			float cost = left_area[i] * static_cast<float>(left_count[i]) + right_area[i] * static_cast<float>(right_count[i]);
+			if (cost < best_cost)
+			{
+				best_cost	= cost;
+				best_axis	= static_cast<int32_t>(axis);
+				best_split	= i;
+			}
+		}
+	}
+
+	//the cost of not splitting is intersecting every primitive, the cost of splitting is going through two more nodes
+	float node_area = node_bounds.surface_area();
+	float leaf_cost = static_cast<float>(node.prim_nb);
+	float split_cost = node_area > 0.0f ? BVH_TRAVERSAL_COST + best_cost / node_area : FLT_MAX;
+
+	uint32_t first	= node.left_first;
+	uint32_t nb		= node.prim_nb;
+	uint32_t left_nb = 0;
+
+	if (best_axis >= 0 && (split_cost < leaf_cost || nb > BVH_MAX_LEAF_SIZE))
+	{
+		//partition our primitives in place : left of the split at the start of the range, right at the end
+		float axis_min = centroid_bounds.min[best_axis];
+		float bin_scale = static_cast<float>(BVH_SAH_BIN_NB) / (centroid_bounds.max[best_axis] - axis_min);
+		uint32_t i = first;
+		uint32_t j = first + nb;
+		while (i < j)
+		{
+			uint32_t bin = static_cast<uint32_t>((prim_centroids[_prim_indices[i]][best_axis] - axis_min) * bin_scale);
+			bin = bin >= BVH_SAH_BIN_NB ? BVH_SAH_BIN_NB - 1 : bin;
+			if (bin <= best_split)
+				i++;
+			else
+			{
+				uint32_t tmp = _prim_indices[i];
+				_prim_indices[i] = _prim_indices[--j];
+				_prim_indices[j] = tmp;
+			}
+		}
+		left_nb = i - first;
+	}
+	else if (nb > BVH_MAX_LEAF_SIZE)
+	{
+		//every centroid is at the same place : no heuristic can help us, we just cut in half
+		left_nb = nb / 2;
+	}
+	else
+	{
+		//not worth splitting
+		build._leaf_nb.fetch_add(1);
+		return;
+	}
+
+	//creating the siblings next to each other
+	uint32_t left_index = build._node_nb.fetch_add(2);
+
+	_nodes[left_index].left_first		= first;
+	_nodes[left_index].prim_nb			= left_nb;
+	_nodes[left_index + 1].left_first	= first + left_nb;
+	_nodes[left_index + 1].prim_nb		= nb - left_nb;
+
+	//the node is now an inner node (careful, node may not be valid after recursion, as we access by index)
+	node.left_first = left_index;
+	node.prim_nb	= 0;
+
+	//a big enough left child is split by another thread, while we go on with the right one
+	if (build._Pool != nullptr && nb >= BVH_TASK_MIN_PRIM_NB)
+		build._Pool->Submit(build._Pool->CreateTask(BVHSubdivideJob(*this, left_index, depth + 1, build), build._Build));
+	else
+		subdivide(left_index, depth + 1, build);
+	subdivide(left_index + 1, depth + 1, build);
+}
+
+/*===== Clear =====*/
+
+void bvh::clear()
+{
+	_nodes.Clear();
+	_prim_indices.Clear();
+	_node_nb	= 0;
+	_prim_nb	= 0;
+	_leaf_nb	= 0;
+	_depth		= 0;
+	_build_time = 0.0f;
+}
@@ -0,0 +1,179 @@
+#include "RaytraceCPUDisplay.h"
+
+//to wait for the jobs writing
+#include <thread>
+
+/*===== Format =====*/
+
+const char* display_format_name(display_format format)
+{
+	switch (format)
+	{
+		case display_format::RGBA8:		return "RGBA8 sRGB";
+		case display_format::RGBA16F:	return "RGBA16F";
+		default:						return "Unknown";
+	}
+}
+
+/*===== Staging =====*/
+
+void display_staging::reset(uint8_t* mapped, size_t image_size, uint32_t width, uint32_t height, uint32_t frame_nb)
+{
+	cancel();
+
+	_mapped		= mapped;
+	_image_size = image_size;
+	_width		= width;
+	_height		= height;
+	_frame_nb	= frame_nb;
+	_tile_nb_x	= (width + CPU_DISPLAY_TILE_SIZE - 1) / CPU_DISPLAY_TILE_SIZE;
+	_tile_nb_y	= (height + CPU_DISPLAY_TILE_SIZE - 1) / CPU_DISPLAY_TILE_SIZE;
+
+	//a black image is shown until the first one is written, so that every GPU image gets something
+	if (_mapped != nullptr)
+		memset(_mapped, 0, _image_size * CPU_DISPLAY_BUFFER_NB);
+	_front = 0;
+	_version++;
+	for (uint32_t i = 0; i < CPU_DISPLAY_BUFFER_NB; i++)
+	{
+		_free_frame[i]		= 0;
+		_image_version[i]	= _version;
+	}
+
+	//every tile changed in this version, for the GPU images to get the black image
+	_TileChanged.Clear();
+	_TileVersion.Clear();
+	_CopyRects.Clear();
+	if (tile_nb() == 0)
+		return;
+
+	_TileChanged.Alloc(tile_nb());
+	_TileVersion.Alloc(tile_nb());
+	_CopyRects.Alloc(tile_nb());
+	for (uint32_t i = 0; i < tile_nb(); i++)
+	{
+		_TileChanged[i].store(0);
+		_TileVersion[i] = _version;
+	}
+}
+
+void display_staging::cancel()
+{
+	_epoch.fetch_add(1);
+
+	//a job that started writing before seeing the new epoch still needs the memory
+	while (_writing_job_nb.load() > 0)
+		std::this_thread::yield();
+
+	//the tiles of the back image that were being written still have a version it does not hold
+	_pending_job_nb.store(0);
+	_encoding = false;
+}
+
+bool display_staging::collect(uint32_t version)
+{
+	uint32_t backVersion	= _image_version[_front ^ 1];
+	bool needsWrite			= false;
+
+	for (uint32_t i = 0; i < tile_nb(); i++)
+	{
+		if (_TileChanged[i].exchange(0) != 0)
+			_TileVersion[i] = version;
+
+		//the back image is two versions behind, so it also misses what changed in the front one
+		needsWrite |= _TileVersion[i] > backVersion;
+	}
+
+	return needsWrite;
+}
+
+void display_staging::encode_tile_row(const vec4* image, uint8_t* to, uint32_t tile_y, uint32_t since)const
+{
+	uint32_t firstY = tile_y * CPU_DISPLAY_TILE_SIZE;
+	uint32_t endY	= firstY + CPU_DISPLAY_TILE_SIZE < _height ? firstY + CPU_DISPLAY_TILE_SIZE : _height;
+
+	for (uint32_t tileX = 0; tileX < _tile_nb_x; tileX++)
+	{
+		if (!tile_changed(tile_y * _tile_nb_x + tileX, since))
+			continue;
+
+		uint32_t firstX = tileX * CPU_DISPLAY_TILE_SIZE;
+		uint32_t endX	= firstX + CPU_DISPLAY_TILE_SIZE < _width ? firstX + CPU_DISPLAY_TILE_SIZE : _width;
+
+		for (uint32_t y = firstY; y < endY; y++)
+		{
+			uint32_t first	= y * _width + firstX;
+			uint32_t end	= y * _width + endX;
+
+			if (_format == display_format::RGBA8)
+			{
+				//the screen only shows [0,1], what is over is clamped as it would be when drawn
+				uint8_t* pixels = to + static_cast<size_t>(first) * 4;
+				for (uint32_t i = first; i < end; i++, pixels += 4)
+				{
+					pixels[0] = encode_srgb8(image[i].x);
+					pixels[1] = encode_srgb8(image[i].y);
+					pixels[2] = encode_srgb8(image[i].z);
+					pixels[3] = 255;
+				}
+			}
+			else
+			{
+				uint16_t* pixels = reinterpret_cast<uint16_t*>(to) + static_cast<size_t>(first) * 4;
+				for (uint32_t i = first; i < end; i++, pixels += 4)
+				{
+					pixels[0] = float_to_half(image[i].x);
+					pixels[1] = float_to_half(image[i].y);
+					pixels[2] = float_to_half(image[i].z);
+					pixels[3] = 0x3c00;//1.0
+				}
+			}
+		}
+	}
+}
+
+bool display_staging::publish()
+{
+	if (!_encoding || _pending_job_nb.load() > 0)
+		return false;
+
+	_front ^= 1;
+	_version++;
+	_image_version[_front]	= _version;
+	_encoding				= false;
+	return true;
+}
+
+uint32_t display_staging::changed_rects(uint32_t since)
+{
+	uint32_t rectNb		= 0;
+	_copied_pixel_nb	= 0;
+
+	for (uint32_t tileY = 0; tileY < _tile_nb_y; tileY++)
+	{
+		uint32_t y		= tileY * CPU_DISPLAY_TILE_SIZE;
+		uint32_t height	= y + CPU_DISPLAY_TILE_SIZE < _height ? CPU_DISPLAY_TILE_SIZE : _height - y;
+
+		for (uint32_t tileX = 0; tileX < _tile_nb_x; tileX++)
+		{
+			//only the changes that are shown : a tile being written in the back image is copied once it is the front one
+			uint32_t tileVersion = _TileVersion[tileY * _tile_nb_x + tileX];
+			if (tileVersion <= since || tileVersion > _version)
+				continue;
+
+			uint32_t x		= tileX * CPU_DISPLAY_TILE_SIZE;
+			uint32_t width	= x + CPU_DISPLAY_TILE_SIZE < _width ? CPU_DISPLAY_TILE_SIZE : _width - x;
+
+			//the tile goes on the previous one's rect if they are next to each other
+			display_rect& previous = _CopyRects[rectNb > 0 ? rectNb - 1 : 0];
+			if (rectNb > 0 && previous._y == y && previous._x + previous._width == x)
+				previous._width += width;
+			else
+				_CopyRects[rectNb++] = display_rect{ x, y, width, height };
+
+			_copied_pixel_nb += width * height;
+		}
+	}
+
+	return rectNb;
+}
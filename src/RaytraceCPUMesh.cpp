@@ -0,0 +1,400 @@
+#include "RaytraceCPUMesh.h"
+
+//for the materials and HIT_EPSILON
+#include "RaytraceCPUHelper.inl"
+
+//for the cornell box's vertices
+#include "CornellBox.h"
+
+//loader include (the implementation is compiled with the GPU loader)
+#define TINYGLTF_USE_RAPIDJSON
+#include "tiny_gltf.h"
+
+/*===== Triangle Mesh =====*/
+
+void triangle_mesh::alloc(uint32_t vertex_nb, uint32_t triangle_nb, uint32_t material_nb, bool has_normals)
+{
+	clear();
+
+	_vertex_nb		= vertex_nb;
+	_triangle_nb	= triangle_nb;
+	_has_normals	= has_normals;
+
+	_pos_x.Alloc(vertex_nb);
+	_pos_y.Alloc(vertex_nb);
+	_pos_z.Alloc(vertex_nb);
+	if (has_normals)
+	{
+		_normal_x.Alloc(vertex_nb);
+		_normal_y.Alloc(vertex_nb);
+		_normal_z.Alloc(vertex_nb);
+	}
+
+	_indices.Alloc(triangle_nb * 3);
+	_material_id.Alloc(triangle_nb);
+	ZERO_SET(_material_id, triangle_nb * sizeof(uint32_t));
+
+	_materials.Alloc(material_nb);
+	ZERO_SET(_materials, material_nb * sizeof(material*));
+}
+
+void triangle_mesh::clear()
+{
+	for (uint32_t i = 0; i < _materials.Nb(); i++)
+	{
+		if (_materials[i] != nullptr)
+			delete _materials[i];
+	}
+	_materials.Clear();
+
+	_pos_x.Clear();
+	_pos_y.Clear();
+	_pos_z.Clear();
+	_normal_x.Clear();
+	_normal_y.Clear();
+	_normal_z.Clear();
+	_indices.Clear();
+	_material_id.Clear();
+	_BVH.clear();
+	_Triangles.clear();
+
+	_vertex_nb		= 0;
+	_triangle_nb	= 0;
+	_has_normals	= false;
+	_bounds			= aabb{};
+}
+
+void triangle_mesh::fit(const vec3& base, float height)
+{
+	aabb box;
+	for (uint32_t i = 0; i < _vertex_nb; i++)
+		box.grow(get_vertex(i));
+
+	//a flat mesh keeps its size
+	float box_height	= box.max.y - box.min.y;
+	float scale			= box_height > 0.0f ? height / box_height : 1.0f;
+	vec3 box_base{ (box.min.x + box.max.x) * 0.5f, box.min.y, (box.min.z + box.max.z) * 0.5f };
+
+	//the scale is the same on every axis, so the normals do not change
+	for (uint32_t i = 0; i < _vertex_nb; i++)
+		set_vertex(i, (get_vertex(i) - box_base) * scale + base);
+}
+
+void triangle_mesh::build(ThreadPool* Pool)
+{
+	_bounds = aabb{};
+	for (uint32_t i = 0; i < _vertex_nb; i++)
+		_bounds.grow(get_vertex(i));
+
+	//the bvh only needs the bounds of our triangles
+	MultipleScopedMemory<aabb> triangleBounds(_triangle_nb);
+	for (uint32_t i = 0; i < _triangle_nb; i++)
+	{
+		aabb box;
+		box.grow(get_vertex(_indices[i * 3 + 0]));
+		box.grow(get_vertex(_indices[i * 3 + 1]));
+		box.grow(get_vertex(_indices[i * 3 + 2]));
+		triangleBounds[i] = box;
+	}
+
+	_BVH.build(*triangleBounds, _triangle_nb, Pool);
+
+	//copying the triangles in the order of the leaves, so that the kernels can go through a leaf without indirection
+	_Triangles.alloc(_BVH._prim_nb);
+	for (uint32_t i = 0; i < _BVH._prim_nb; i++)
+	{
+		uint32_t triangle = _BVH._prim_indices[i];
+		_Triangles.set(i, get_vertex(_indices[triangle * 3 + 0]), get_vertex(_indices[triangle * 3 + 1]), get_vertex(_indices[triangle * 3 + 2]), triangle);
+	}
+}
+
+bool triangle_mesh::hit(const ray& incomming, hit_record& record)const
+{
+	//the triangles are stored in leaf order, so a leaf is a contiguous range we can test all at once
+	float distance		= FLT_MAX;
+	uint32_t leafIndex	= 0;
+	auto leaf_hit = [this, &incomming, &leafIndex](uint32_t first, uint32_t nb, float& closest)
+	{
+		return _Triangles.hit(incomming, first, nb, closest, leafIndex);
+	};
+
+	if (!_BVH.closest_hit(incomming, distance, leaf_hit))
+		return false;
+
+	//we only fill up the record for the closest triangle
+	uint32_t triangle	= _Triangles._triangle_id[leafIndex];
+	record.distance		= distance;
+	record.hit_point	= incomming.at(distance);
+	record.mat			= _materials[_material_id[triangle]];
+
+	if (_has_normals)
+	{
+		//the normal is smoothed over the triangle from the normal of each vertex
+		float u, v;
+		_Triangles.barycentrics(incomming, leafIndex, u, v);
+		vec3 normal = get_normal(_indices[triangle * 3 + 0]) * (1.0f - u - v) + get_normal(_indices[triangle * 3 + 1]) * u + get_normal(_indices[triangle * 3 + 2]) * v;
+		record.hit_normal = normalize(normal);
+	}
+	else
+		record.hit_normal = _Triangles.face_normal(leafIndex);
+
+	//the shade is only computed for the closest hit, once it is known (see shading)
+	return true;
+}
+
+bool triangle_mesh::any_hit(const ray& incomming, float max_distance)const
+{
+	uint32_t leafIndex = 0;
+	auto leaf_hit = [this, &incomming, &leafIndex](uint32_t first, uint32_t nb, float& closest)
+	{
+		return _Triangles.hit(incomming, first, nb, closest, leafIndex);
+	};
+
+	return _BVH.any_hit(incomming, max_distance, leaf_hit);
+}
+
+/*===== glTF =====*/
+
+//gives out where the data of the accessor starts, and the number of bytes from an element to the next
+static const uint8_t* GetAccessorData(const tinygltf::Model& model, const tinygltf::Accessor& accessor, uint32_t& stride)
+{
+	const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
+	stride = static_cast<uint32_t>(accessor.ByteStride(bufferView));
+	return model.buffers[bufferView.buffer].data.data() + bufferView.byteOffset + accessor.byteOffset;
+}
+
+//gives out the float vector at i of an accessor
+static vec3 GetVec3(const uint8_t* data, uint32_t stride, uint32_t i)
+{
+	const float* element = reinterpret_cast<const float*>(data + i * stride);
+	return vec3{ element[0], element[1], element[2] };
+}
+
+//gives out the index at i of an index accessor, whatever its integer type
+static uint32_t GetIndex(const uint8_t* data, uint32_t stride, int component_type, uint32_t i)
+{
+	switch (component_type)
+	{
+		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:		return *(data + i * stride);
+		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:	return *reinterpret_cast<const uint16_t*>(data + i * stride);
+		default:										return *reinterpret_cast<const uint32_t*>(data + i * stride);
+	}
+}
+
+//whether the primitive is made of triangles with positions we can read
+static bool IsTrianglePrimitive(const tinygltf::Model& model, const tinygltf::Primitive& primitive)
+{
+	std::map<std::string, int>::const_iterator position = primitive.attributes.find("POSITION");
+	if ((primitive.mode != -1 && primitive.mode != TINYGLTF_MODE_TRIANGLES) || position == primitive.attributes.end())
+		return false;
+
+	const tinygltf::Accessor& accessor = model.accessors[position->second];
+	return accessor.bufferView >= 0 && accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT && accessor.type == TINYGLTF_TYPE_VEC3;
+}
+
+//gives out the meshes used by the node and its children
+static void GatherNodeMeshes(const tinygltf::Model& model, int node_index, VolatileLoopArray<uint32_t>& mesh_use)
+{
+	const tinygltf::Node& node = model.nodes[node_index];
+	if (node.mesh >= 0)
+		mesh_use[node.mesh]++;
+
+	for (uint32_t i = 0; i < node.children.size(); i++)
+		GatherNodeMeshes(model, node.children[i], mesh_use);
+}
+
+//makes a material close to the glTF one : metal if it is mostly metallic, diffuse otherwise
+static material* CreateGLTFMaterial(const tinygltf::Model& model, const tinygltf::Material& gltfMaterial)
+{
+	const tinygltf::PbrMetallicRoughness& pbr = gltfMaterial.pbrMetallicRoughness;
+	vec4 color{ static_cast<float>(pbr.baseColorFactor[0]), static_cast<float>(pbr.baseColorFactor[1]), static_cast<float>(pbr.baseColorFactor[2]), 1.0f };
+
+	//we do not read textures when tracing, so a textured material gets the average of its texture
+	if (pbr.baseColorTexture.index >= 0 && model.textures[pbr.baseColorTexture.index].source >= 0)
+	{
+		const tinygltf::Image& image = model.images[model.textures[pbr.baseColorTexture.index].source];
+		if (image.bits == 8 && image.component >= 3 && image.width > 0 && image.height > 0)
+		{
+			vec3 sum{ 0.0f, 0.0f, 0.0f };
+			uint32_t pixelNb = static_cast<uint32_t>(image.width * image.height);
+			for (uint32_t i = 0; i < pixelNb; i++)
+			{
+				const unsigned char* pixel = &image.image[i * image.component];
+
+				//textures are sRGB, the average is done on the actual light
+				sum = sum + vec3{ powf(pixel[0] / 255.0f, 2.2f), powf(pixel[1] / 255.0f, 2.2f), powf(pixel[2] / 255.0f, 2.2f) };
+			}
+			sum = sum / static_cast<float>(pixelNb);
+			color = vec4{ color.x * sum.x, color.y * sum.y, color.z * sum.z, 1.0f };
+		}
+	}
+
+	if (pbr.metallicFactor >= 0.5)
+		return new metal(color);
+	return new diffuse(color);
+}
+
+bool load_gltf_mesh(const char* file_name, triangle_mesh& mesh)
+{
+	tinygltf::TinyGLTF loader;
+	tinygltf::Model loadedModel;
+	std::string err;
+	std::string warnings;
+
+	//first load model
+	if (!loader.LoadASCIIFromFile(&loadedModel, &err, &warnings, file_name))
+	{
+		printf("error when reading %s :\nerror : %s\nwarning : %s", file_name, err.c_str(), warnings.c_str());
+		return false;
+	}
+
+	//1. finding which meshes the default scene uses, and how many times (the nodes' transforms are not applied)
+	VolatileLoopArray<uint32_t> meshUse(static_cast<uint32_t>(loadedModel.meshes.size()));
+	ZERO_SET(meshUse, meshUse.Nb() * sizeof(uint32_t));
+	if (!loadedModel.scenes.empty())
+	{
+		const tinygltf::Scene& scene = loadedModel.scenes[loadedModel.defaultScene >= 0 ? loadedModel.defaultScene : 0];
+		for (uint32_t i = 0; i < scene.nodes.size(); i++)
+			GatherNodeMeshes(loadedModel, scene.nodes[i], meshUse);
+	}
+
+	//2. counting the vertices and triangles of every primitive we can trace
+	uint32_t vertexNb	= 0;
+	uint32_t triangleNb = 0;
+	bool hasNormals		= true;
+	for (uint32_t i = 0; i < meshUse.Nb(); i++)
+	{
+		if (meshUse[i] == 0)
+			continue;
+
+		const tinygltf::Mesh& gltfMesh = loadedModel.meshes[i];
+		for (uint32_t j = 0; j < gltfMesh.primitives.size(); j++)
+		{
+			const tinygltf::Primitive& primitive = gltfMesh.primitives[j];
+			if (!IsTrianglePrimitive(loadedModel, primitive))
+				continue;
+
+			uint32_t primitiveVertexNb = static_cast<uint32_t>(loadedModel.accessors[primitive.attributes.at("POSITION")].count);
+			vertexNb	+= primitiveVertexNb;
+			triangleNb	+= static_cast<uint32_t>(primitive.indices >= 0 ? loadedModel.accessors[primitive.indices].count : primitiveVertexNb) / 3;
+			hasNormals	&= primitive.attributes.count("NORMAL") > 0;
+		}
+	}
+
+	if (triangleNb == 0)
+	{
+		meshUse.Clear();
+		printf("error when reading %s : no triangles to trace.\n", file_name);
+		return false;
+	}
+
+	//one more material for the primitives without any
+	uint32_t defaultMaterial = static_cast<uint32_t>(loadedModel.materials.size());
+	mesh.alloc(vertexNb, triangleNb, defaultMaterial + 1, hasNormals);
+	for (uint32_t i = 0; i < defaultMaterial; i++)
+		mesh._materials[i] = CreateGLTFMaterial(loadedModel, loadedModel.materials[i]);
+	mesh._materials[defaultMaterial] = new diffuse(vec4{ 0.8f, 0.8f, 0.8f, 1.0f });
+
+	//3. copying the primitives' vertices and indices, one after the other
+	uint32_t vertexOffset	= 0;
+	uint32_t triangleOffset = 0;
+	for (uint32_t i = 0; i < meshUse.Nb(); i++)
+	{
+		if (meshUse[i] == 0)
+			continue;
+
+		const tinygltf::Mesh& gltfMesh = loadedModel.meshes[i];
+		for (uint32_t j = 0; j < gltfMesh.primitives.size(); j++)
+		{
+			const tinygltf::Primitive& primitive = gltfMesh.primitives[j];
+			if (!IsTrianglePrimitive(loadedModel, primitive))
+				continue;
+
+			//position
+			const tinygltf::Accessor& posAccessor = loadedModel.accessors[primitive.attributes.at("POSITION")];
+			uint32_t posStride;
+			const uint8_t* posData = GetAccessorData(loadedModel, posAccessor, posStride);
+			uint32_t primitiveVertexNb = static_cast<uint32_t>(posAccessor.count);
+			for (uint32_t k = 0; k < primitiveVertexNb; k++)
+				mesh.set_vertex(vertexOffset + k, GetVec3(posData, posStride, k));
+
+			//normals
+			if (hasNormals)
+			{
+				const tinygltf::Accessor& normalAccessor = loadedModel.accessors[primitive.attributes.at("NORMAL")];
+				uint32_t normalStride;
+				const uint8_t* normalData = GetAccessorData(loadedModel, normalAccessor, normalStride);
+				for (uint32_t k = 0; k < primitiveVertexNb; k++)
+					mesh.set_normal(vertexOffset + k, GetVec3(normalData, normalStride, k));
+			}
+
+			//indices (a primitive without indices uses its vertices in order)
+			uint32_t primitiveTriangleNb;
+			if (primitive.indices >= 0)
+			{
+				const tinygltf::Accessor& indexAccessor = loadedModel.accessors[primitive.indices];
+				uint32_t indexStride;
+				const uint8_t* indexData = GetAccessorData(loadedModel, indexAccessor, indexStride);
+				primitiveTriangleNb = static_cast<uint32_t>(indexAccessor.count) / 3;
+				for (uint32_t k = 0; k < primitiveTriangleNb * 3; k++)
+					mesh._indices[triangleOffset * 3 + k] = vertexOffset + GetIndex(indexData, indexStride, indexAccessor.componentType, k);
+			}
+			else
+			{
+				primitiveTriangleNb = primitiveVertexNb / 3;
+				for (uint32_t k = 0; k < primitiveTriangleNb * 3; k++)
+					mesh._indices[triangleOffset * 3 + k] = vertexOffset + k;
+			}
+
+			uint32_t materialId = primitive.material >= 0 ? static_cast<uint32_t>(primitive.material) : defaultMaterial;
+			for (uint32_t k = 0; k < primitiveTriangleNb; k++)
+				mesh._material_id[triangleOffset + k] = materialId;
+
+			vertexOffset	+= primitiveVertexNb;
+			triangleOffset	+= primitiveTriangleNb;
+		}
+	}
+
+	meshUse.Clear();
+	return true;
+}
+
+/*===== Cornell Box =====*/
+
+void create_cornell_box_mesh(float scale, triangle_mesh& mesh)
+{
+	//all the raw vertices info
+	VolatileLoopArray<vec3>		pos;
+	VolatileLoopArray<vec2>		uv;
+	VolatileLoopArray<vec3>		normal;
+	VolatileLoopArray<vec4>		vertexColor;
+	VolatileLoopArray<uint32_t> indices;
+
+	//fill the raw vertices array with the info
+	CornellBox::CreateMesh(scale, pos, uv, normal, vertexColor, indices);
+
+	mesh.alloc(pos.Nb(), indices.Nb() / 3, vertexColor.Nb(), true);
+	for (uint32_t i = 0; i < pos.Nb(); i++)
+	{
+		mesh.set_vertex(i, pos[i]);
+		mesh.set_normal(i, normal[i]);
+	}
+	for (uint32_t i = 0; i < indices.Nb(); i++)
+		mesh._indices[i] = indices[i];
+
+	//the colors are a "1D texture" the uv's x reads from
+	for (uint32_t i = 0; i < vertexColor.Nb(); i++)
+		mesh._materials[i] = new diffuse(vec4{ vertexColor[i].x, vertexColor[i].y, vertexColor[i].z, 1.0f });
+	for (uint32_t i = 0; i < mesh._triangle_nb; i++)
+	{
+		uint32_t colorIndex = static_cast<uint32_t>(uv[indices[i * 3]].x * static_cast<float>(vertexColor.Nb()));
+		mesh._material_id[i] = colorIndex < vertexColor.Nb() ? colorIndex : vertexColor.Nb() - 1;
+	}
+
+	//clear out
+	pos.Clear();
+	uv.Clear();
+	normal.Clear();
+	vertexColor.Clear();
+	indices.Clear();
+}
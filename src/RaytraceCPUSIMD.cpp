@@ -0,0 +1,611 @@
+#include "RaytraceCPUSIMD.h"
+
+//for HIT_EPSILON
+#include "RaytraceCPUHelper.inl"
+
+//the SSE and AVX2 kernels only exist on x86, other platforms use the scalar one
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define RAYTRACE_CPU_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+//msvc lets us use any intrinsics without compiler flags
+#define TARGET_SSE2
+#define TARGET_AVX2
+#else
+//gcc and clang need to be told a function may use those, as we do not compile the whole project for it
+//(SSE2 is always there on x64, but not on 32 bits x86)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+/*===== Runtime Dispatch =====*/
+
+simd_level detect_simd_level()
+{
+#ifdef RAYTRACE_CPU_X86
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	int max_leaf = info[0];
+
+	if (max_leaf >= 7)
+	{
+		__cpuid(info, 1);
+		//the OS must save the AVX registers on context switch for us to use them
+		bool os_saves_registers = (info[2] & (1 << 27)) != 0;
+		bool has_avx			= (info[2] & (1 << 28)) != 0;
+
+		__cpuidex(info, 7, 0);
+		bool has_avx2 = (info[1] & (1 << 5)) != 0;
+
+		if (os_saves_registers && has_avx && has_avx2 && (_xgetbv(0) & 0x6) == 0x6)
+			return simd_level::AVX2;
+	}
+
+	//every x86 CPU able to run vulkan supports SSE2
+	return simd_level::SSE;
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return simd_level::AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return simd_level::SSE;
+	return simd_level::SCALAR;
+#endif
+#else
+	return simd_level::SCALAR;
+#endif
+}
+
+const char* simd_level_name(simd_level level)
+{
+	switch (level)
+	{
+		case simd_level::SCALAR:	return "Scalar";
+		case simd_level::SSE:		return "SSE (4-wide)";
+		case simd_level::AVX2:		return "AVX2 (8-wide)";
+		default:					return "Unknown";
+	}
+}
+
+/*===== Kernels =====*/
+
+/*
+* every kernel solves the same quadratic equation as sphere::hit, on multiple spheres at once.
+* as ray directions are normalized, a == 1 and is left out.
+*/
+
+static bool hit_scalar(const sphere_soa& spheres, const ray& incoming, uint32_t first, uint32_t nb, float& closest, uint32_t& hit_index)
+{
+	bool has_hit = false;
+	for (uint32_t i = first; i < first + nb; i++)
+	{
+		float ocx = spheres._center_x[i] - incoming.origin.x;
+		float ocy = spheres._center_y[i] - incoming.origin.y;
+		float ocz = spheres._center_z[i] - incoming.origin.z;
+
+		float h = incoming.direction.x * ocx + incoming.direction.y * ocy + incoming.direction.z * ocz;
+		float c = (ocx * ocx + ocy * ocy + ocz * ocz) - (spheres._radius[i] * spheres._radius[i]);
+		float discriminant = (h * h) - c;
+
+		if (discriminant <= 0.0f)
+			continue;
+
+		float sqrt_discriminant = sqrtf(discriminant);
+
+		//the closest root in front of the ray's origin
+		float distance = h - sqrt_discriminant;
+		distance = distance < HIT_EPSILON ? h + sqrt_discriminant : distance;
+
+		if (distance >= HIT_EPSILON && distance < closest)
+		{
+			closest		= distance;
+			hit_index	= i;
+			has_hit		= true;
+		}
+	}
+
+	return has_hit;
+}
+
+#ifdef RAYTRACE_CPU_X86
+
+//keeps a where mask is set, b otherwise (SSE4.1 has blendv, but SSE2 does not)
+TARGET_SSE2 static __forceinline __m128 select_sse(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+TARGET_SSE2 static bool hit_sse(const sphere_soa& spheres, const ray& incoming, uint32_t first, uint32_t nb, float& closest, uint32_t& hit_index)
+{
+	const __m128 origin_x	= _mm_set1_ps(incoming.origin.x);
+	const __m128 origin_y	= _mm_set1_ps(incoming.origin.y);
+	const __m128 origin_z	= _mm_set1_ps(incoming.origin.z);
+	const __m128 dir_x		= _mm_set1_ps(incoming.direction.x);
+	const __m128 dir_y		= _mm_set1_ps(incoming.direction.y);
+	const __m128 dir_z		= _mm_set1_ps(incoming.direction.z);
+	const __m128 epsilon	= _mm_set1_ps(HIT_EPSILON);
+	const __m128 zero		= _mm_setzero_ps();
+
+	//the lanes after the end of the range are not spheres we were asked to test (though they are allocated)
+	const __m128i lane_offsets	= _mm_setr_epi32(0, 1, 2, 3);
+	const __m128i end			= _mm_set1_epi32(static_cast<int32_t>(first + nb));
+
+	//the closest hit found by each lane
+	__m128	best_distance	= _mm_set1_ps(closest);
+	__m128i	best_index		= _mm_set1_epi32(-1);
+
+	for (uint32_t i = first; i < first + nb; i += 4)
+	{
+		__m128i index	= _mm_add_epi32(_mm_set1_epi32(static_cast<int32_t>(i)), lane_offsets);
+		__m128	in_range = _mm_castsi128_ps(_mm_cmplt_epi32(index, end));
+
+		//a leaf can start anywhere in the arrays, so loads are unaligned
+		__m128 ocx		= _mm_sub_ps(_mm_loadu_ps(&spheres._center_x[i]), origin_x);
+		__m128 ocy		= _mm_sub_ps(_mm_loadu_ps(&spheres._center_y[i]), origin_y);
+		__m128 ocz		= _mm_sub_ps(_mm_loadu_ps(&spheres._center_z[i]), origin_z);
+		__m128 radius	= _mm_loadu_ps(&spheres._radius[i]);
+
+		__m128 h = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dir_x, ocx), _mm_mul_ps(dir_y, ocy)), _mm_mul_ps(dir_z, ocz));
+		__m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)), _mm_mul_ps(ocz, ocz)), _mm_mul_ps(radius, radius));
+		__m128 discriminant = _mm_sub_ps(_mm_mul_ps(h, h), c);
+
+		__m128 has_root				= _mm_cmpgt_ps(discriminant, zero);
+		__m128 sqrt_discriminant	= _mm_sqrt_ps(_mm_max_ps(discriminant, zero));
+
+		//the closest root in front of the ray's origin
+		__m128 near_root	= _mm_sub_ps(h, sqrt_discriminant);
+		__m128 far_root		= _mm_add_ps(h, sqrt_discriminant);
+		__m128 distance		= select_sse(_mm_cmpge_ps(near_root, epsilon), near_root, far_root);
+
+		__m128 closer = _mm_and_ps(_mm_and_ps(has_root, in_range), _mm_and_ps(_mm_cmpge_ps(distance, epsilon), _mm_cmplt_ps(distance, best_distance)));
+
+		best_distance	= select_sse(closer, distance, best_distance);
+		best_index		= _mm_castps_si128(select_sse(closer, _mm_castsi128_ps(index), _mm_castsi128_ps(best_index)));
+	}
+
+	//reducing the lanes to the closest hit
+	alignas(16) float		lane_distance[4];
+	alignas(16) int32_t		lane_index[4];
+	_mm_store_ps(lane_distance, best_distance);
+	_mm_store_si128(reinterpret_cast<__m128i*>(lane_index), best_index);
+
+	bool has_hit = false;
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		if (lane_index[i] >= 0 && lane_distance[i] < closest)
+		{
+			closest		= lane_distance[i];
+			hit_index	= static_cast<uint32_t>(lane_index[i]);
+			has_hit		= true;
+		}
+	}
+
+	return has_hit;
+}
+
+TARGET_AVX2 static bool hit_avx2(const sphere_soa& spheres, const ray& incoming, uint32_t first, uint32_t nb, float& closest, uint32_t& hit_index)
+{
+	const __m256 origin_x	= _mm256_set1_ps(incoming.origin.x);
+	const __m256 origin_y	= _mm256_set1_ps(incoming.origin.y);
+	const __m256 origin_z	= _mm256_set1_ps(incoming.origin.z);
+	const __m256 dir_x		= _mm256_set1_ps(incoming.direction.x);
+	const __m256 dir_y		= _mm256_set1_ps(incoming.direction.y);
+	const __m256 dir_z		= _mm256_set1_ps(incoming.direction.z);
+	const __m256 epsilon	= _mm256_set1_ps(HIT_EPSILON);
+	const __m256 zero		= _mm256_setzero_ps();
+
+	//the lanes after the end of the range are not spheres we were asked to test (though they are allocated)
+	const __m256i lane_offsets	= _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256i end			= _mm256_set1_epi32(static_cast<int32_t>(first + nb));
+
+	//the closest hit found by each lane
+	__m256	best_distance	= _mm256_set1_ps(closest);
+	__m256i	best_index		= _mm256_set1_epi32(-1);
+
+	for (uint32_t i = first; i < first + nb; i += 8)
+	{
+		__m256i index		= _mm256_add_epi32(_mm256_set1_epi32(static_cast<int32_t>(i)), lane_offsets);
+		__m256	in_range	= _mm256_castsi256_ps(_mm256_cmpgt_epi32(end, index));
+
+		//a leaf can start anywhere in the arrays, so loads are unaligned
+		__m256 ocx		= _mm256_sub_ps(_mm256_loadu_ps(&spheres._center_x[i]), origin_x);
+		__m256 ocy		= _mm256_sub_ps(_mm256_loadu_ps(&spheres._center_y[i]), origin_y);
+		__m256 ocz		= _mm256_sub_ps(_mm256_loadu_ps(&spheres._center_z[i]), origin_z);
+		__m256 radius	= _mm256_loadu_ps(&spheres._radius[i]);
+
+		__m256 h = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dir_x, ocx), _mm256_mul_ps(dir_y, ocy)), _mm256_mul_ps(dir_z, ocz));
+		__m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_mul_ps(ocy, ocy)), _mm256_mul_ps(ocz, ocz)), _mm256_mul_ps(radius, radius));
+		__m256 discriminant = _mm256_sub_ps(_mm256_mul_ps(h, h), c);
+
+		__m256 has_root				= _mm256_cmp_ps(discriminant, zero, _CMP_GT_OQ);
+		__m256 sqrt_discriminant	= _mm256_sqrt_ps(_mm256_max_ps(discriminant, zero));
+
+		//the closest root in front of the ray's origin
+		__m256 near_root	= _mm256_sub_ps(h, sqrt_discriminant);
+		__m256 far_root		= _mm256_add_ps(h, sqrt_discriminant);
+		__m256 distance		= _mm256_blendv_ps(far_root, near_root, _mm256_cmp_ps(near_root, epsilon, _CMP_GE_OQ));
+
+		__m256 closer = _mm256_and_ps(_mm256_and_ps(has_root, in_range),
+			_mm256_and_ps(_mm256_cmp_ps(distance, epsilon, _CMP_GE_OQ), _mm256_cmp_ps(distance, best_distance, _CMP_LT_OQ)));
+
+		best_distance	= _mm256_blendv_ps(best_distance, distance, closer);
+		best_index		= _mm256_blendv_epi8(best_index, index, _mm256_castps_si256(closer));
+	}
+
+	//reducing the lanes to the closest hit
+	alignas(32) float		lane_distance[8];
+	alignas(32) int32_t		lane_index[8];
+	_mm256_store_ps(lane_distance, best_distance);
+	_mm256_store_si256(reinterpret_cast<__m256i*>(lane_index), best_index);
+
+	bool has_hit = false;
+	for (uint32_t i = 0; i < 8; i++)
+	{
+		if (lane_index[i] >= 0 && lane_distance[i] < closest)
+		{
+			closest		= lane_distance[i];
+			hit_index	= static_cast<uint32_t>(lane_index[i]);
+			has_hit		= true;
+		}
+	}
+
+	return has_hit;
+}
+
+#endif //RAYTRACE_CPU_X86
+
+sphere_soa::hit_kernel sphere_soa::get_kernel(simd_level level)
+{
+	switch (level)
+	{
+		case simd_level::SCALAR:	return &hit_scalar;
+#ifdef RAYTRACE_CPU_X86
+		case simd_level::SSE:		return &hit_sse;
+		case simd_level::AVX2:		return &hit_avx2;
+#endif
+		default:					return nullptr;
+	}
+}
+
+/*===== Sphere SoA =====*/
+
+void sphere_soa::select_kernel(simd_level level)
+{
+	//the CPU support does not change at runtime, asking only once
+	static const simd_level supported = detect_simd_level();
+
+	_level	= static_cast<uint32_t>(level) > static_cast<uint32_t>(supported) ? supported : level;
+	_kernel = get_kernel(_level);
+}
+
+void sphere_soa::alloc(uint32_t nb)
+{
+	clear();
+
+	_nb = nb;
+
+	//padding so that a kernel reading a full vector from the last sphere stays in our arrays
+	uint32_t padded_nb = nb + SIMD_MAX_WIDTH;
+	_center_x.Alloc(padded_nb);
+	_center_y.Alloc(padded_nb);
+	_center_z.Alloc(padded_nb);
+	_radius.Alloc(padded_nb);
+	_material_id.Alloc(padded_nb);
+
+	//the padding is never used as a result, but it is better for it not to hold garbage (such as NaNs)
+	for (uint32_t i = nb; i < padded_nb; i++)
+		set(i, vec3{ 0.0f, 0.0f, 0.0f }, 0.0f, 0);
+
+	if (_kernel == nullptr)
+		select_kernel(simd_level::AVX2);
+}
+
+void sphere_soa::clear()
+{
+	_center_x.Clear();
+	_center_y.Clear();
+	_center_z.Clear();
+	_radius.Clear();
+	_material_id.Clear();
+	_nb = 0;
+}
+
+/*===== Triangle Kernels =====*/
+
+/*
+* every kernel runs the Moller-Trumbore test, on multiple triangles at once.
+* triangles are two sided : a ray hits them whatever their winding.
+*/
+
+//under this determinant, the ray is considered parallel to the triangle
+#define TRIANGLE_PARALLEL_EPSILON 1e-12f
+
+static bool hit_triangles_scalar(const triangle_soa& triangles, const ray& incoming, uint32_t first, uint32_t nb, float& closest, uint32_t& hit_index)
+{
+	bool has_hit = false;
+	for (uint32_t i = first; i < first + nb; i++)
+	{
+		//the vector orthogonal to the ray and the second edge
+		float px = incoming.direction.y * triangles._edge2_z[i] - incoming.direction.z * triangles._edge2_y[i];
+		float py = incoming.direction.z * triangles._edge2_x[i] - incoming.direction.x * triangles._edge2_z[i];
+		float pz = incoming.direction.x * triangles._edge2_y[i] - incoming.direction.y * triangles._edge2_x[i];
+
+		float det = triangles._edge1_x[i] * px + triangles._edge1_y[i] * py + triangles._edge1_z[i] * pz;
+		if (fabsf(det) < TRIANGLE_PARALLEL_EPSILON)
+			continue;
+
+		float inv_det = 1.0f / det;
+
+		//the first barycentric coordinate
+		float tx = incoming.origin.x - triangles._v0_x[i];
+		float ty = incoming.origin.y - triangles._v0_y[i];
+		float tz = incoming.origin.z - triangles._v0_z[i];
+		float u = (tx * px + ty * py + tz * pz) * inv_det;
+		if (u < 0.0f || u > 1.0f)
+			continue;
+
+		//the second barycentric coordinate
+		float qx = ty * triangles._edge1_z[i] - tz * triangles._edge1_y[i];
+		float qy = tz * triangles._edge1_x[i] - tx * triangles._edge1_z[i];
+		float qz = tx * triangles._edge1_y[i] - ty * triangles._edge1_x[i];
+		float v = (incoming.direction.x * qx + incoming.direction.y * qy + incoming.direction.z * qz) * inv_det;
+		if (v < 0.0f || u + v > 1.0f)
+			continue;
+
+		float distance = (triangles._edge2_x[i] * qx + triangles._edge2_y[i] * qy + triangles._edge2_z[i] * qz) * inv_det;
+		if (distance >= HIT_EPSILON && distance < closest)
+		{
+			closest		= distance;
+			hit_index	= i;
+			has_hit		= true;
+		}
+	}
+
+	return has_hit;
+}
+
+#ifdef RAYTRACE_CPU_X86
+
+TARGET_SSE2 static bool hit_triangles_sse(const triangle_soa& triangles, const ray& incoming, uint32_t first, uint32_t nb, float& closest, uint32_t& hit_index)
+{
+	const __m128 origin_x	= _mm_set1_ps(incoming.origin.x);
+	const __m128 origin_y	= _mm_set1_ps(incoming.origin.y);
+	const __m128 origin_z	= _mm_set1_ps(incoming.origin.z);
+	const __m128 dir_x		= _mm_set1_ps(incoming.direction.x);
+	const __m128 dir_y		= _mm_set1_ps(incoming.direction.y);
+	const __m128 dir_z		= _mm_set1_ps(incoming.direction.z);
+	const __m128 epsilon	= _mm_set1_ps(HIT_EPSILON);
+	const __m128 parallel	= _mm_set1_ps(TRIANGLE_PARALLEL_EPSILON);
+	const __m128 zero		= _mm_setzero_ps();
+	const __m128 one		= _mm_set1_ps(1.0f);
+	const __m128 abs_mask	= _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+	//the lanes after the end of the range are not triangles we were asked to test (though they are allocated)
+	const __m128i lane_offsets	= _mm_setr_epi32(0, 1, 2, 3);
+	const __m128i end			= _mm_set1_epi32(static_cast<int32_t>(first + nb));
+
+	//the closest hit found by each lane
+	__m128	best_distance	= _mm_set1_ps(closest);
+	__m128i	best_index		= _mm_set1_epi32(-1);
+
+	for (uint32_t i = first; i < first + nb; i += 4)
+	{
+		__m128i index		= _mm_add_epi32(_mm_set1_epi32(static_cast<int32_t>(i)), lane_offsets);
+		__m128	in_range	= _mm_castsi128_ps(_mm_cmplt_epi32(index, end));
+
+		//a leaf can start anywhere in the arrays, so loads are unaligned
+		__m128 e1x = _mm_loadu_ps(&triangles._edge1_x[i]);
+		__m128 e1y = _mm_loadu_ps(&triangles._edge1_y[i]);
+		__m128 e1z = _mm_loadu_ps(&triangles._edge1_z[i]);
+		__m128 e2x = _mm_loadu_ps(&triangles._edge2_x[i]);
+		__m128 e2y = _mm_loadu_ps(&triangles._edge2_y[i]);
+		__m128 e2z = _mm_loadu_ps(&triangles._edge2_z[i]);
+
+		//the vector orthogonal to the ray and the second edge
+		__m128 px = _mm_sub_ps(_mm_mul_ps(dir_y, e2z), _mm_mul_ps(dir_z, e2y));
+		__m128 py = _mm_sub_ps(_mm_mul_ps(dir_z, e2x), _mm_mul_ps(dir_x, e2z));
+		__m128 pz = _mm_sub_ps(_mm_mul_ps(dir_x, e2y), _mm_mul_ps(dir_y, e2x));
+
+		__m128 det			= _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+		__m128 not_parallel = _mm_cmpge_ps(_mm_and_ps(det, abs_mask), parallel);
+		__m128 inv_det		= _mm_div_ps(one, det);
+
+		//the first barycentric coordinate
+		__m128 tx	= _mm_sub_ps(origin_x, _mm_loadu_ps(&triangles._v0_x[i]));
+		__m128 ty	= _mm_sub_ps(origin_y, _mm_loadu_ps(&triangles._v0_y[i]));
+		__m128 tz	= _mm_sub_ps(origin_z, _mm_loadu_ps(&triangles._v0_z[i]));
+		__m128 u	= _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inv_det);
+
+		//the second barycentric coordinate
+		__m128 qx	= _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+		__m128 qy	= _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+		__m128 qz	= _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+		__m128 v	= _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dir_x, qx), _mm_mul_ps(dir_y, qy)), _mm_mul_ps(dir_z, qz)), inv_det);
+
+		__m128 distance = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv_det);
+
+		__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero)), _mm_cmple_ps(_mm_add_ps(u, v), one));
+		__m128 closer = _mm_and_ps(_mm_and_ps(_mm_and_ps(not_parallel, in_range), inside),
+			_mm_and_ps(_mm_cmpge_ps(distance, epsilon), _mm_cmplt_ps(distance, best_distance)));
+
+		best_distance	= select_sse(closer, distance, best_distance);
+		best_index		= _mm_castps_si128(select_sse(closer, _mm_castsi128_ps(index), _mm_castsi128_ps(best_index)));
+	}
+
+	//reducing the lanes to the closest hit
+	alignas(16) float		lane_distance[4];
+	alignas(16) int32_t		lane_index[4];
+	_mm_store_ps(lane_distance, best_distance);
+	_mm_store_si128(reinterpret_cast<__m128i*>(lane_index), best_index);
+
+	bool has_hit = false;
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		if (lane_index[i] >= 0 && lane_distance[i] < closest)
+		{
+			closest		= lane_distance[i];
+			hit_index	= static_cast<uint32_t>(lane_index[i]);
+			has_hit		= true;
+		}
+	}
+
+	return has_hit;
+}
+
+TARGET_AVX2 static bool hit_triangles_avx2(const triangle_soa& triangles, const ray& incoming, uint32_t first, uint32_t nb, float& closest, uint32_t& hit_index)
+{
+	const __m256 origin_x	= _mm256_set1_ps(incoming.origin.x);
+	const __m256 origin_y	= _mm256_set1_ps(incoming.origin.y);
+	const __m256 origin_z	= _mm256_set1_ps(incoming.origin.z);
+	const __m256 dir_x		= _mm256_set1_ps(incoming.direction.x);
+	const __m256 dir_y		= _mm256_set1_ps(incoming.direction.y);
+	const __m256 dir_z		= _mm256_set1_ps(incoming.direction.z);
+	const __m256 epsilon	= _mm256_set1_ps(HIT_EPSILON);
+	const __m256 parallel	= _mm256_set1_ps(TRIANGLE_PARALLEL_EPSILON);
+	const __m256 zero		= _mm256_setzero_ps();
+	const __m256 one		= _mm256_set1_ps(1.0f);
+	const __m256 abs_mask	= _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+
+	//the lanes after the end of the range are not triangles we were asked to test (though they are allocated)
+	const __m256i lane_offsets	= _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256i end			= _mm256_set1_epi32(static_cast<int32_t>(first + nb));
+
+	//the closest hit found by each lane
+	__m256	best_distance	= _mm256_set1_ps(closest);
+	__m256i	best_index		= _mm256_set1_epi32(-1);
+
+	for (uint32_t i = first; i < first + nb; i += 8)
+	{
+		__m256i index		= _mm256_add_epi32(_mm256_set1_epi32(static_cast<int32_t>(i)), lane_offsets);
+		__m256	in_range	= _mm256_castsi256_ps(_mm256_cmpgt_epi32(end, index));
+
+		//a leaf can start anywhere in the arrays, so loads are unaligned
+		__m256 e1x = _mm256_loadu_ps(&triangles._edge1_x[i]);
+		__m256 e1y = _mm256_loadu_ps(&triangles._edge1_y[i]);
+		__m256 e1z = _mm256_loadu_ps(&triangles._edge1_z[i]);
+		__m256 e2x = _mm256_loadu_ps(&triangles._edge2_x[i]);
+		__m256 e2y = _mm256_loadu_ps(&triangles._edge2_y[i]);
+		__m256 e2z = _mm256_loadu_ps(&triangles._edge2_z[i]);
+
+		//the vector orthogonal to the ray and the second edge
+		__m256 px = _mm256_sub_ps(_mm256_mul_ps(dir_y, e2z), _mm256_mul_ps(dir_z, e2y));
+		__m256 py = _mm256_sub_ps(_mm256_mul_ps(dir_z, e2x), _mm256_mul_ps(dir_x, e2z));
+		__m256 pz = _mm256_sub_ps(_mm256_mul_ps(dir_x, e2y), _mm256_mul_ps(dir_y, e2x));
+
+		__m256 det			= _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+		__m256 not_parallel = _mm256_cmp_ps(_mm256_and_ps(det, abs_mask), parallel, _CMP_GE_OQ);
+		__m256 inv_det		= _mm256_div_ps(one, det);
+
+		//the first barycentric coordinate
+		__m256 tx	= _mm256_sub_ps(origin_x, _mm256_loadu_ps(&triangles._v0_x[i]));
+		__m256 ty	= _mm256_sub_ps(origin_y, _mm256_loadu_ps(&triangles._v0_y[i]));
+		__m256 tz	= _mm256_sub_ps(origin_z, _mm256_loadu_ps(&triangles._v0_z[i]));
+		__m256 u	= _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, px), _mm256_mul_ps(ty, py)), _mm256_mul_ps(tz, pz)), inv_det);
+
+		//the second barycentric coordinate
+		__m256 qx	= _mm256_sub_ps(_mm256_mul_ps(ty, e1z), _mm256_mul_ps(tz, e1y));
+		__m256 qy	= _mm256_sub_ps(_mm256_mul_ps(tz, e1x), _mm256_mul_ps(tx, e1z));
+		__m256 qz	= _mm256_sub_ps(_mm256_mul_ps(tx, e1y), _mm256_mul_ps(ty, e1x));
+		__m256 v	= _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dir_x, qx), _mm256_mul_ps(dir_y, qy)), _mm256_mul_ps(dir_z, qz)), inv_det);
+
+		__m256 distance = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), inv_det);
+
+		__m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ), _mm256_cmp_ps(v, zero, _CMP_GE_OQ)), _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+		__m256 closer = _mm256_and_ps(_mm256_and_ps(_mm256_and_ps(not_parallel, in_range), inside),
+			_mm256_and_ps(_mm256_cmp_ps(distance, epsilon, _CMP_GE_OQ), _mm256_cmp_ps(distance, best_distance, _CMP_LT_OQ)));
+
+		best_distance	= _mm256_blendv_ps(best_distance, distance, closer);
+		best_index		= _mm256_blendv_epi8(best_index, index, _mm256_castps_si256(closer));
+	}
+
+	//reducing the lanes to the closest hit
+	alignas(32) float		lane_distance[8];
+	alignas(32) int32_t		lane_index[8];
+	_mm256_store_ps(lane_distance, best_distance);
+	_mm256_store_si256(reinterpret_cast<__m256i*>(lane_index), best_index);
+
+	bool has_hit = false;
+	for (uint32_t i = 0; i < 8; i++)
+	{
+		if (lane_index[i] >= 0 && lane_distance[i] < closest)
+		{
+			closest		= lane_distance[i];
+			hit_index	= static_cast<uint32_t>(lane_index[i]);
+			has_hit		= true;
+		}
+	}
+
+	return has_hit;
+}
+
+#endif //RAYTRACE_CPU_X86
+
+triangle_soa::hit_kernel triangle_soa::get_kernel(simd_level level)
+{
+	switch (level)
+	{
+		case simd_level::SCALAR:	return &hit_triangles_scalar;
+#ifdef RAYTRACE_CPU_X86
+		case simd_level::SSE:		return &hit_triangles_sse;
+		case simd_level::AVX2:		return &hit_triangles_avx2;
+#endif
+		default:					return nullptr;
+	}
+}
+
+/*===== Triangle SoA =====*/
+
+void triangle_soa::select_kernel(simd_level level)
+{
+	//the CPU support does not change at runtime, asking only once
+	static const simd_level supported = detect_simd_level();
+
+	_level	= static_cast<uint32_t>(level) > static_cast<uint32_t>(supported) ? supported : level;
+	_kernel = get_kernel(_level);
+}
+
+void triangle_soa::alloc(uint32_t nb)
+{
+	clear();
+
+	_nb = nb;
+
+	//padding so that a kernel reading a full vector from the last triangle stays in our arrays
+	uint32_t padded_nb = nb + SIMD_MAX_WIDTH;
+	_v0_x.Alloc(padded_nb);
+	_v0_y.Alloc(padded_nb);
+	_v0_z.Alloc(padded_nb);
+	_edge1_x.Alloc(padded_nb);
+	_edge1_y.Alloc(padded_nb);
+	_edge1_z.Alloc(padded_nb);
+	_edge2_x.Alloc(padded_nb);
+	_edge2_y.Alloc(padded_nb);
+	_edge2_z.Alloc(padded_nb);
+	_triangle_id.Alloc(padded_nb);
+
+	//the padding is never used as a result, but it is better for it not to hold garbage (such as NaNs)
+	vec3 origin{ 0.0f, 0.0f, 0.0f };
+	for (uint32_t i = nb; i < padded_nb; i++)
+		set(i, origin, origin, origin, 0);
+
+	if (_kernel == nullptr)
+		select_kernel(simd_level::AVX2);
+}
+
+void triangle_soa::clear()
+{
+	_v0_x.Clear();
+	_v0_y.Clear();
+	_v0_z.Clear();
+	_edge1_x.Clear();
+	_edge1_y.Clear();
+	_edge1_z.Clear();
+	_edge2_x.Clear();
+	_edge2_y.Clear();
+	_edge2_z.Clear();
+	_triangle_id.Clear();
+	_nb = 0;
+}
@@ -0,0 +1,229 @@
+#include "RaytraceCPUStats.h"
+
+//to export the history
+#include "rapidjson/document.h"
+#include "rapidjson/filewritestream.h"
+#include "rapidjson/prettywriter.h"
+
+/*===== Counters =====*/
+
+void trace_counters::add(const trace_counters& counters)
+{
+	for (uint32_t i = 0; i < CPU_STATS_DEPTH_NB; i++)
+		_ray_nb[i] += counters._ray_nb[i];
+	_shadow_ray_nb	+= counters._shadow_ray_nb;
+	_prim_test_nb	+= counters._prim_test_nb;
+	_node_visit_nb	+= counters._node_visit_nb;
+}
+
+void thread_trace_counters::add(const trace_counters& counters)
+{
+	for (uint32_t i = 0; i < CPU_STATS_DEPTH_NB; i++)
+		_ray_nb[i].fetch_add(counters._ray_nb[i]);
+	_shadow_ray_nb.fetch_add(counters._shadow_ray_nb);
+	_prim_test_nb.fetch_add(counters._prim_test_nb);
+	_node_visit_nb.fetch_add(counters._node_visit_nb);
+}
+
+void thread_trace_counters::take(trace_counters& counters)
+{
+	for (uint32_t i = 0; i < CPU_STATS_DEPTH_NB; i++)
+		counters._ray_nb[i] = _ray_nb[i].exchange(0);
+	counters._shadow_ray_nb = _shadow_ray_nb.exchange(0);
+	counters._prim_test_nb	= _prim_test_nb.exchange(0);
+	counters._node_visit_nb = _node_visit_nb.exchange(0);
+}
+
+/*===== Graphs =====*/
+
+const char* stats_graph_name(stats_graph graph)
+{
+	switch (graph)
+	{
+		case stats_graph::RAYS:					return "Rays";
+		case stats_graph::PRIM_TESTS_PER_RAY:	return "Primitive Tests / Ray";
+		case stats_graph::NODE_VISITS_PER_RAY:	return "Node Visits / Ray";
+		case stats_graph::BUSY:					return "Busy (%)";
+		case stats_graph::QUEUE_WAIT:			return "Queue Wait / Job (ms)";
+		case stats_graph::IDLE:					return "Idle (%)";
+		default:								return "Unknown";
+	}
+}
+
+/*===== Stats =====*/
+
+void render_stats::alloc(uint32_t thread_nb)
+{
+	clear();
+
+	_thread_nb = thread_nb;
+	_ThreadCounters.Alloc(thread_nb + 1);
+	_LastPoolValues.Alloc(thread_nb * 4);
+	ZERO_SET(_LastPoolValues, thread_nb * 4 * sizeof(uint64_t));
+	_History.Alloc(CPU_STATS_HISTORY_NB);
+	_ThreadHistory.Alloc(CPU_STATS_HISTORY_NB * (thread_nb > 0 ? thread_nb : 1));
+}
+
+void render_stats::clear()
+{
+	_ThreadCounters.Clear();
+	_LastPoolValues.Clear();
+	_History.Clear();
+	_ThreadHistory.Clear();
+	_thread_nb	= 0;
+	_first		= 0;
+	_frame_nb	= 0;
+}
+
+void render_stats::collect(const ThreadPool& Pool, float frame_ms)
+{
+	if (_History == nullptr)
+		return;
+
+	//the oldest frame makes room for the new one once the history is full
+	uint32_t slot = (_first + _frame_nb) % CPU_STATS_HISTORY_NB;
+	if (_frame_nb < CPU_STATS_HISTORY_NB)
+		_frame_nb++;
+	else
+		_first = (_first + 1) % CPU_STATS_HISTORY_NB;
+
+	frame_stats& frame	= _History[slot];
+	frame				= frame_stats{};
+	frame._frame_ms		= frame_ms;
+
+	for (uint32_t i = 0; i <= _thread_nb; i++)
+	{
+		trace_counters counters;
+		_ThreadCounters[i].take(counters);
+		frame._Counters.add(counters);
+
+		//the last counters are the ones of the jobs that did not run on the pool
+		if (i == _thread_nb)
+			break;
+
+		//the pool counts from the start, we only keep what the frame added (nothing if the busy times were reset in between)
+		uint64_t poolValues[4] = { Pool.GetThreadBusyTime(i), Pool.GetThreadQueueWaitTime(i), Pool.GetThreadIdleTime(i), Pool.GetThreadJobNb(i) };
+		uint64_t frameValues[4];
+		for (uint32_t j = 0; j < 4; j++)
+		{
+			uint64_t& last	= _LastPoolValues[i * 4 + j];
+			frameValues[j]	= poolValues[j] >= last ? poolValues[j] - last : 0;
+			last			= poolValues[j];
+		}
+
+		thread_frame_stats& threadFrame = _ThreadHistory[i * CPU_STATS_HISTORY_NB + slot];
+		threadFrame._ray_nb			= counters.total_ray_nb();
+		threadFrame._busy_ms		= static_cast<float>(frameValues[0]) * 1e-6f;
+		threadFrame._queue_wait_ms	= static_cast<float>(frameValues[1]) * 1e-6f;
+		threadFrame._idle_ms		= static_cast<float>(frameValues[2]) * 1e-6f;
+		threadFrame._job_nb			= frameValues[3];
+
+		frame._Threads._ray_nb			+= threadFrame._ray_nb;
+		frame._Threads._job_nb			+= threadFrame._job_nb;
+		frame._Threads._busy_ms			+= threadFrame._busy_ms;
+		frame._Threads._queue_wait_ms	+= threadFrame._queue_wait_ms;
+		frame._Threads._idle_ms			+= threadFrame._idle_ms;
+	}
+}
+
+thread_frame_stats render_stats::thread_average(uint32_t thread_index)const
+{
+	thread_frame_stats average;
+	if (_frame_nb == 0)
+		return average;
+
+	for (uint32_t i = 0; i < _frame_nb; i++)
+	{
+		const thread_frame_stats& threadFrame = thread_frame(thread_index, i);
+		average._ray_nb			+= threadFrame._ray_nb;
+		average._job_nb			+= threadFrame._job_nb;
+		average._busy_ms		+= threadFrame._busy_ms;
+		average._queue_wait_ms	+= threadFrame._queue_wait_ms;
+		average._idle_ms		+= threadFrame._idle_ms;
+	}
+
+	average._ray_nb			/= _frame_nb;
+	average._job_nb			/= _frame_nb;
+	average._busy_ms		/= static_cast<float>(_frame_nb);
+	average._queue_wait_ms	/= static_cast<float>(_frame_nb);
+	average._idle_ms		/= static_cast<float>(_frame_nb);
+	return average;
+}
+
+float render_stats::graph_value(stats_graph graph, uint32_t index)const
+{
+	const frame_stats& frame = _History[(_first + index) % CPU_STATS_HISTORY_NB];
+	float rayNb		= static_cast<float>(frame._Counters.total_ray_nb());
+	float threadMs	= frame._frame_ms * static_cast<float>(_thread_nb);
+
+	switch (graph)
+	{
+		case stats_graph::RAYS:					return rayNb;
+		case stats_graph::PRIM_TESTS_PER_RAY:	return rayNb > 0.0f ? static_cast<float>(frame._Counters._prim_test_nb) / rayNb : 0.0f;
+		case stats_graph::NODE_VISITS_PER_RAY:	return rayNb > 0.0f ? static_cast<float>(frame._Counters._node_visit_nb) / rayNb : 0.0f;
+		case stats_graph::BUSY:					return threadMs > 0.0f ? 100.0f * frame._Threads._busy_ms / threadMs : 0.0f;
+		case stats_graph::QUEUE_WAIT:			return frame._Threads._job_nb > 0 ? frame._Threads._queue_wait_ms / static_cast<float>(frame._Threads._job_nb) : 0.0f;
+		case stats_graph::IDLE:					return threadMs > 0.0f ? 100.0f * frame._Threads._idle_ms / threadMs : 0.0f;
+		default:								return 0.0f;
+	}
+}
+
+bool render_stats::export_json(const char* file_name)const
+{
+	rapidjson::Document statsDocument;
+	statsDocument.SetObject();
+	rapidjson::MemoryPoolAllocator<>& allocator = statsDocument.GetAllocator();
+
+	statsDocument.AddMember("Threads", _thread_nb, allocator);
+
+	rapidjson::Value framesValue(rapidjson::kArrayType);
+	for (uint32_t i = 0; i < _frame_nb; i++)
+	{
+		//the oldest frame first
+		uint32_t age = _frame_nb - 1 - i;
+		const frame_stats& frame = this->frame(age);
+
+		rapidjson::Value frameValue(rapidjson::kObjectType);
+		frameValue.AddMember("FrameMs", frame._frame_ms, allocator);
+
+		rapidjson::Value raysValue(rapidjson::kArrayType);
+		for (uint32_t j = 0; j < CPU_STATS_DEPTH_NB; j++)
+			raysValue.PushBack(frame._Counters._ray_nb[j], allocator);
+		frameValue.AddMember("RaysPerDepth", raysValue, allocator);
+		frameValue.AddMember("ShadowRays", frame._Counters._shadow_ray_nb, allocator);
+		frameValue.AddMember("PrimitiveTests", frame._Counters._prim_test_nb, allocator);
+		frameValue.AddMember("NodeVisits", frame._Counters._node_visit_nb, allocator);
+
+		//what each thread did, to see how the work was shared
+		rapidjson::Value threadsValue(rapidjson::kArrayType);
+		for (uint32_t j = 0; j < _thread_nb; j++)
+		{
+			const thread_frame_stats& threadFrame = thread_frame(j, age);
+
+			rapidjson::Value threadValue(rapidjson::kObjectType);
+			threadValue.AddMember("Rays", threadFrame._ray_nb, allocator);
+			threadValue.AddMember("Jobs", threadFrame._job_nb, allocator);
+			threadValue.AddMember("BusyMs", threadFrame._busy_ms, allocator);
+			threadValue.AddMember("QueueWaitMs", threadFrame._queue_wait_ms, allocator);
+			threadValue.AddMember("IdleMs", threadFrame._idle_ms, allocator);
+			threadsValue.PushBack(threadValue, allocator);
+		}
+		frameValue.AddMember("Threads", threadsValue, allocator);
+
+		framesValue.PushBack(frameValue, allocator);
+	}
+	statsDocument.AddMember("Frames", framesValue, allocator);
+
+	//discarding the file's previous content, or creating a new one
+	FILE* jsonFile = fopen(file_name, "w");
+	if (jsonFile == nullptr)
+		return false;
+
+	char writeBuffer[4096];
+	rapidjson::FileWriteStream writeStream(jsonFile, writeBuffer, sizeof(writeBuffer));
+	rapidjson::PrettyWriter<rapidjson::FileWriteStream> writer(writeStream);
+	bool written = statsDocument.Accept(writer);
+
+	fclose(jsonFile);
+	return written;
+}
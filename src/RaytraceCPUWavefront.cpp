@@ -0,0 +1,112 @@
+#include "RaytraceCPUWavefront.h"
+
+/*===== Stages =====*/
+
+const char* wavefront_stage_name(wavefront_stage stage)
+{
+	switch (stage)
+	{
+		case wavefront_stage::GENERATE:		return "Generate";
+		case wavefront_stage::EXTEND:		return "Extend";
+		case wavefront_stage::SHADE:		return "Shade";
+		case wavefront_stage::ACCUMULATE:	return "Accumulate";
+		default:							return "Unknown";
+	}
+}
+
+/*===== Rays =====*/
+
+void wavefront_rays::alloc(uint32_t nb)
+{
+	_origin_x.Alloc(nb);
+	_origin_y.Alloc(nb);
+	_origin_z.Alloc(nb);
+	_direction_x.Alloc(nb);
+	_direction_y.Alloc(nb);
+	_direction_z.Alloc(nb);
+	_color_r.Alloc(nb);
+	_color_g.Alloc(nb);
+	_color_b.Alloc(nb);
+	_radiance_r.Alloc(nb);
+	_radiance_g.Alloc(nb);
+	_radiance_b.Alloc(nb);
+	_pixel_index.Alloc(nb);
+	_sample.Alloc(nb);
+	_bounce.Alloc(nb);
+}
+
+void wavefront_rays::clear()
+{
+	_origin_x.Clear();
+	_origin_y.Clear();
+	_origin_z.Clear();
+	_direction_x.Clear();
+	_direction_y.Clear();
+	_direction_z.Clear();
+	_color_r.Clear();
+	_color_g.Clear();
+	_color_b.Clear();
+	_radiance_r.Clear();
+	_radiance_g.Clear();
+	_radiance_b.Clear();
+	_pixel_index.Clear();
+	_sample.Clear();
+	_bounce.Clear();
+}
+
+/*===== Wavefront =====*/
+
+void wavefront::alloc(uint32_t capacity)
+{
+	clear();
+
+	_capacity = capacity;
+	_rays[0].alloc(capacity);
+	_rays[1].alloc(capacity);
+	_hits.Alloc(capacity);
+	_has_hit.Alloc(capacity);
+}
+
+void wavefront::clear()
+{
+	_rays[0].clear();
+	_rays[1].clear();
+	_hits.Clear();
+	_has_hit.Clear();
+	_capacity	= 0;
+	_path_nb	= 0;
+	_done.store(false);
+}
+
+void wavefront::reset(uint32_t path_nb)
+{
+	_path_nb		= path_nb;
+	_first_path		= 0;
+	_wave_path_nb	= 0;
+	_ray_nb			= 0;
+	_current		= 0;
+	_next_ray_nb.store(0);
+	_pending_job_nb.store(0);
+	_stage			= wavefront_stage::GENERATE;
+	_done.store(path_nb == 0);
+
+	for (uint32_t i = 0; i < static_cast<uint32_t>(wavefront_stage::NB); i++)
+		_stage_ns[i].store(0);
+}
+
+bool wavefront::next_wave()
+{
+	_first_path += _wave_path_nb;
+	if (_first_path >= _path_nb)
+	{
+		_done.store(true);
+		return false;
+	}
+
+	//the last wave may not be full
+	_wave_path_nb	= _path_nb - _first_path < _capacity ? _path_nb - _first_path : _capacity;
+	_ray_nb			= 0;
+	_current		= 0;
+	_stage			= wavefront_stage::GENERATE;
+	return true;
+}
@@ -11,6 +11,9 @@
 //include serialization
 #include "SerializationHelper.h"
 
+//include the shaders' sampling functions
+#include "RaytraceGPUSampling.h"
+
 #define NUMBER_OF_SPHERES 30
 
 /*===== Import =====*/
@@ -226,9 +229,10 @@ void RaytraceGPU::PrepareVulkanRaytracingProps(GraphicsAPIManager& GAPI)
 void RaytraceGPU::PrepareVulkanRaytracingScripts(class GraphicsAPIManager& GAPI)
 {
 	//define ray gen shader
-	const char* ray_gen_shader =
-		R"(#version 460
+	const std::string ray_gen_shader =
+		std::string(R"(#version 460
 			#extension GL_EXT_ray_tracing : enable
+)") + gpu_sampling_glsl() + R"(
 
 			struct HitRecord 
 			{
@@ -241,28 +245,6 @@ void RaytraceGPU::PrepareVulkanRaytracingScripts(class GraphicsAPIManager& GAPI)
 			};
 			layout(location = 0) rayPayloadEXT HitRecord payload;
 
-			uint RandomInt(inout uint seed)
-			{
-				//using PCG hash for random number seed generation (found from this https://www.reedbeta.com/blog/hash-functions-for-gpu-rendering/)
-				seed = seed * 747796405u + 2891336453u;
-				uint word = ((seed >> ((seed >> 28u) + 4u)) ^ seed) * 277803737u;
-				return (word >> 22u) ^ word;
-
-				// LCG values from Numerical Recipes
-			    //return (seed = 1664525 * seed + 1013904223);
-			}
-
-			float RandomFloat(inout uint seed)
-			{
-				//// Float version using bitmask from Numerical Recipes
-				//const uint one = 0x3f800000;
-				//const uint msk = 0x007fffff;
-				//return uintBitsToFloat(one | (msk & (RandomInt(seed) >> 9))) - 1;
-			
-				// Faster version from NVIDIA examples; quality good enough for our use case.
-				return (float(RandomInt(seed) & 0x00FFFFFF) / float(0x01000000));
-			}
-
 			layout(binding = 0) uniform accelerationStructureEXT topLevelAS;
 			layout(set = 1, binding = 0, rgba32f) uniform image2D image;
 			layout(set = 1, binding = 1) uniform UniformBuffer
@@ -281,13 +263,13 @@ void RaytraceGPU::PrepareVulkanRaytracingScripts(class GraphicsAPIManager& GAPI)
 			{
 				vec3 finalColor = vec3(0.0);
 
-				uint seed = 1;
-				payload.RandomSeed = (gl_LaunchIDEXT.x * gl_LaunchSizeEXT.x + gl_LaunchIDEXT.y);
-				payload.RandomSeed = RandomInt(payload.RandomSeed);
+				//every pixel has its own scrambling of the sequence, and every sample is a point of it
+				uint pixelSeed = HashUint(gl_LaunchIDEXT.y * gl_LaunchSizeEXT.x + gl_LaunchIDEXT.x);
 
 				for (int j = 0; j < nb_samples; j++)
 				{
-					const vec2 pixelCenter = vec2(gl_LaunchIDEXT.xy) + vec2(RandomFloat(seed) - 0.5,RandomFloat(seed) - 0.5);
+					//the first pair of dimensions jitters the ray in the pixel
+					const vec2 pixelCenter = vec2(gl_LaunchIDEXT.xy) + SobolOwen2D(uint(j), pixelSeed, 0u) - 0.5;
 
 					//finding the pixel we are computing from the ray launch arguments
 					const vec2 inUV = (pixelCenter) / vec2(gl_LaunchSizeEXT.xy);
@@ -312,6 +294,9 @@ void RaytraceGPU::PrepareVulkanRaytracingScripts(class GraphicsAPIManager& GAPI)
 
 					for (int i = 0; i < depth; i++)
 					{
+						//every bounce gets its own pair of dimensions, packed in the payload for the material
+						payload.RandomSeed = packUnorm2x16(SobolOwen2D(uint(j), pixelSeed, uint(1 + i)));
+
 						//tracing rays
 						traceRayEXT(
 							topLevelAS,//Acceleration structure
@@ -561,45 +546,10 @@ void RaytraceGPU::PrepareVulkanRaytracingScripts(class GraphicsAPIManager& GAPI)
 			})";
 
 	//define diffuse shader
-	const char* diffuse_shader =
-		R"(#version 460
+	const std::string diffuse_shader =
+		std::string(R"(#version 460
 			#extension GL_EXT_ray_tracing : enable
-
-			uint RandomInt(inout uint seed)
-			{
-				//using PCG hash for random number seed generation (found from this https://www.reedbeta.com/blog/hash-functions-for-gpu-rendering/)
-				seed = seed * 747796405u + 2891336453u;
-				uint word = ((seed >> ((seed >> 28u) + 4u)) ^ seed) * 277803737u;
-				return (word >> 22u) ^ word;
-
-				// LCG values from Numerical Recipes
-			    //return (seed = 1664525 * seed + 1013904223);
-			}
-
-			float RandomFloat(inout uint seed)
-			{
-				//// Float version using bitmask from Numerical Recipes
-				//const uint one = 0x3f800000;
-				//const uint msk = 0x007fffff;
-				//return uintBitsToFloat(one | (msk & (RandomInt(seed) >> 9))) - 1;
-			
-				// Faster version from NVIDIA examples; quality good enough for our use case.
-				return (float(RandomInt(seed) & 0x00FFFFFF) / float(0x01000000));
-			}
-			
-			
-			
-			vec3 RandomInUnitSphere(inout uint seed)
-			{
-				for (;;)
-				{
-					const vec3 p = 2 * vec3(RandomFloat(seed), RandomFloat(seed), RandomFloat(seed)) - 1;
-					if (dot(p, p) < 1)
-					{
-						return p;
-					}
-				}
-			}
+)") + gpu_sampling_glsl() + R"(
 
 			struct RayDispatch
 			{
@@ -613,7 +563,8 @@ void RaytraceGPU::PrepareVulkanRaytracingScripts(class GraphicsAPIManager& GAPI)
 
 			void main()
 			{
-				const vec3 rand = RandomInUnitSphere(callablePayload.RandomSeed);
+				//a point on the unit sphere around the tip of the normal gives a cosine weighted direction
+				const vec3 rand = UniformSphere(unpackUnorm2x16(callablePayload.RandomSeed));
 				callablePayload.normal = normalize(callablePayload.normal + rand);
 
 			})";
@@ -651,28 +602,6 @@ void RaytraceGPU::PrepareVulkanRaytracingScripts(class GraphicsAPIManager& GAPI)
 		R"(#version 460
 			#extension GL_EXT_ray_tracing : enable
 
-			uint RandomInt(inout uint seed)
-			{
-				//using PCG hash for random number seed generation (found from this https://www.reedbeta.com/blog/hash-functions-for-gpu-rendering/)
-				seed = seed * 747796405u + 2891336453u;
-				uint word = ((seed >> ((seed >> 28u) + 4u)) ^ seed) * 277803737u;
-				return (word >> 22u) ^ word;
-
-				// LCG values from Numerical Recipes
-			    //return (seed = 1664525 * seed + 1013904223);
-			}
-
-			float RandomFloat(inout uint seed)
-			{
-				//// Float version using bitmask from Numerical Recipes
-				//const uint one = 0x3f800000;
-				//const uint msk = 0x007fffff;
-				//return uintBitsToFloat(one | (msk & (RandomInt(seed) >> 9))) - 1;
-			
-				// Faster version from NVIDIA examples; quality good enough for our use case.
-				return (float(RandomInt(seed) & 0x00FFFFFF) / float(0x01000000));
-			}
-
 			struct RayDispatch
 			{
 				vec3	direction;// the original directio of the hit 
@@ -711,7 +640,7 @@ void RaytraceGPU::PrepareVulkanRaytracingScripts(class GraphicsAPIManager& GAPI)
 				reflectance = reflectance + (1.0f * reflectance) * pow((1.0f - cos_ray_normal), 5);
 
 				//as snell's law is an approximation, it actually takes more of a probabilistic approach, thus the random.
-				if (cannot_refract || reflectance > RandomFloat(callablePayload.RandomSeed) )
+				if (cannot_refract || reflectance > unpackUnorm2x16(callablePayload.RandomSeed).x )
 				{
 					callablePayload.normal = normalize(direction - (normal * 2.0f * dot(direction, normal)));
 				}
@@ -732,7 +661,7 @@ void RaytraceGPU::PrepareVulkanRaytracingScripts(class GraphicsAPIManager& GAPI)
 		VulkanHelper::ShaderScripts Script;
 		
 		//add raygen shader
-		if (CreateVulkanShaders(GAPI._VulkanUploader, Script, VK_SHADER_STAGE_RAYGEN_BIT_KHR, ray_gen_shader, "Raytrace GPU RayGen"))
+		if (CreateVulkanShaders(GAPI._VulkanUploader, Script, VK_SHADER_STAGE_RAYGEN_BIT_KHR, ray_gen_shader.c_str(), "Raytrace GPU RayGen"))
 			_RayShaders.Add(Script);
 
 		//add miss shader
@@ -748,7 +677,7 @@ void RaytraceGPU::PrepareVulkanRaytracingScripts(class GraphicsAPIManager& GAPI)
 			_RayShaders.Add(Script);
 
 		//add callable shaders
-		if (CreateVulkanShaders(GAPI._VulkanUploader, Script, VK_SHADER_STAGE_CALLABLE_BIT_KHR, diffuse_shader, "Raytrace GPU Diffuse"))
+		if (CreateVulkanShaders(GAPI._VulkanUploader, Script, VK_SHADER_STAGE_CALLABLE_BIT_KHR, diffuse_shader.c_str(), "Raytrace GPU Diffuse"))
 			_RayShaders.Add(Script);
 		if (CreateVulkanShaders(GAPI._VulkanUploader, Script, VK_SHADER_STAGE_CALLABLE_BIT_KHR, metal_shader, "Raytrace GPU Metal"))
 			_RayShaders.Add(Script);
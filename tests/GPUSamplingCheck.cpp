@@ -0,0 +1,85 @@
+/*
+* checks that the glsl sampling functions the GPU raytracers use give out the same samples as the CPU raytracer's sequence_sampler.
+* the glsl code is compiled as C++ with the few glsl types and functions it uses, then compared for the first indices of a few pixels and pairs of dimensions.
+*/
+#include <stdio.h>
+
+#ifndef _WIN32
+#define __forceinline inline
+#endif
+#include "Maths.h"
+
+namespace glsl
+{
+	typedef uint32_t uint;
+
+	struct uvec2
+	{
+		uint x, y;
+		uvec2(uint x_, uint y_) : x{ x_ }, y{ y_ } {}
+		uvec2 operator>>(uint shift)const { return uvec2(x >> shift, y >> shift); }
+	};
+
+	struct vec2
+	{
+		float x, y;
+		explicit vec2(const uvec2& v) : x{ static_cast<float>(v.x) }, y{ static_cast<float>(v.y) } {}
+		vec2 operator*(double scale)const { vec2 scaled = *this; scaled.x *= static_cast<float>(scale); scaled.y *= static_cast<float>(scale); return scaled; }
+	};
+
+	struct vec3
+	{
+		float x, y, z;
+		vec3(float x_, float y_, float z_) : x{ x_ }, y{ y_ }, z{ z_ } {}
+	};
+
+	//written bit by bit, so that it does not share anything with the CPU's reverse_bits
+	inline uint bitfieldReverse(uint x)
+	{
+		uint reversed = 0u;
+		for (uint i = 0u; i < 32u; i++)
+			reversed |= ((x >> i) & 1u) << (31u - i);
+		return reversed;
+	}
+
+	inline double max(double a, double b) { return a > b ? a : b; }
+
+	//the glsl code is put here as C++ : the function giving it out as a string is closed right away
+#define GPU_SAMPLING_GLSL(...) nullptr; } __VA_ARGS__ inline void gpu_sampling_glsl_end() {
+#include "RaytraceGPUSampling.h"
+}
+
+int main()
+{
+	const uint32_t index_nb		= 4096;
+	const uint32_t pixel_seeds[]	= { 0u, 1u, 0x9e3779b9u, 123456789u };
+	const uint32_t pair_nb		= 4;
+
+	uint32_t mismatch_nb = 0;
+	for (uint32_t pixel_seed : pixel_seeds)
+		for (uint32_t pair = 0; pair < pair_nb; pair++)
+			for (uint32_t index = 0; index < index_nb; index++)
+			{
+				sequence_sampler sampler(sample_sequence::SOBOL, index, pixel_seed);
+				sampler.skip_to(pair * 2);
+				float x = sampler.next_float();
+				float y = sampler.next_float();
+
+				glsl::vec2 gpu = glsl::SobolOwen2D(index, pixel_seed, pair);
+				if (gpu.x != x || gpu.y != y)
+				{
+					if (mismatch_nb < 10)
+						printf("mismatch for pixel seed %u, pair %u, index %u : cpu (%f, %f), glsl (%f, %f)\n", pixel_seed, pair, index, x, y, gpu.x, gpu.y);
+					mismatch_nb++;
+				}
+			}
+
+	if (mismatch_nb > 0)
+	{
+		printf("GPU sampling check failed : %u samples differ\n", mismatch_nb);
+		return 1;
+	}
+
+	printf("GPU sampling check passed : the glsl and CPU sequences match\n");
+	return 0;
+}